@@ -46,6 +46,7 @@ class Data{
   T* copy_column(unsigned long long int);
   void data_construct();
   void construct(T * data, unsigned int offset = 0);
+  void append(const T * data, unsigned long long int count);
   bool is_empty() const{ return m_empty;}
   void increment_data_stream();
   T get_element( unsigned long long int, unsigned long long int );
@@ -70,6 +71,7 @@ class Data{
   long long unsigned int m_p; //columns
   long long unsigned int m_p_max; //columns
   long long unsigned m_range_rows;
+  unsigned long long int m_capacity;//length of the allocated row m_X[0] when m_n==1, used by append.
   bool m_empty;//set to true if the source data file is empty
   bool m_streaming;
   unsigned long long int m_window_size;//the number of columns held in the data matrix when m_streaming==true.
@@ -189,6 +191,42 @@ void Data<T>::construct(T * data, unsigned int offset)
     m_X=new T* [1];
     m_X[0]=new T[1];
   }
+  m_capacity = m_p;
+}
+
+/*append values to the end of a single row of data, eg event times arriving
+  online. The row grows geometrically so repeated appends are amortised O(1).*/
+template <class T>
+void Data<T>::append(const T * data, unsigned long long int count){
+  if(!count)
+    return;
+  if(m_n!=1){
+    cerr << "Data.hpp: append is only supported for a single row of data" << endl;
+    exit(1);
+  }
+  if(m_empty){
+    m_p = 0;
+    m_range_X[0][0] = m_range_X[0][1] = data[0];
+  }
+  if(m_p+count>m_capacity){
+    unsigned long long int capacity = 2*m_capacity > m_p+count ? 2*m_capacity : m_p+count;
+    T* row = new T[capacity];
+    for(unsigned long long int j=0; j<m_p; j++)
+      row[j] = m_X[0][j];
+    delete [] m_X[0];
+    m_X[0] = row;
+    m_capacity = capacity;
+  }
+  for(unsigned long long int j=0; j<count; j++){
+    m_X[0][m_p+j] = data[j];
+    if(data[j]<m_range_X[0][0])
+      m_range_X[0][0] = data[j];
+    else if(data[j]>m_range_X[0][1])
+      m_range_X[0][1] = data[j];
+  }
+  m_p += count;
+  m_p_max = m_p;
+  m_empty = false;
 }
 
 template <class T>
@@ -244,6 +282,7 @@ void Data<T>::data_construct(){
     m_range_X[0]=new T[m_range_rows*2];
     m_range_X[0][0] = m_range_X[0][1] = m_X[0][0];
   }
+  m_capacity = m_p;
 
   for (i=1;i<m_n;i++){
     m_X[i]=m_X[i-1]+m_p;
@@ -3,6 +3,44 @@
 #include <math.h>
 #include "decay_function.hpp"
 
+//log I_x(a,b), the regularized incomplete beta function, by its continued fraction (Lentz's method),
+//which converges quickly for x < (a+1)/(a+b+2). Everything but the fraction is kept in logs, so the
+//far tails do not underflow.
+static double log_incomplete_beta( double a, double b, double log_x, double log_1mx ){
+  const double tiny = 1e-300;
+  double x = exp(log_x);
+  double c = 1, d = 1-(a+b)*x/(a+1);
+  if(fabs(d)<tiny)
+    d = tiny;
+  d = 1/d;
+  double h = d;
+  for( unsigned int m = 1; m <= 100000; m++ ){
+    double m2 = 2.0*m;
+    double aa = m*(b-m)*x/((a+m2-1)*(a+m2));
+    d = 1+aa*d;
+    if(fabs(d)<tiny)
+      d = tiny;
+    c = 1+aa/c;
+    if(fabs(c)<tiny)
+      c = tiny;
+    d = 1/d;
+    h *= d*c;
+    aa = -(a+m)*(a+b+m)*x/((a+m2)*(a+m2+1));
+    d = 1+aa*d;
+    if(fabs(d)<tiny)
+      d = tiny;
+    c = 1+aa/c;
+    if(fabs(c)<tiny)
+      c = tiny;
+    d = 1/d;
+    double del = d*c;
+    h *= del;
+    if(fabs(del-1)<1e-15)
+      break;
+  }
+  return a*log_x + b*log_1mx - gsl_sf_lnbeta(a,b) - log(a) + log(h);
+}
+
 pp_model::pp_model(double alpha,double beta, Data<double> * data, Step_Function* time_scale, Step_Function* seasonal_scale )
 :probability_model(data,seasonal_scale),m_alpha(alpha),m_beta(beta)
 {
@@ -73,6 +111,17 @@ pp_model::~pp_model(){
     delete (Decay_Function*)m_pp_time_scale;
 }
 
+probability_model* pp_model::clone() const{
+  //regression models restore the shared count data on destruction and random means draw from m_rng
+  if(m_poisson_regression || m_random_mean)
+    return NULL;
+  pp_model* pm = new pp_model(*this);
+  pm->release_shared_ownership();
+  if(m_shot_noise_rate > 0)
+    pm->m_pp_time_scale = (Univariate_Function*)new Decay_Function(m_shot_noise_rate);
+  return pm;
+}
+
 void pp_model::use_random_mean(int seed) {
   m_random_mean = 1;
   m_rng = gsl_rng_alloc(gsl_rng_taus);
@@ -84,6 +133,7 @@ void pp_model::construct(){
   m_alternative_gamma_prior=false;
   m_likelihood_term_zero = m_alpha*log(m_beta);
   m_likelihood_term = m_likelihood_term_zero-gsl_sf_lngamma(m_alpha);
+  m_lgamma.reset(m_alpha,m_data_cont ? m_data_cont->get_cols() : 0);
   if( m_seasonal_analysis )
     collapse_to_seasons();
   m_poisson_regression = false;
@@ -188,13 +238,31 @@ double pp_model::log_likelihood_interval_with_count(double t1, double t2, unsign
   return (m_shot_noise_rate*r*t1)+log_likelihood_length_and_count(m_t,r);
 }
 
+//the logs are taken in a pass of their own, free of branches and calls through the model
+void pp_model::log_likelihood_intervals_with_count(unsigned long long int n, const double * t1, const double * t2, const unsigned long long int * r, double * ll){
+  if(m_pp_time_scale){
+    probability_model::log_likelihood_intervals_with_count(n,t1,t2,r,ll);
+    return;
+  }
+  for(unsigned long long int i=0; i<n; i++)
+    ll[i] = log(m_beta+(t2[i]-t1[i]));
+  for(unsigned long long int i=0; i<n; i++){
+    if(t2[i]-t1[i]<=0)
+      ll[i] = log_likelihood_interval_with_count(t1[i],t2[i],r[i]);
+    else if(!r[i])
+      ll[i] = (m_shot_noise_rate*r[i]*t1[i])+(m_likelihood_term_zero - m_alpha*ll[i]);
+    else
+      ll[i] = (m_shot_noise_rate*r[i]*t1[i])+(m_likelihood_term + m_lgamma(m_alpha,r[i]) - (r[i]+m_alpha)*ll[i]);
+  }
+}
+
 double pp_model::log_likelihood_length_and_count(double t, unsigned long long int r){
     if(t<=0)
       return 0;
     if(!r)
       return m_likelihood_term_zero - m_alpha*log(m_beta+t);
     //cout << r << " " << m_alpha << endl;
-    return m_likelihood_term + gsl_sf_lngamma(r+m_alpha) - (r+m_alpha)*log(m_beta+t);
+    return m_likelihood_term + m_lgamma(m_alpha,r) - (r+m_alpha)*log(m_beta+t);
 }
 
 double pp_model::poisson_regression_log_likelihood_interval(unsigned long long int i1, unsigned long long int i2){
@@ -313,9 +381,54 @@ double pp_model::calculate_log_posterior_predictive_pdf( double t, unsigned long
   return m_log_predictive_pdf;
 }
 
-double pp_model::calculate_log_posterior_predictive_df( double t, unsigned long long int r, bool lower_tail ){
+void pp_model::negative_binomial_log_tails( unsigned long long int k, double log_p, double log_q, double & log_lower, double & log_upper ){
+  //P(X<=k) = I_p(alpha,k+1); the smaller tail comes from the continued fraction, the other by complement
+  double a = m_alpha_star, b = k+1.0;
+  if(exp(log_p) < (a+1)/(a+b+2)){
+    log_lower = log_incomplete_beta(a,b,log_p,log_q);
+    log_upper = log1p(-exp(log_lower));
+  }else{
+    log_upper = log_incomplete_beta(b,a,log_q,log_p);
+    log_lower = log1p(-exp(log_upper));
+  }
+}
+
+double pp_model::calculate_log_posterior_predictive_df_closed_form( double t, unsigned long long int r, bool lower_tail ){
+  double log_p = log(m_beta_star)-log(m_beta_star+t);
+  double log_t_b = log(t)-log(m_beta_star+t);
+  m_log_pdf_const = m_alpha_star*log_p;
+  m_log_predictive_pdf = m_log_pdf_const + r*log_t_b + gsl_sf_lngamma(m_alpha_star+r) - gsl_sf_lngamma(m_alpha_star) - gsl_sf_lngamma(r+1.0);
+  m_df_values.clear();
+  m_pdf_values.clear();
+  double df = 0, df2 = 0, unused;
+  //the same endpoints as the sum over the pmf below: P(X<=r), P(X<=r-1) or P(X>=r), P(X>r)
+  if(lower_tail){
+    negative_binomial_log_tails(r,log_p,log_t_b,df,unused);
+    if(r>0)
+      negative_binomial_log_tails(r-1,log_p,log_t_b,df2,unused);
+  }else{
+    if(r>0)
+      negative_binomial_log_tails(r-1,log_p,log_t_b,unused,df);
+    if(m_log_predictive_pdf>df)//due to rounding errors
+      df = m_log_predictive_pdf;
+    negative_binomial_log_tails(r,log_p,log_t_b,unused,df2);
+  }
+  //kept on the log scale, where the far tails do not underflow
+  m_pvalue_pair = make_pair(df2,df);
+  m_p_value_endpoints.clear();
+  m_p_value_endpoints.push_back(m_pvalue_pair);
+  m_pvalue_pair_on_log_scale = true;
+  m_p_value_endpoints_log_scale.clear();
+  m_p_value_endpoints_log_scale.push_back(m_pvalue_pair_on_log_scale);
+  return combine_p_values_from_endpoints(false);
+}
+
+double pp_model::calculate_log_posterior_predictive_df( double t, unsigned long long int r, bool lower_tail, bool two_sided ){
   if(t<=0)// || (!lower_tail && !r ))
     return -LOG_TWO;
+  //the two-sided p-value needs the whole ordering of the pmf against the observed tail, so only it sums the terms
+  if(!two_sided)
+    return calculate_log_posterior_predictive_df_closed_form(t,r,lower_tail);
   double t_b = t/(m_beta_star+t);
   double log_t_b = log(t)-log(m_beta_star+t);
   m_log_pdf_const = m_alpha_star*(log(m_beta_star)-log(m_beta_star+t));
@@ -420,23 +533,69 @@ double pp_model::calculate_log_posterior_predictive_df( double t, unsigned long
 }
 
 void pp_model::calculate_sequential_log_predictive_dfs(double start, double end, double increment, bool lower_tail, bool two_sided, double control_chart_weight, string* filename_ptr, vector<double>* dfs ){
-  probability_model::set_parameters_to_current_t(start);
   ofstream outfile;
   if( filename_ptr )
     outfile.open(filename_ptr->c_str());
+  if(!m_p_value_alternative_style){
+    vector<double> scores;
+    vector<double>* out = dfs ? dfs : &scores;
+    unsigned int first = out->size();
+    m_current_t = calculate_window_log_predictive_dfs(start,end,increment,lower_tail,two_sided,out);
+    if(outfile.is_open())
+      for( unsigned int k = first; k < out->size(); k++ )
+	outfile << exp((*out)[k]) << '\n';
+    return;
+  }
+  probability_model::set_parameters_to_current_t(start);
   while( m_current_t < end ){
     calculate_log_predictive_df_bounds(increment,lower_tail,two_sided);
     if(dfs)
       dfs->push_back(m_log_predictive_df);
     if(outfile.is_open())
-      outfile << exp(m_log_predictive_df) << endl;
+      outfile << exp(m_log_predictive_df) << '\n';
     m_current_t += increment;
   }
 }
 
+double pp_model::calculate_window_log_predictive_dfs(double start, double end, double increment, bool lower_tail, bool two_sided, vector<double>* dfs ){
+  set_parameters_to_time(start);
+  //the windows are laid out first, so that their lengths and counts come from one pass each
+  vector<double> starts, ends;
+  double t = start;
+  for( ; t < end; t += increment ){
+    starts.push_back(t);
+    ends.push_back(t+increment);
+  }
+  unsigned int n = starts.size();
+  if(!n)
+    return t;
+  vector<double> lengths(n,increment);
+  if(m_pp_time_scale)
+    m_pp_time_scale->cumulative_function_batch(&starts[0],&ends[0],n,&lengths[0]);
+  vector<unsigned long long int> counts(n,0);
+  if(m_data_cont && !m_data_cont->is_empty()){
+    const double * x = (*m_data_cont)[0];
+    unsigned long long int num_data = m_data_cont->get_cols(), i = m_r;
+    for( unsigned int k = 0; k < n; k++ ){
+      unsigned long long int first = i;
+      while( i < num_data && x[i] < ends[k] )
+	i++;
+      counts[k] = i-first;
+    }
+  }
+  dfs->reserve(dfs->size()+n);
+  for( unsigned int k = 0; k < n; k++ )
+    dfs->push_back(calculate_window_log_predictive_df(lengths[k],counts[k],lower_tail,two_sided));
+  return t;
+}
+
 void pp_model::set_parameters_to_current_t(){
-  m_current_data_index = m_r = m_data_cont ? m_data_cont->find_data_index(m_current_t) : 0;
-  m_t = m_pp_time_scale ? m_pp_time_scale->cumulative_function( 0, m_current_t ) : m_current_t;
+  set_parameters_to_time(m_current_t);
+}
+
+void pp_model::set_parameters_to_time( double t ){
+  m_current_data_index = m_r = m_data_cont ? m_data_cont->find_data_index(t) : 0;
+  m_t = m_pp_time_scale ? m_pp_time_scale->cumulative_function( 0, t ) : t;
   m_alpha_star = m_alpha + m_r;
   m_beta_star = m_beta + m_t;
 }
@@ -450,10 +609,14 @@ double pp_model::calculate_log_predictive_df_bounds( double increment, bool lowe
 double pp_model::calculate_event_count_log_predictive_df( double increment, bool lower_tail, bool two_sided, bool increment_parameters ){
   double t = m_pp_time_scale ? m_pp_time_scale->cumulative_function( m_current_t, m_current_t+increment ) : increment;
   unsigned long long int r = m_data_cont ? m_data_cont->find_data_index(m_current_t+increment,0,m_r) - m_r : 0;
+  return calculate_window_log_predictive_df(t,r,lower_tail,two_sided);
+}
+
+double pp_model::calculate_window_log_predictive_df( double t, unsigned long long int r, bool lower_tail, bool two_sided ){
   if(t>0){
     if(two_sided)
       calculate_log_posterior_predictive_pdf(t,r);
-    m_log_predictive_df = calculate_log_posterior_predictive_df(t,r,lower_tail);
+    m_log_predictive_df = calculate_log_posterior_predictive_df(t,r,lower_tail,two_sided);
     if(two_sided){
       //      m_predictive_two_sided_df = 1-m_predictive_two_sided_df*exp(m_log_pdf_const);
       //      m_predictive_two_sided_df2 = 1-m_predictive_two_sided_df2*exp(m_log_pdf_const);
@@ -487,8 +650,18 @@ double pp_model::calculate_waiting_times_log_predictive_df( double increment, bo
   unsigned long long int i2 = m_data_cont ? m_data_cont->find_data_index(m_current_t+increment,0,m_current_data_index) : (unsigned long long int)(m_current_t+increment);
   double current_t = m_current_t;
   if(i2>m_current_data_index){
+    if(m_pp_time_scale){
+      //the scaled waiting times, each from the event before, all at once
+      unsigned int n = i2-m_current_data_index;
+      m_waiting_time_starts.resize(n);
+      m_waiting_times.resize(n);
+      m_waiting_time_starts[0] = current_t;
+      for(unsigned int j = 1; j < n; j++)
+	m_waiting_time_starts[j] = (*m_data_cont)[0][m_current_data_index+j-1];
+      m_pp_time_scale->cumulative_function_batch( &m_waiting_time_starts[0], &(*m_data_cont)[0][m_current_data_index], n, &m_waiting_times[0] );
+    }
     while(i2>m_current_data_index){
-      double t = m_pp_time_scale ? m_pp_time_scale->cumulative_function( current_t, (*m_data_cont)[0][m_current_data_index] ) : (*m_data_cont)[0][m_current_data_index] - current_t;
+      double t = m_pp_time_scale ? m_waiting_times[how_many] : (*m_data_cont)[0][m_current_data_index] - current_t;
       m_log_predictive_df = calculate_log_posterior_predictive_pdf(t,0);//upper tail
       if(t<=0){
 	cerr << "Rounding errors in event times"<< endl;
@@ -563,13 +736,14 @@ double pp_model::calculate_waiting_times_log_predictive_df( double increment, bo
 double pp_model::log_likelihood_changepoints( vector<unsigned long long int>& regime_changepoints_data_indices, vector<double>& regime_changepoints_changepoint_positions ){
   m_r = 0;
   m_t = 0;
+  unsigned int cursor = 0;//the intervals are in order, so the knots are swept once
   for( unsigned int i = 0; i < regime_changepoints_data_indices.size(); i += 2 ){
     //number of uncensored observations in each interval
     m_r += regime_changepoints_data_indices[ i + 1 ] - regime_changepoints_data_indices[ i ];
     //Calculate the time interval
     double t1 = regime_changepoints_changepoint_positions[ i ];
     double t2 = regime_changepoints_changepoint_positions[ i + 1 ];
-    m_t += m_time_scale ? m_time_scale->cumulative_function( t1, t2 ) : t2-t1;
+    m_t += m_time_scale ? m_time_scale->cumulative_function( t1, t2, cursor ) : t2-t1;
   }
   return log_likelihood_length_and_count( m_t, m_r );
 }
@@ -2,6 +2,7 @@
 #define POISSON_PROCESS_MODEL_HPP
 
 #include "probability_model.hpp"
+#include "lgamma_table.hpp"
 #include <stdlib.h>
 
 class pp_model : public probability_model{
@@ -15,6 +16,7 @@ class pp_model : public probability_model{
   pp_model(string, double=.1, double=.1);//for Poisson regression
   pp_model(Data<unsigned long long int>*, Data<double>* = NULL, double=.1, double=.1,double* =NULL);//for Poisson regression
   ~pp_model();
+  virtual probability_model* clone() const;
   void construct();
   void poisson_regression_construct();
   void construct_empirical_prior();
@@ -26,22 +28,29 @@ class pp_model : public probability_model{
    virtual double draw_mean_from_posterior(changepoint *, changepoint *, changepoint * = NULL);
    virtual double calculate_log_predictive_df(double t1, double t2, double t3, bool lower_tail = true );
    virtual void calculate_sequential_log_predictive_dfs(double start, double end, double increment, bool lower_tail = true, bool two_sided = false, double control_chart_weight = 0.05, string* filename_ptr = NULL, vector<double>* dfs = NULL );
+   virtual double calculate_window_log_predictive_dfs(double start, double end, double increment, bool lower_tail, bool two_sided, vector<double>* dfs );
    virtual void set_parameters_to_current_t();
+   void set_parameters_to_time( double t );
    virtual double calculate_log_predictive_df_bounds( double increment, bool lower_tail = true, bool two_sided = false, bool increment_parameters = true );
    virtual double get_mean_function( double t ){ return m_shot_noise_rate > 0 ? m_pp_time_scale->function(t) : 1; }
+   virtual bool constant_mean_function(){ return !(m_shot_noise_rate > 0); }
    virtual double log_likelihood_changepoints( vector<unsigned long long int>&, vector<double>& );
    virtual double get_alpha(){return m_alpha;}
    virtual double get_beta(){return m_beta;}
    double log_likelihood_up_to(double t);
    virtual double log_likelihood_interval_with_count(double t1, double t2, unsigned long long int r);
+   virtual void log_likelihood_intervals_with_count(unsigned long long int n, const double * t1, const double * t2, const unsigned long long int * r, double * ll);
    double log_likelihood_length_and_count(double t, unsigned long long int r);
    double log_likelihood_length_and_count(){ return log_likelihood_length_and_count(m_t,m_r); }
    double poisson_regression_log_likelihood_interval(unsigned long long int i1, unsigned long long int i2);
    double calculate_mean(changepoint *, changepoint *, changepoint * = NULL);
    double calculate_log_posterior_predictive_pdf( double t, unsigned long long int r );
-   double calculate_log_posterior_predictive_df( double t, unsigned long long int r, bool lower_tail = true );//posterior predictive distribution function for a future count of r in t units of time, given the current posterior parameters m_alpha_star, m_beta_star.
+   double calculate_log_posterior_predictive_df( double t, unsigned long long int r, bool lower_tail = true, bool two_sided = false );//posterior predictive distribution function for a future count of r in t units of time, given the current posterior parameters m_alpha_star, m_beta_star.
+   double calculate_log_posterior_predictive_df_closed_form( double t, unsigned long long int r, bool lower_tail );//the one-sided p-value pair from the negative binomial tails, without summing the pmf
+   void negative_binomial_log_tails( unsigned long long int k, double log_p, double log_q, double & log_lower, double & log_upper );//log P(X<=k), log P(X>k) for X~NB(m_alpha_star,p)
    double calculate_waiting_times_log_predictive_df( double increment, bool lower_tail, bool two_sided, bool increment_parameters );
    double calculate_event_count_log_predictive_df( double increment, bool lower_tail, bool two_sided, bool increment_parameters );
+   double calculate_window_log_predictive_df( double t, unsigned long long int r, bool lower_tail, bool two_sided );//for a window of scaled length t holding r events
   virtual void use_random_mean(int seed);
   virtual void use_prior_mean(){m_posterior_mean = 0;}
   
@@ -53,6 +62,7 @@ class pp_model : public probability_model{
     double m_beta_star;
     double m_likelihood_term;
     double m_likelihood_term_zero;//simplified constant for cancellation when #events=0;
+    Lgamma_Table m_lgamma;//lgamma(m_alpha+r) for the counts r seen so far
     bool m_poisson_regression;//true if the model is Poisson regression rather than Poisson process
     Data<unsigned long long int>* m_cum_counts;//for Poisson regression.
     double m_alpha; //lambda shape parameter,can't be zero
@@ -61,6 +71,7 @@ class pp_model : public probability_model{
     double m_chi;//variance for alternative gamma prior
     double* m_cum_intensity_multipliers;//fixed mulitpliers for the intensity in Poisson regression.
     Univariate_Function* m_pp_time_scale;
+    vector<double> m_waiting_time_starts, m_waiting_times;//scratch for calculate_waiting_times_log_predictive_df
     double m_shot_noise_rate;
     
     bool m_posterior_mean;
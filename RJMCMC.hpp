@@ -5,6 +5,7 @@
 #include "particle.hpp"
 #include "histogram_type.hpp"
 #include "mc_divergence.hpp"
+#include "quantile_sketch.hpp"
 using namespace std;
 #define LOG_TWO log(2.0)
 #define LOG_THREE log(3.0)
@@ -55,6 +56,7 @@ template< class T>
   virtual Particle<T>** get_sample() const {return m_sample;}
   virtual Particle<T>* get_current_particle() const {return m_current_particle;}
   void delete_current_particle(){delete m_current_particle;}
+  Particle<T>* release_current_particle(){Particle<T>* p=m_current_particle; m_current_particle=NULL; return p;}
   virtual double get_end_time() const {return m_end_time;}
   virtual void set_initial_sample(Particle<T> * initial) {m_initial_sample = initial;}
   virtual void calculate_function_of_interest() = 0;
@@ -69,7 +71,7 @@ template< class T>
   void write_1d_histogram_to_file(const string output_filename="1d_distribution.txt"){m_histogram->write_1d_histogram_to_file(output_filename);}
   void write_marginal_histogram_to_file(const string output_filename="marginal_distribution.txt",unsigned int dimension=1,unsigned int margin=0){m_histogram->write_marginal_histogram_to_file(output_filename,dimension,margin);}
   void write_primary_function_of_interest_to_file(const string ="foi.txt");
-  map<vector<unsigned int>,long long unsigned int>* get_bin_counts() {if (m_histogram) return m_histogram->get_bin_counts(); return NULL;}
+  Bin_Hash_Table<unsigned long long int>* get_bin_counts() {if (m_histogram) return m_histogram->get_bin_counts(); return NULL;}
   Histogram* get_histogram(){return m_histogram;}
   Histogram* take_histogram(){Histogram* hist=m_histogram; m_histogram=NULL; return hist;}
   double get_autocorrelation_prob(){ return m_histogram->get_autocorrelation_prob();}
@@ -79,6 +81,7 @@ template< class T>
   virtual void locally_perfect_MAP(Particle<T>* = NULL, bool = false ) = 0;
   unsigned long long int get_size_sample()const{return m_size_of_sample;} 
   void set_continue_loop(bool loop){m_continue_loop=loop;}
+  void set_seed(int se){m_seed=se; gsl_rng_set(r,m_seed);}
   void runsimulation();
   void start_calculating_mc_divergence(Divergence_Type=BIAS,Loss_Function=MINIMAX,unsigned int=50,bool=false,unsigned int=0,bool=false,unsigned int=0);
   void update_dimension_distribution();
@@ -89,6 +92,9 @@ template< class T>
   void end_divergence_burn_in(){ m_histogram->set_divergence_initial_number_of_bins();}
   void set_initial_iterations(long long int ii){m_initial_iterations=ii;}
   void set_function_criteria(unsigned int);
+  /*also estimate the lower, median and upper quantiles of the function of interest on its grid,
+    written next to it by write_primary_function_of_interest_to_file*/
+  void calculate_function_of_interest_bands(double lower = 0.05, double upper = 0.95);
   void set_sample_filename(string s){m_sample_filename = s;}
   void set_sample_dimensions_filename(string s){m_sample_dimensions_filename = s;}
   void set_sample_logposterior_filename(string s){m_sample_logposterior_filename = s;}
@@ -110,6 +116,8 @@ template< class T>
   double get_sum_thinned_importance_weights(){ return m_sum_thinned_importance_weights; }
   void non_conjugate(){m_conjugate=0;}
   void constrained_model(){m_constraint=true;}
+  /*the initial sample may still be referenced elsewhere: leave it untouched and copy it on the first accepted move*/
+  void share_initial_sample(bool share=true){m_share_initial_sample=share;}
   virtual bool draw_means_from_posterior( bool test_constraint= true ){return true;}
 
  protected:
@@ -146,6 +154,7 @@ template< class T>
   double *m_mean_function_of_interest;
   double *m_mean_sq_function_of_interest;
   double *m_var_function_of_interest;
+  Quantile_Sketch *m_function_of_interest_bands;
   double m_mean_var_function_of_interest;
   bool m_delete_data;
   unsigned long long int m_birth_attempt;
@@ -185,7 +194,10 @@ template< class T>
   bool m_conjugate;
   bool m_constraint;
   unsigned long long int m_num_constrained_particles;
+  bool m_share_initial_sample;
+  bool m_current_particle_shared;
   void rj_construct();
+  void own_current_particle();
 };
 
 
@@ -209,7 +221,7 @@ template<class T>
     delete [] m_sample;
   }
 
-  if (m_current_particle){
+  if (m_current_particle && !m_current_particle_shared){
     delete m_current_particle;
   }
 
@@ -231,6 +243,7 @@ template<class T>
     delete [] m_mean_sq_function_of_interest;
   if(m_var_function_of_interest)
     delete [] m_var_function_of_interest;
+  delete m_function_of_interest_bands;
 
 }
 
@@ -239,6 +252,8 @@ template<class T>
   m_conjugate=true;
   m_constraint=false;
   m_num_constrained_particles=0;
+  m_share_initial_sample=false;
+  m_current_particle_shared=false;
   m_calculating_divergence = false;
   m_calculate_sample_histogram = false;
   m_calculate_mv_sample_histogram = false;
@@ -258,6 +273,7 @@ template<class T>
   m_mean_function_of_interest=NULL;
   m_mean_sq_function_of_interest=NULL;
   m_var_function_of_interest=NULL;
+  m_function_of_interest_bands=NULL;
   m_length_grid=1;  
 
   m_size_of_sample=m_iterations;
@@ -295,6 +311,16 @@ void rj<T>::set_function_criteria(unsigned int grid){
 
 }
 
+template<class T>
+void rj<T>::calculate_function_of_interest_bands(double lower, double upper){
+  vector<double> probabilities;
+  probabilities.push_back(lower);
+  probabilities.push_back(0.5);
+  probabilities.push_back(upper);
+  delete m_function_of_interest_bands;
+  m_function_of_interest_bands = new Quantile_Sketch(m_length_grid,probabilities);
+}
+
 
 
 template<class T>
@@ -315,6 +341,10 @@ template<class T>
     m_move_parameter_accept=0;
     m_continue_loop=1;
     initiate_sample(m_initial_sample);
+    m_current_particle_shared = m_share_initial_sample && m_initial_sample;
+    //non conjugate proposals alter the current particle before the accept step
+    if(!m_conjugate)
+      own_current_particle();
     m_iters = -m_burnin;
     first=1;
    
@@ -452,6 +482,7 @@ template<class T>
       }
     }
     if (m_accept) {
+      own_current_particle();
       m_accept_between_thinning = true;
       /*birth*/
       if (u1<=m_b){
@@ -565,6 +596,7 @@ template<class T>
 
     bool particle_okay=true;
     if(m_constraint && m_iters>0 && m_iters%m_thinning==0){
+      own_current_particle();
       particle_okay=draw_means_from_posterior();
       if(particle_okay)
 	m_num_constrained_particles++;
@@ -572,6 +604,7 @@ template<class T>
     
     if(m_importance_sampling && m_iters>0){
       if(m_iters == 1 || m_accept ){
+	own_current_particle();
 	if(particle_okay)
 	  calculate_importance_weight();
 	else
@@ -643,6 +676,14 @@ void rj<T>::initiate_sample(Particle<T> * ptr2particle){
 }
 
 
+template<class T>
+void rj<T>::own_current_particle(){
+  if(m_current_particle_shared){
+    m_current_particle = copy_particle(m_current_particle);
+    m_current_particle_shared = false;
+  }
+}
+
 template<class T>
 Particle<T> * rj<T>::copy_particle(Particle<T> * ptr2particle){
   Particle<T> * new_particle;
@@ -934,6 +975,8 @@ template<class T>
     OutputStream << m_mean_function_of_interest[i]/iterations << "\t" << var_mean_i + mean_var_i << endl;
   }
   OutputStream.close();
+  if(m_function_of_interest_bands)
+    m_function_of_interest_bands->write_to_file(Quantile_Sketch::bands_file(output_filename));
 }
 
 template<class T>
@@ -29,7 +29,8 @@ rj_pp::~rj_pp(){
         m_sample=NULL;
     }
     if(m_current_particle){
-        delete m_current_particle;
+        if(!m_current_particle_shared)
+            delete m_current_particle;
         m_current_particle = NULL;
     }
    
@@ -79,7 +80,7 @@ void rj_pp::proposal_type(const char *proposaltype, void * v){
     m_prop_distribution_sd = ((double*)v)[1];
   }else if (strcmp(hist,proposaltype)==0 && ((unsigned int*)v)[0]>0){
     m_prop_distribution = 'H';
-    m_prop_histogram = new Histogram(m_start_cps,m_end_time,((unsigned int*)v)[0]);
+    m_prop_histogram = new Histogram(m_start_cps,m_end_time,((unsigned int*)v)[0],-1,true,false,true);
     m_prop_histogram->bin_data(m_pm->get_data());
   }else{
     cerr << "proposal distribution for changepionts is not recognised, using the default uniform distribution" << endl;
@@ -730,6 +731,8 @@ void rj_pp::update_primary_function_of_interest(){
     
     double mean_fn_i = mean_i * m_pm->get_mean_function(grid_i-cp_left_position);
     m_mean_function_of_interest[i] += mean_fn_i;
+    if(m_function_of_interest_bands)
+      m_function_of_interest_bands->add(i,mean_fn_i);
     if(m_mean_sq_function_of_interest)
       m_mean_sq_function_of_interest[i] += mean_fn_i * mean_fn_i;
     if(m_var_function_of_interest)
@@ -8,6 +8,8 @@
 #include <cmath>
 #include "changepoint.hpp"
 #include "probability_model.hpp"
+#include "resampling.hpp"
+#include "telemetry.hpp"
 using namespace std;
 #include <iostream>
 #include <fstream>
@@ -31,7 +33,14 @@ public:
   virtual void ESS_resample_particles(double,int)=0;
   virtual void calculate_function_of_interest(double, double)=0;
   void run_simulation_SMC_PP();
+  bool advance_interval();
+  unsigned int get_num_intervals_completed() const{ return m_interval; }
+  double get_interval_end(unsigned int i) const{ return m_start+m_change_in_time*(i+1); }
+  double get_size_of_sample(int ds, unsigned int i) const{ return m_size_of_sample ? m_size_of_sample[ds][i] : 0; }
+  double get_last_changepoint(int ds, unsigned int i) const{ return m_last_changepoint ? m_last_changepoint[ds][i] : 0; }
   virtual void delete_samples(int);
+  /*called at the end of each interval, lets a fixed-lag sampler drop old history*/
+  virtual void retire_history(double){}
   unsigned long long int find_max(double *, unsigned long long int);
   void permute_sample();
   void print_sample_A(int);
@@ -42,6 +51,7 @@ public:
   void normalise_weights();
   void print_weights();
   double calculate_ESS(int);
+  void calculate_ESS(double *);//all processes at once
   void set_ESS_threshold(double threshold){m_ESS_percentage=threshold; m_ESS_threshold=m_max_sample_size_A*m_ESS_percentage;}
   void print_size_of_sample(int ds, const char *);
   void print_last_changepoints(int ds, const char *);
@@ -56,6 +66,10 @@ public:
   void print_size_sample_A(int ds);
   void sample_from_prior() {m_sample_from_prior = true;}
   void do_importance_sampling() {m_importance_sampling = 1;}
+  void set_resampling_type(Resampling_Type type){m_resampler.set_resampling_type(type);}
+  void resample_every_interval(bool every = true){m_adaptive_resampling = !every;}
+  /*stream the stage timings, sample sizes and ESS of every interval to out, one JSON object per line*/
+  void set_telemetry(ostream & out, int first_process = 0);
 
 protected:
 
@@ -82,6 +96,8 @@ protected:
     double ** m_ESS;
     bool m_store_ESS;
     double * m_max_weight;
+    double * m_current_ESS;
+    double * m_old_sum_weights;
     double * m_sum_exp_weights;
     double * m_sum_squared_exp_weights;
     double ** m_cum_exp_weights;
@@ -99,10 +115,17 @@ protected:
     int * m_process_observed;
     int seed;
     unsigned int m_num_ESS;
+    Resampler m_resampler;
+    bool m_adaptive_resampling;//only resample a process when its ESS falls below the threshold
   bool  m_sample_from_prior;
   bool m_importance_sampling;
   double log_gamma_pdf(double, double, double);
   probability_model ** m_pm;
+  Telemetry * m_telemetry;
+  double * m_telemetry_ESS;//before any resampling
+  bool * m_telemetry_resampled;
+  /*adds the fields of process ds to the telemetry record of the interval just completed*/
+  virtual void process_telemetry(int ds);
 
 };
 template<class T>
@@ -124,6 +147,10 @@ SMC_PP<T>::SMC_PP(double start, double end, unsigned int num_of_intervals, long
     sample_size /= m_num;
   }
   m_sample_from_prior = false;
+  m_adaptive_resampling = true;
+  m_telemetry = NULL;
+  m_telemetry_ESS = NULL;
+  m_telemetry_resampled = NULL;
   m_store_ESS=0;
   if(MCMC_only){
     m_sample_dummy=NULL;
@@ -188,6 +215,9 @@ SMC_PP<T>::SMC_PP(double start, double end, unsigned int num_of_intervals, long
   }
 
   m_max_weight = new double[m_num];
+  m_current_ESS = new double[m_num];
+  m_old_sum_weights = new double[m_num];
+  m_interval = 0;
   for(int i=0; i<m_num; i++){
     m_sum_exp_weights[i]=(double)(m_max_sample_size_A);
     m_sum_squared_exp_weights[i]=(double)(m_max_sample_size_A);
@@ -271,6 +301,8 @@ SMC_PP<T>::~SMC_PP(){
   delete [] m_sum_exp_weights;
   delete [] m_sum_squared_exp_weights;
   delete [] m_max_weight;
+  delete [] m_current_ESS;
+  delete [] m_old_sum_weights;
    
   if (m_sample_dummy&&!MCMC_only){
     delete []  m_sample_dummy;
@@ -303,6 +335,39 @@ SMC_PP<T>::~SMC_PP(){
       delete [] m_sample_sizes[0];
       delete [] m_sample_sizes;
   }
+  if(m_telemetry){
+    delete m_telemetry;
+    delete [] m_telemetry_ESS;
+    delete [] m_telemetry_resampled;
+  }
+}
+
+template<class T>
+void SMC_PP<T>::set_telemetry(ostream & out, int first_process){
+  if(m_telemetry){
+    delete m_telemetry;
+    delete [] m_telemetry_ESS;
+    delete [] m_telemetry_resampled;
+  }
+  m_telemetry = new Telemetry(out,first_process);
+  m_telemetry_ESS = new double[m_num];
+  m_telemetry_resampled = new bool[m_num];
+}
+
+template<class T>
+void SMC_PP<T>::process_telemetry(int ds){
+  m_telemetry->field("A",m_sample_size_A[ds]);
+  m_telemetry->field("B",m_process_observed[ds]>1 ? m_sample_size_B[ds] : 0ULL);
+  if(!MCMC_only){
+    unsigned long long int distinct = 0;
+    for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
+      if(j==0 || m_sample_A[ds][j]!=m_sample_A[ds][j-1])
+	distinct++;
+    }
+    m_telemetry->field("distinct",distinct);
+    m_telemetry->field("ess",m_telemetry_ESS[ds]);
+    m_telemetry->field("resampled",(unsigned long long int)m_telemetry_resampled[ds]);
+  }
 }
 
 template<class T>
@@ -330,102 +395,154 @@ void SMC_PP<T>::store_sample_sizes(){
   }
 }
 
+//carries on from the last interval completed, eg after restoring a checkpoint
 template<class T>
 void SMC_PP<T>::run_simulation_SMC_PP(){
+  while(advance_interval()){}
+}
 
-  double * ESS;
-  double * BF;
-  double * old_sum_weights;
-  ESS  = new double[m_num];
-  BF = new double[m_num];
-  old_sum_weights = new double[m_num];
-   
-  for (m_interval = 0; m_interval<m_num_of_intervals; m_interval++){
-    iters=m_interval;
+/*one SMC update, over the next interval of length m_change_in_time: returns false once
+  all m_num_of_intervals have been processed, so the caller can feed data in between*/
+template<class T>
+bool SMC_PP<T>::advance_interval(){
+  if(m_interval>=m_num_of_intervals)
+    return false;
+  double * ESS = m_current_ESS;
+  double * old_sum_weights = m_old_sum_weights;
+  iters=m_interval;
+  unsigned long long int particles_allocated = Particle<T>::get_num_allocated();
+  if(m_telemetry){
+    m_telemetry->begin_interval();
+    m_telemetry->begin_stage(SAMPLE_STAGE);
+  }
+  for(int ds=0; ds<m_num; ds++){
+    old_sum_weights[ds] = log(m_sum_exp_weights[ds]) +m_max_weight[ds];
+  }
+  if (MCMC_only){           
+    sample_particles(m_start,m_start+m_change_in_time*(m_interval+1));
+  }
+  else{
+    sample_particles(m_start+m_change_in_time*m_interval,m_start+m_change_in_time*(m_interval+1));
+  }
+  if(m_interval>0 && MCMC_only==0 && !m_sample_from_prior){
+    permute_sample();
+  }
+  if(m_telemetry){
+    m_telemetry->end_stage(SAMPLE_STAGE);
+    m_telemetry->begin_stage(JOIN_STAGE);
+  }
+  if (!MCMC_only){
     for(int ds=0; ds<m_num; ds++){
-      old_sum_weights[ds] = log(m_sum_exp_weights[ds]) +m_max_weight[ds];
-    }
-    if (MCMC_only){           
-      sample_particles(m_start,m_start+m_change_in_time*(m_interval+1));
-    }
-    else{
-      sample_particles(m_start+m_change_in_time*m_interval,m_start+m_change_in_time*(m_interval+1));
+      if(m_process_observed[ds]>0){
+        calculate_weights_join_particles(m_interval,ds);
+        if(m_process_observed[ds]>1){       
+          delete_samples(ds);
+        }
+        for(unsigned int j=0; j<m_sample_size_A[ds]; j++){
+          m_sample_A[ds][j] = m_sample_dummy[ds][j];
+        }
+      }
     }
-    if(m_interval>0 && MCMC_only==0 && !m_sample_from_prior){
-      permute_sample();
+  }
+  if(m_telemetry){
+    m_telemetry->end_stage(JOIN_STAGE);
+    m_telemetry->begin_stage(ESS_STAGE);
+  }
+  if (!MCMC_only){
+    calculate_ESS(ESS);
+  }
+  if(m_telemetry){
+    m_telemetry->end_stage(ESS_STAGE);
+    for(int ds=0; ds<m_num; ds++){
+      m_telemetry_ESS[ds] = MCMC_only ? 0 : ESS[ds];
+      m_telemetry_resampled[ds] = false;
     }
+  }
+  for(int ds=0; ds<m_num; ds++){
     if (!MCMC_only){
-      for(int ds=0; ds<m_num; ds++){
-	if(m_process_observed[ds]>0){
-	  calculate_weights_join_particles(m_interval,ds);
-	  if(m_process_observed[ds]>1){       
-	    delete_samples(ds);
-	  }
-	  for(unsigned int j=0; j<m_sample_size_A[ds]; j++){
-	    m_sample_A[ds][j] = m_sample_dummy[ds][j];
-	  }
-	}
+      if(m_store_ESS){
+        m_ESS[ds][m_interval] = ESS[ds];
       }
-    }
-    for(int ds=0; ds<m_num; ds++){
-      if (!MCMC_only){
-	ESS[ds]=calculate_ESS(ds);
-	if(m_store_ESS){
-	  m_ESS[ds][m_interval] = ESS[m_interval];
-	}
-	/*BF[ds] = log(m_sum_exp_weights[ds]) + m_max_weight[ds]-old_sum_weights[ds];
-     	  if (BF[ds] < log(0.1) && ESS[ds]>m_ESS_threshold){
-	  cout<<"BF "<<ds<<" "<<m_start+m_change_in_time*(i)<<endl;
-	  resample_particles(m_start+m_change_in_time*(i),m_start+m_change_in_time*(i+1),m_num_BF_iterations,m_BF_resampling_type,ds);
-	  }*/
-	m_ESS_threshold=m_sample_size_A[ds]*m_ESS_percentage;
-
-	if (ESS[ds]<m_ESS_threshold){
-	  m_num_ESS++;
-	  // cout<<"ESS: "<<ds<<" "<<m_interval<<" "<<ESS[ds]<<endl;  
-	  ESS_resample_particles(m_start+m_change_in_time*(m_interval+1),ds);
-	  ESS[ds]=calculate_ESS(ds);
-	  resample_particles(m_start,m_start+m_change_in_time*(m_interval+1),5,"Uniform",ds);
-	}
+      /*BF[ds] = log(m_sum_exp_weights[ds]) + m_max_weight[ds]-old_sum_weights[ds];
+   	  if (BF[ds] < log(0.1) && ESS[ds]>m_ESS_threshold){
+        cout<<"BF "<<ds<<" "<<m_start+m_change_in_time*(i)<<endl;
+        resample_particles(m_start+m_change_in_time*(i),m_start+m_change_in_time*(i+1),m_num_BF_iterations,m_BF_resampling_type,ds);
+        }*/
+      m_ESS_threshold=m_sample_size_A[ds]*m_ESS_percentage;
+
+      if (ESS[ds]<m_ESS_threshold || !m_adaptive_resampling){
+        m_num_ESS++;
+        // cout<<"ESS: "<<ds<<" "<<m_interval<<" "<<ESS[ds]<<endl;  
+        if(m_telemetry)
+          m_telemetry->begin_stage(RESAMPLE_STAGE);
+        ESS_resample_particles(m_start+m_change_in_time*(m_interval+1),ds);
+        ESS[ds]=calculate_ESS(ds);
+        if(m_telemetry){
+          m_telemetry->end_stage(RESAMPLE_STAGE);
+          m_telemetry->begin_stage(REJUVENATE_STAGE);
+        }
+        resample_particles(m_start,m_start+m_change_in_time*(m_interval+1),5,"Uniform",ds);
+        if(m_telemetry){
+          m_telemetry->end_stage(REJUVENATE_STAGE);
+          m_telemetry_resampled[ds] = true;
+        }
       }
     }
+  }
 
-    if (MCMC_only) {
-      unsigned long long int sample_size = m_max_sample_size_A;
-      if (m_variable_B) {
-	sample_size /= m_num;
-      }
-      for(unsigned long long int j=0; j<sample_size; j++){
-	for(int ds=0; ds<m_num; ds++){
-	  m_exp_weights[ds][j]=1;
-	}
-      }
+  if (MCMC_only) {
+    unsigned long long int sample_size = m_max_sample_size_A;
+    if (m_variable_B) {
+      sample_size /= m_num;
     }
-    calculate_function_of_interest(m_start+m_change_in_time*(m_interval),m_start+m_change_in_time*(m_interval+1));
-    if(m_online_num_changepoints){
+    for(unsigned long long int j=0; j<sample_size; j++){
       for(int ds=0; ds<m_num; ds++){
-	if(m_process_observed[ds]>0){      
-	  for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
-	    m_size_of_sample[ds][m_interval]+=  m_sample_A[ds][j]->get_dim_theta()*m_exp_weights[ds][j];
-	  }
-	  m_size_of_sample[ds][m_interval]/=m_sum_exp_weights[ds];
-	}
+        m_exp_weights[ds][j]=1;
       }
     }
-    if(m_online_last_changepoint){
-      for(int ds=0; ds<m_num; ds++){
-	if(m_process_observed[ds]>0){      
-	  for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
-	    m_last_changepoint[ds][m_interval]+=  m_sample_A[ds][j]->get_last_theta_component()->getchangepoint()*m_exp_weights[ds][j];
-	  }
-	  m_last_changepoint[ds][m_interval]/=m_sum_exp_weights[ds];
-	}
+  }
+  if(m_telemetry)
+    m_telemetry->begin_stage(FOI_STAGE);
+  calculate_function_of_interest(m_start+m_change_in_time*(m_interval),m_start+m_change_in_time*(m_interval+1));
+  if(m_online_num_changepoints){
+    for(int ds=0; ds<m_num; ds++){
+      if(m_process_observed[ds]>0){      
+        for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
+          m_size_of_sample[ds][m_interval]+=  (m_sample_A[ds][j]->get_dim_theta()+m_sample_A[ds][j]->get_num_retired())*m_exp_weights[ds][j];
+        }
+        m_size_of_sample[ds][m_interval]/=m_sum_exp_weights[ds];
+      }
+    }
+  }
+  if(m_online_last_changepoint){
+    for(int ds=0; ds<m_num; ds++){
+      if(m_process_observed[ds]>0){      
+        for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
+          m_last_changepoint[ds][m_interval]+=  m_sample_A[ds][j]->get_last_theta_component()->getchangepoint()*m_exp_weights[ds][j];
+        }
+        m_last_changepoint[ds][m_interval]/=m_sum_exp_weights[ds];
       }
     }
   }
-  delete [] ESS;
-  delete [] BF;
-  delete [] old_sum_weights;
+  if(m_telemetry){
+    m_telemetry->end_stage(FOI_STAGE);
+    m_telemetry->begin_stage(RETIRE_STAGE);
+  }
+  if (!MCMC_only){
+    retire_history(m_start+m_change_in_time*(m_interval+1));
+  }
+  if(m_telemetry){
+    m_telemetry->end_stage(RETIRE_STAGE);
+    m_telemetry->begin_record(m_interval,m_start+m_change_in_time*(m_interval+1),Particle<T>::get_num_allocated()-particles_allocated);
+    for(int ds=0; ds<m_num; ds++){
+      m_telemetry->begin_process(ds);
+      process_telemetry(ds);
+      m_telemetry->end_process();
+    }
+    m_telemetry->end_record();
+  }
+  m_interval++;
+  return true;
 }
 
 
@@ -439,40 +556,44 @@ void SMC_PP<T>::permute_sample(){
 
 template<class T>
 double SMC_PP<T>::calculate_ESS(int ds){
-    double weights_squared;
-    double sum_weights_squared=0;
-    double effectivess;
-
     calculate_exp_weights(ds);
-
-    for (unsigned int long long i=0; i<m_sample_size_A[ds]; i++){   
-      weights_squared=m_exp_weights[ds][i]*m_exp_weights[ds][i];
-      sum_weights_squared+=weights_squared;
-    }
-    
-    m_sum_squared_exp_weights[ds]=sum_weights_squared;
-    effectivess = (m_sum_exp_weights[ds])*(m_sum_exp_weights[ds]/sum_weights_squared);
-    return(effectivess);
+    return (m_sum_exp_weights[ds])*(m_sum_exp_weights[ds]/m_sum_squared_exp_weights[ds]);
 }
 
+template<class T>
+void SMC_PP<T>::calculate_ESS(double * ESS){
+    for(int ds=0; ds<m_num; ds++)
+      ESS[ds]=calculate_ESS(ds);
+}
 
-
+/*two streaming passes over the log weights: the maximum, then the exponentiated
+  weights together with their sum, sum of squares and cumulative sum. The sums are
+  accumulated in index order so the ESS and the resampling are unchanged.*/
 template<class T>
 void SMC_PP<T>::calculate_exp_weights(int ds){
+  const double * weights = m_weights[ds];
+  double * exp_weights = m_exp_weights[ds];
+  double * cum_exp_weights = m_cum_exp_weights[ds];
+  unsigned long long int size = m_sample_size_A[ds];
 
-  m_sum_exp_weights[ds]=0;
-  m_max_weight[ds]=m_weights[ds][find_max(m_weights[ds],m_sample_size_A[ds])];
+  double max_weight = size>0 ? weights[0] : 0;
+  for (unsigned long long int i=1; i<size; i++){
+    max_weight = weights[i] > max_weight ? weights[i] : max_weight;
+  }
 
-  for (unsigned long long int i=0; i<m_sample_size_A[ds]; i++){
-    if (isinf(m_weights[ds][i])) {
-      m_exp_weights[ds][i] = 0;
-    } else {
-      m_exp_weights[ds][i]=exp(m_weights[ds][i]-m_max_weight[ds]);
-    }
-    m_sum_exp_weights[ds]+=m_exp_weights[ds][i];
-    
-    m_cum_exp_weights[ds][i]=m_sum_exp_weights[ds];
+  double sum_weights = 0, sum_weights_squared = 0;
+  for (unsigned long long int i=0; i<size; i++){
+    double exp_weight = exp(weights[i]-max_weight);
+    exp_weight = isinf(weights[i]) ? 0 : exp_weight;
+    exp_weights[i] = exp_weight;
+    sum_weights += exp_weight;
+    sum_weights_squared += exp_weight*exp_weight;
+    cum_exp_weights[i] = sum_weights;
   }
+
+  m_max_weight[ds] = max_weight;
+  m_sum_exp_weights[ds] = sum_weights;
+  m_sum_squared_exp_weights[ds] = sum_weights_squared;
 }
 
 template<class T>   
@@ -525,7 +646,7 @@ void SMC_PP<T>::swap( int &  element1Ptr, int & element2Ptr )
 template<class T>
 unsigned long long int SMC_PP<T>::find_max(double * vec, unsigned long long int size)
 {
-  int max=0;
+  unsigned long long int max=0;
   for (unsigned long long int i=1; i<size; i++){
     if (vec[i] > vec[max]){
       max=i;
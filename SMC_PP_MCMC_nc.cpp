@@ -1,7 +1,13 @@
 #include "SMC_PP_MCMC_nc.hpp"
 #define LOG_TWO log(2.0)
 #include "string.h"
+#include "checkpoint.hpp"
 #include <iostream>
+#include <pthread.h>
+
+//particles are moved in blocks of this size when rejuvenating on several threads,
+//each block with its own seed so the result does not depend on the number of threads
+#define REJUVENATION_BLOCK_SIZE 256
 
 bool SMC_PP_MCMC::MyDataSort(const pair<double,int>& lhs, const pair<double,int>& rhs){return (lhs.first > rhs.first);}
 
@@ -9,6 +15,14 @@ SMC_PP_MCMC::SMC_PP_MCMC(double start, double end, unsigned int intervals, int s
   :SMC_PP<changepoint>(start,end,intervals,sizeA,sizeB,sizes,num_data,varyB,dochangepoint,doMCMC,s),m_calculate_intensity(intensity), m_do_exact_sampling(exact_sampling)
 {
   m_discrete = false;
+  m_num_threads = 1;
+  m_foi_difference_arrays = false;
+  m_rejection_block_size = 0;
+  m_rejection_envelope = 0;
+  m_particle_budget = 0;
+  m_history_horizon = 0;
+  m_history_cutoff = m_start;
+  m_divergence_exchange = NULL;
   m_pm = pm;
   m_nu = nu;
   m_var_nu = v_nu;
@@ -201,6 +215,288 @@ void SMC_PP_MCMC::delete_samples(int ds){
    
 }
 
+/*the retired changepoints have already contributed to the filtering estimates of the
+  intensity and number of changepoints, only the last of them is kept as the intercept.
+  Retiring is idempotent so particles shared by several indices are safe.*/
+void SMC_PP_MCMC::retire_history(double end){
+  if(m_history_horizon<=0 || end-m_history_horizon<=m_history_cutoff)
+    return;
+  if(!m_conjugate){
+    cerr << "SMC_PP_MCMC: the history of non-conjugate models cannot be truncated, keeping all changepoints" << endl;
+    m_history_horizon = 0;
+    return;
+  }
+  m_history_cutoff = end-m_history_horizon;
+  changepoint cutoff(m_history_cutoff,0,0,0);
+  for(int ds=0; ds<m_num; ds++){
+    if(m_process_observed[ds]>0){
+      for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
+	if(j>0 && m_sample_A[ds][j]==m_sample_A[ds][j-1])
+	  continue;
+	m_sample_A[ds][j]->retire_components(m_sample_A[ds][j]->find_position(&cutoff,true));
+      }
+    }
+  }
+}
+
+#define CHECKPOINT_MAGIC "SMCPPCK1"
+
+void SMC_PP_MCMC::write_changepoint(ostream & out, const changepoint * cp){
+  checkpoint_write(out,cp->getchangepoint());
+  checkpoint_write(out,cp->getdataindex());
+  checkpoint_write(out,cp->getlikelihood());
+  checkpoint_write(out,cp->getmeanvalue());
+  checkpoint_write(out,cp->getvarvalue());
+  checkpoint_write(out,cp->getdouble());
+}
+
+changepoint * SMC_PP_MCMC::read_changepoint(istream & in){
+  double position, likelihood, mean, var, d;
+  unsigned long long int index;
+  checkpoint_read(in,position);
+  checkpoint_read(in,index);
+  checkpoint_read(in,likelihood);
+  checkpoint_read(in,mean);
+  checkpoint_read(in,var);
+  if(!checkpoint_read(in,d))
+    return NULL;
+  changepoint * cp = new changepoint(position,0,likelihood,mean);
+  cp->setdataindex(index);
+  cp->setvarvalue(var);
+  cp->setdouble(d);
+  return cp;
+}
+
+void SMC_PP_MCMC::write_particle(ostream & out, Particle<changepoint> * p){
+  checkpoint_write(out,p->get_dim_theta());
+  checkpoint_write(out,p->get_num_retired());
+  checkpoint_write(out,p->get_birth_time());
+  checkpoint_write(out,p->get_log_posterior());
+  checkpoint_write(out,p->get_weight());
+  bool has_intercept = p->get_intercept()!=NULL;
+  checkpoint_write(out,has_intercept);
+  if(has_intercept)
+    write_changepoint(out,p->get_intercept());
+  for(unsigned int k=0; k<p->get_dim_theta(); k++)
+    write_changepoint(out,p->get_theta_component(k));
+}
+
+Particle<changepoint> * SMC_PP_MCMC::read_particle(istream & in){
+  unsigned int dim, num_retired, birth_time;
+  double log_posterior;
+  long double log_weight;
+  bool has_intercept;
+  checkpoint_read(in,dim);
+  checkpoint_read(in,num_retired);
+  checkpoint_read(in,birth_time);
+  checkpoint_read(in,log_posterior);
+  checkpoint_read(in,log_weight);
+  if(!checkpoint_read(in,has_intercept))
+    return NULL;
+  changepoint * intercept = has_intercept ? read_changepoint(in) : NULL;
+  changepoint ** theta = dim>0 ? new changepoint*[dim] : NULL;
+  bool ok = !has_intercept || intercept;
+  for(unsigned int k=0; k<dim; k++){
+    theta[k] = ok ? read_changepoint(in) : NULL;
+    ok = ok && theta[k];
+  }
+  if(!ok){
+    for(unsigned int k=0; k<dim; k++)
+      delete theta[k];
+    delete [] theta;
+    delete intercept;
+    return NULL;
+  }
+  Particle<changepoint> * p = new Particle<changepoint>(dim,theta,intercept,birth_time);
+  p->set_log_posterior(log_posterior);
+  p->set_weight(log_weight);
+  p->set_num_retired(num_retired);
+  return p;
+}
+
+bool SMC_PP_MCMC::read_checkpoint_interval(istream & in, unsigned int & interval){
+  char magic[sizeof(CHECKPOINT_MAGIC)-1];
+  return checkpoint_read(in,magic,sizeof(magic)) && memcmp(magic,CHECKPOINT_MAGIC,sizeof(magic))==0 && checkpoint_read(in,interval);
+}
+
+/*particles shared by adjacent indices after resampling are written once and flagged
+  at the indices which repeat them, so that the sharing is restored on reading*/
+void SMC_PP_MCMC::write_checkpoint(ostream & out) const{
+  if(MCMC_only){
+    cerr << "SMC_PP_MCMC: sequential MCMC runs cannot be checkpointed" << endl;
+    return;
+  }
+  out.write(CHECKPOINT_MAGIC,sizeof(CHECKPOINT_MAGIC)-1);
+  checkpoint_write(out,m_interval);
+  checkpoint_write(out,m_num);
+  checkpoint_write(out,m_num_of_intervals);
+  checkpoint_write(out,m_max_sample_size_A);
+  checkpoint_write(out,m_start);
+  checkpoint_write(out,m_end);
+  checkpoint_write(out,seed);
+
+  checkpoint_write(out,m_num_ESS);
+  checkpoint_write(out,m_ESS_threshold);
+  checkpoint_write(out,m_nu);
+  checkpoint_write(out,m_prior_diff);
+  checkpoint_write(out,m_history_cutoff);
+  checkpoint_write_rng(out,r);
+  checkpoint_write(out,m_process_observed,m_num);
+  checkpoint_write(out,m_sample_size_A,m_num);
+  checkpoint_write(out,m_sample_size_B,m_num);
+  checkpoint_write(out,m_max_weight,m_num);
+  checkpoint_write(out,m_sum_exp_weights,m_num);
+  checkpoint_write(out,m_sum_squared_exp_weights,m_num);
+  checkpoint_write(out,m_current_ESS,m_num);
+  checkpoint_write(out,m_old_sum_weights,m_num);
+  if(m_current_sample_size){
+    checkpoint_write(out,m_current_sample_size,m_num);
+    checkpoint_write(out,m_min_sample_size,m_num);
+  }
+  if(m_variable_B)
+    checkpoint_write(out,m_vec_KLS,m_num);
+
+  //per interval records, present or not depending on the options
+  unsigned long long int per_interval = (unsigned long long int)m_num*m_num_of_intervals;
+  checkpoint_write(out,m_store_ESS);
+  if(m_store_ESS)
+    checkpoint_write(out,m_ESS[0],per_interval);
+  checkpoint_write(out,m_store_sample_sizes);
+  if(m_store_sample_sizes)
+    checkpoint_write(out,m_sample_sizes[0],per_interval);
+  if(m_size_of_sample)
+    checkpoint_write(out,m_size_of_sample[0],per_interval);
+  if(m_last_changepoint)
+    checkpoint_write(out,m_last_changepoint[0],per_interval);
+  if(m_rejection_sampling_acceptance_rate)
+    checkpoint_write(out,m_rejection_sampling_acceptance_rate[0],per_interval);
+  if(m_num_zero_weights)
+    checkpoint_write(out,m_num_zero_weights[0],per_interval);
+
+  for(int ds=0; ds<m_num; ds++){
+    m_pm[ds]->write_state(out);
+    if(m_functionofinterest)
+      m_functionofinterest[ds]->write_state(out);
+    if(m_process_observed[ds]==0)
+      continue;
+    checkpoint_write(out,m_weights[ds],m_sample_size_A[ds]);
+    checkpoint_write(out,m_exp_weights[ds],m_sample_size_A[ds]);
+    checkpoint_write(out,m_cum_exp_weights[ds],m_sample_size_A[ds]);
+    for(unsigned long long int j=0; j<m_sample_size_A[ds]; j++){
+      bool repeat = j>0 && m_sample_A[ds][j]==m_sample_A[ds][j-1];
+      checkpoint_write(out,repeat);
+      if(!repeat)
+	write_particle(out,m_sample_A[ds][j]);
+    }
+  }
+}
+
+bool SMC_PP_MCMC::read_checkpoint(istream & in){
+  unsigned int interval, num_of_intervals;
+  int num, s;
+  unsigned long long int max_sample_size_A;
+  double start, end;
+  if(MCMC_only || m_interval>0 || !read_checkpoint_interval(in,interval))
+    return false;
+  checkpoint_read(in,num);
+  checkpoint_read(in,num_of_intervals);
+  checkpoint_read(in,max_sample_size_A);
+  checkpoint_read(in,start);
+  checkpoint_read(in,end);
+  if(!checkpoint_read(in,s) || num!=m_num || num_of_intervals!=m_num_of_intervals || max_sample_size_A!=m_max_sample_size_A
+     || start!=m_start || end!=m_end || s!=seed || interval>m_num_of_intervals){
+    cerr << "SMC_PP_MCMC: the checkpoint is from a run with different settings" << endl;
+    return false;
+  }
+
+  bool ok = true;
+  ok = ok && checkpoint_read(in,m_num_ESS);
+  ok = ok && checkpoint_read(in,m_ESS_threshold);
+  ok = ok && checkpoint_read(in,m_nu);
+  ok = ok && checkpoint_read(in,m_prior_diff);
+  ok = ok && checkpoint_read(in,m_history_cutoff);
+  ok = ok && checkpoint_read_rng(in,r);
+  ok = ok && checkpoint_read(in,m_process_observed,m_num);
+  ok = ok && checkpoint_read(in,m_sample_size_A,m_num);
+  ok = ok && checkpoint_read(in,m_sample_size_B,m_num);
+  ok = ok && checkpoint_read(in,m_max_weight,m_num);
+  ok = ok && checkpoint_read(in,m_sum_exp_weights,m_num);
+  ok = ok && checkpoint_read(in,m_sum_squared_exp_weights,m_num);
+  ok = ok && checkpoint_read(in,m_current_ESS,m_num);
+  ok = ok && checkpoint_read(in,m_old_sum_weights,m_num);
+  if(ok && m_current_sample_size){
+    unsigned long long int * current_sample_size = new unsigned long long int[m_num];
+    ok = checkpoint_read(in,current_sample_size,m_num) && checkpoint_read(in,m_min_sample_size,m_num);
+    //grow the particle and weight arrays to the size they had reached
+    for(int ds=0; ds<m_num && ok; ds++){
+      if(current_sample_size[ds]>m_current_sample_size[ds]){
+	int observed = m_process_observed[ds];
+	m_process_observed[ds] = 0;
+	increase_vector(ds,current_sample_size[ds]);
+	m_process_observed[ds] = observed;
+      }
+      m_current_sample_size[ds] = current_sample_size[ds];
+    }
+    delete [] current_sample_size;
+  }
+  if(ok && m_variable_B)
+    ok = checkpoint_read(in,m_vec_KLS,m_num);
+
+  unsigned long long int per_interval = (unsigned long long int)m_num*m_num_of_intervals;
+  bool stored;
+  ok = ok && checkpoint_read(in,stored) && stored==m_store_ESS;
+  if(ok && m_store_ESS)
+    ok = checkpoint_read(in,m_ESS[0],per_interval);
+  ok = ok && checkpoint_read(in,stored) && stored==m_store_sample_sizes;
+  if(ok && m_store_sample_sizes)
+    ok = checkpoint_read(in,m_sample_sizes[0],per_interval);
+  if(ok && m_size_of_sample)
+    ok = checkpoint_read(in,m_size_of_sample[0],per_interval);
+  if(ok && m_last_changepoint)
+    ok = checkpoint_read(in,m_last_changepoint[0],per_interval);
+  if(ok && m_rejection_sampling_acceptance_rate)
+    ok = checkpoint_read(in,m_rejection_sampling_acceptance_rate[0],per_interval);
+  if(ok && m_num_zero_weights)
+    ok = checkpoint_read(in,m_num_zero_weights[0],per_interval);
+
+  for(int ds=0; ds<m_num && ok; ds++){
+    ok = m_pm[ds]->read_state(in);
+    if(ok && m_functionofinterest)
+      ok = m_functionofinterest[ds]->read_state(in);
+    if(!ok || m_process_observed[ds]==0)
+      continue;
+    ok = checkpoint_read(in,m_weights[ds],m_sample_size_A[ds]);
+    ok = ok && checkpoint_read(in,m_exp_weights[ds],m_sample_size_A[ds]);
+    ok = ok && checkpoint_read(in,m_cum_exp_weights[ds],m_sample_size_A[ds]);
+    for(unsigned long long int j=0; j<m_sample_size_A[ds] && ok; j++){
+      bool repeat;
+      ok = checkpoint_read(in,repeat) && !(repeat && j==0);
+      if(ok){
+	m_sample_A[ds][j] = repeat ? m_sample_A[ds][j-1] : read_particle(in);
+	ok = m_sample_A[ds][j]!=NULL;
+      }
+    }
+  }
+  if(!ok){
+    cerr << "SMC_PP_MCMC: the checkpoint is incomplete" << endl;
+    return false;
+  }
+  m_interval = interval;
+  return true;
+}
+
+void SMC_PP_MCMC::process_telemetry(int ds){
+  SMC_PP<changepoint>::process_telemetry(ds);
+  if(m_process_observed[ds]==0)
+    return;
+  if(m_num_zero_weights)
+    m_telemetry->field("zero_weights",(unsigned long long int)m_num_zero_weights[ds][m_interval]);
+  if(m_rejection_sampling_acceptance_rate && !m_sample_from_prior)
+    m_telemetry->field("acceptance",m_rejection_sampling_acceptance_rate[ds][m_interval]);
+  if(m_variable_B)
+    m_telemetry->field("divergence",m_vec_KLS[ds]);
+}
+
 void SMC_PP_MCMC::sample_particles(double start, double end){
   long double avg_distance=0;
   //  double variance=0;
@@ -292,6 +588,9 @@ void SMC_PP_MCMC::sample_particles(double start, double end){
 	}
 	else if(!m_variable_B && m_process_observed[ds]>1){
 	  sample_size=m_max_sample_size_B;
+	  if(m_particle_budget && m_particle_budget<sample_size)
+	    sample_size=m_particle_budget;
+	  m_sample_size_B[ds]=sample_size;
 	}
 	
 	unsigned int max_theta = UINT_MAX;
@@ -354,6 +653,8 @@ void SMC_PP_MCMC::sample_particles(double start, double end){
 							    m_calculate_intensity);
 
 	  if (!m_sample_from_prior) {
+	    m_rejection_sampling[ds]->use_batched_proposals(m_rejection_block_size, m_num_threads);
+	    m_rejection_sampling[ds]->use_adaptive_envelope(m_rejection_envelope);
 	    m_rejection_sampling[ds]->run_simulation();
 	    m_rejection_sampling_acceptance_rate[ds][iters] = m_rejection_sampling[ds]->m_acceptance_rate;
 	  } else {
@@ -380,7 +681,26 @@ void SMC_PP_MCMC::sample_particles(double start, double end){
     }
   }
 
-  if(m_variable_B && active && !MCMC_only){
+  if(m_variable_B && !MCMC_only && m_divergence_exchange){
+    //the budget is shared with samplers elsewhere, only run while holding the largest divergence
+    unsigned long long int current_max = find_max(m_vec_KLS,m_num);
+    m_divergence_exchange->report(current_number,active ? m_vec_KLS[current_max] : -HUGE_VAL);
+    double threshold;
+    bool ties_win;
+    unsigned long long int allowance;
+    while((allowance = m_divergence_exchange->grant(threshold,ties_win))>0){
+      unsigned long long int done = 0;
+      while(active && done<allowance && (m_vec_KLS[current_max]>threshold || (ties_win && m_vec_KLS[current_max]==threshold))){
+	m_rj_B[current_max]->runsimulation();
+	m_vec_KLS[current_max]=m_rj_B[current_max]->get_divergence();
+	m_rj_B[current_max]->set_continue_loop(1);
+	done+=1;
+	current_max=find_max(m_vec_KLS,m_num);
+      }
+      m_divergence_exchange->report(done,active ? m_vec_KLS[current_max] : -HUGE_VAL);
+    }
+  }
+  else if(m_variable_B && active && !MCMC_only){
     unsigned long long int current_max = find_max(m_vec_KLS,m_num);
    
     while(current_number<m_max_sample_size_A){
@@ -487,11 +807,22 @@ void SMC_PP_MCMC::increase_vector(int ds, unsigned long long int sample_size) {
   }
 }
 
-void SMC_PP_MCMC::resample_particles(double start, double end, int num, const char * ptr2char,int ds){
+struct SMC_PP_MCMC::Rejuvenation_Worker{
+  SMC_PP_MCMC * smc;
+  rj_pp * rj_pp_obj;
+  int ds;
+  int seed;
+  unsigned long long int num_blocks;
+  unsigned long long int * block_starts;
+  unsigned long long int * next_block;
+  pthread_mutex_t * lock;
+};
+
+rj_pp * SMC_PP_MCMC::rejuvenation_sampler(double start, double end, int num, const char * ptr2char, probability_model * pm, int se){
     double move_width=m_move_width;
     double normal_pars[2] = {start,(end-start)/3};
 
-    rj_pp * rj_pp_obj = new rj_pp(start,end,num,10000,move_width,m_nu,m_var_nu,m_pm[ds],1,0,m_discrete,0,NULL,seed*(iters+1),true);
+    rj_pp * rj_pp_obj = new rj_pp(start,end,num,10000,move_width,m_nu,m_var_nu,pm,1,0,m_discrete,0,NULL,se,false);
 
     if(m_proposal_type && m_vec_proposal_type){
       if(strcmp(m_proposal_type,"Histogram")==0){
@@ -507,67 +838,163 @@ void SMC_PP_MCMC::resample_particles(double start, double end, int num, const ch
       rj_pp_obj->calculate_intensity();
     }
 
+    //changepoints before the cutoff have been retired and must stay where they are
+    if(m_history_cutoff>start){
+      rj_pp_obj->set_start_cps(m_history_cutoff);
+    }
+
     if(!m_conjugate){
       rj_pp_obj->non_conjugate();
     }
 
-    rj_pp_obj->stop_storing_sample();
+    return rj_pp_obj;
+}
 
-    for(unsigned long long int i=m_sample_size_A[ds]-1; i>0; i--){
-        if(m_sample_A[ds][i]==m_sample_A[ds][i-1]){
-            m_sample_A[ds][i]=new Particle<changepoint>(m_sample_A[ds][i],NULL);
+/*moves particles begin..end-1 from the highest index down. Duplicated pointers are
+  adjacent after resampling and must not straddle the range; each copy of a duplicate
+  runs its chain on the shared particle, which is only copied when a move is accepted.
+  Copies which accept nothing keep pointing at the shared particle and are gathered at
+  the start of their group so that duplicates stay adjacent.*/
+void SMC_PP_MCMC::rejuvenate_particles(rj_pp * rj_pp_obj, int ds, unsigned long long int begin, unsigned long long int end){
+    Particle<changepoint> ** sample = m_sample_A[ds];
+    unsigned long long int i = end;
+    while(i>begin){
+      unsigned long long int first = i-1;
+      while(first>begin && sample[first-1]==sample[i-1])
+	first--;
+      Particle<changepoint> * shared = sample[i-1];
+      bool still_referenced = false;
+      for(unsigned long long int j=i; j>first; j--){
+	//the last chain of a group may move the particle in place if no other index holds it
+	rj_pp_obj->share_initial_sample(j-1>first || still_referenced);
+	rj_pp_obj->set_initial_sample(shared);
+	rj_pp_obj->runsimulation();
+	sample[j-1] = rj_pp_obj->release_current_particle();
+	if(sample[j-1]==shared)
+	  still_referenced = true;
+      }
+      //keep the indices still sharing a particle adjacent, the particles all carry equal weight
+      if(still_referenced){
+	unsigned long long int k = first;
+	for(unsigned long long int j=first; j<i; j++){
+	  if(sample[j]==shared){
+	    sample[j] = sample[k];
+	    sample[k++] = shared;
+	  }
 	}
-        rj_pp_obj->set_initial_sample(m_sample_A[ds][i]);
-       	rj_pp_obj->runsimulation();
+      }
+      i = first;
     }
-    
-    rj_pp_obj->set_initial_sample(m_sample_A[ds][0]);
-    rj_pp_obj->runsimulation();
-    m_sample_A[ds][0] = new Particle<changepoint>(rj_pp_obj->get_current_particle(),NULL);
-    delete rj_pp_obj;
 }
 
-void SMC_PP_MCMC::ESS_resample_particles(double end,int ds){
+void * SMC_PP_MCMC::rejuvenation_thread(void * arg){
+    Rejuvenation_Worker * worker = (Rejuvenation_Worker*)arg;
+    unsigned long long int b;
+    while(true){
+      pthread_mutex_lock(worker->lock);
+      b = (*worker->next_block)++;
+      pthread_mutex_unlock(worker->lock);
+      if(b>=worker->num_blocks)
+	break;
+      worker->rj_pp_obj->set_seed(worker->seed+b);
+      worker->smc->rejuvenate_particles(worker->rj_pp_obj,worker->ds,worker->block_starts[b],worker->block_starts[b+1]);
+    }
+    return NULL;
+}
 
-    int * num_resampled_particles = new int[ m_sample_size_A[ds]];
-    double unif_rand = gsl_ran_flat(r,0,1)*(1.0/((double)m_sample_size_A[ds]));
- 
-    for (unsigned int i=0; i<m_sample_size_A[ds]; i++){
-        num_resampled_particles[i]=0;
+void SMC_PP_MCMC::resample_particles(double start, double end, int num, const char * ptr2char,int ds){
+    unsigned long long int size = m_sample_size_A[ds];
+    unsigned long long int num_blocks = (size+REJUVENATION_BLOCK_SIZE-1)/REJUVENATION_BLOCK_SIZE;
+    unsigned int num_threads = m_num_threads < num_blocks ? m_num_threads : (unsigned int)num_blocks;
+
+    //worker 0 runs on this thread with the original model, the others on copies
+    probability_model ** pm = new probability_model*[num_threads>0 ? num_threads : 1];
+    pm[0] = m_pm[ds];
+    for(unsigned int t=1; t<num_threads; t++){
+      pm[t] = m_pm[ds]->clone();
+      if(!pm[t]){
+	num_threads = t;
+	break;
+      }
     }
 
-    unsigned int  j=0, k=0;
+    if(num_threads<2){
+      rj_pp * rj_pp_obj = rejuvenation_sampler(start,end,num,ptr2char,m_pm[ds],seed*(iters+1));
+      rejuvenate_particles(rj_pp_obj,ds,0,size);
+      delete rj_pp_obj;
+      delete [] pm;
+      return;
+    }
 
-    while(k<m_sample_size_A[ds]){
-      while((m_cum_exp_weights[ds][j]/m_sum_exp_weights[ds] - unif_rand) > ((double)k)/((double)m_sample_size_A[ds]) && k<m_sample_size_A[ds]){
-	num_resampled_particles[j]++;
+    unsigned long long int * block_starts = new unsigned long long int[num_blocks+1];
+    block_starts[0] = 0;
+    for(unsigned long long int b=1; b<num_blocks; b++){
+      unsigned long long int k = max(b*REJUVENATION_BLOCK_SIZE,block_starts[b-1]);
+      while(k<size && m_sample_A[ds][k]==m_sample_A[ds][k-1])
 	k++;
-      }
-      j++;
+      block_starts[b] = k;
+    }
+    block_starts[num_blocks] = size;
+
+    unsigned long long int next_block = 0;
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock,NULL);
+    Rejuvenation_Worker * workers = new Rejuvenation_Worker[num_threads];
+    pthread_t * threads = new pthread_t[num_threads];
+    bool * started = new bool[num_threads];
+    for(unsigned int t=0; t<num_threads; t++){
+      workers[t].smc = this;
+      workers[t].rj_pp_obj = rejuvenation_sampler(start,end,num,ptr2char,pm[t],seed*(iters+1));
+      workers[t].ds = ds;
+      workers[t].seed = seed*(iters+1);
+      workers[t].num_blocks = num_blocks;
+      workers[t].block_starts = block_starts;
+      workers[t].next_block = &next_block;
+      workers[t].lock = &lock;
+      started[t] = false;
     }
+    //any blocks left by a thread which could not be started are picked up by the others
+    for(unsigned int t=1; t<num_threads; t++)
+      started[t] = pthread_create(&threads[t],NULL,rejuvenation_thread,(void*)(&workers[t]))==0;
+    rejuvenation_thread((void*)(&workers[0]));
+    for(unsigned int t=0; t<num_threads; t++){
+      if(started[t])
+	pthread_join(threads[t],NULL);
+      delete workers[t].rj_pp_obj;
+      if(t>0)
+	delete pm[t];
+    }
+    pthread_mutex_destroy(&lock);
 
-    Particle<changepoint> ** holding;
-    holding = new Particle<changepoint> *[m_max_sample_size_A];
+    delete [] started;
+    delete [] threads;
+    delete [] workers;
+    delete [] block_starts;
+    delete [] pm;
+}
 
-    for(unsigned int i=0; i<m_sample_size_A[ds]; i++){
-        if(num_resampled_particles[i]==0)
-            delete m_sample_A[ds][i];
-    }
-        
-    j=0;
+void SMC_PP_MCMC::ESS_resample_particles(double end,int ds){
 
-    for(unsigned int i=0; i<m_sample_size_A[ds]; i++){
-      while(num_resampled_particles[i]>0){
-	holding[j++]=m_sample_A[ds][i];
-	-- num_resampled_particles[i];
-      }
+    m_resampler.resample(m_exp_weights[ds],m_sum_exp_weights[ds],m_sample_size_A[ds],r);
+    unsigned long long int * num_resampled_particles = m_resampler.get_counts();
+
+    //particles left unmoved by rejuvenation are shared by adjacent indices, delete only when the whole run dies
+    unsigned long long int run_start = 0, run_count = 0;
+    for(unsigned long long int i=0; i<m_sample_size_A[ds]; i++){
+        if(i>0 && m_sample_A[ds][i]!=m_sample_A[ds][i-1]){
+            if(run_count==0)
+                delete m_sample_A[ds][run_start];
+            run_start = i;
+            run_count = 0;
+        }
+        run_count += num_resampled_particles[i];
     }
+    if(m_sample_size_A[ds]>0 && run_count==0)
+        delete m_sample_A[ds][run_start];
 
-    delete [] m_sample_A[ds];
-    m_sample_A[ds] = holding;
-    delete [] num_resampled_particles;
+    m_resampler.permute_in_place(m_sample_A[ds]);
 
-    for(unsigned int i=0; i<m_sample_size_A[ds]; i++){
+    for(unsigned long long int i=0; i<m_sample_size_A[ds]; i++){
       m_weights[ds][i]=0;
     }
 }
@@ -874,6 +1301,8 @@ void SMC_PP_MCMC::calculate_function_of_interest(double start, double end){
       if(start==m_start && end==m_end){
 	m_functionofinterest[ds]->reset_prob();
       }
+      if(m_foi_difference_arrays)
+	m_functionofinterest[ds]->use_difference_arrays(m_num_threads);
       if(m_process_observed[ds]>0){
 	m_functionofinterest[ds]->calculate_function(start,end,m_sample_A[ds],m_sample_size_A[ds],m_exp_weights[ds],m_sum_exp_weights[ds],m_sum_squared_exp_weights[ds],iters,1,m_pm[ds]);
       }
@@ -8,6 +8,7 @@
 #include "probability_model.hpp"
 #include "function_of_interest.hpp"
 #include "rejection_sampling.hpp"
+#include "divergence_exchange.hpp"
 #include <list>
 #include <utility>  
 
@@ -51,6 +52,36 @@ public:
     void print_rejection_sampling_acceptance_rates(int, const char *);
   void sample_intensities(Particle<changepoint> **, double, unsigned int, int);
   void set_discrete_model(){m_discrete = true;}
+  /*number of threads used to move the particles after resampling*/
+  void set_num_threads(unsigned int n){m_num_threads = n>0 ? n : 1;}
+  /*add up the functions of interest with difference arrays over the threads*/
+  void use_foi_difference_arrays(bool d = true){m_foi_difference_arrays = d;}
+  /*5%, 50% and 95% quantiles of the intensity on the grid, written next to it by print_intensity;
+    after initialise_function_of_interest*/
+  void calculate_intensity_bands(){ if(m_functionofinterest) for(int ds=0; ds<m_num; ds++) m_functionofinterest[ds]->calculate_intensity_bands(); }
+  /*place the grid cells of the intensity where the changepoints are dense, see Function_of_Interest::use_adaptive_grid*/
+  void use_adaptive_foi_grid(){ if(m_functionofinterest) for(int ds=0; ds<m_num; ds++) m_functionofinterest[ds]->use_adaptive_grid(); }
+  /*rejection sampling proposes in blocks of this size over the threads, 0 for one at a time*/
+  void set_rejection_block_size(unsigned int b){m_rejection_block_size = b;}
+  /*rejection sampling proposes from an adaptive envelope of up to this many segments, 0 for the prior*/
+  void set_rejection_envelope(unsigned int s){m_rejection_envelope = s;}
+  /*cap on the number of new particles sampled on each interval, 0 for no cap*/
+  void set_particle_budget(unsigned long long int b){m_particle_budget = b;}
+  unsigned long long int get_particle_budget() const{return m_particle_budget;}
+  double get_intensity(int ds, double t){return m_functionofinterest[ds]->get_intensity(t);}
+  /*fixed-lag mode: changepoints more than h before the end of the current interval are no
+    longer moved and are dropped from the particles, 0 keeps the whole history*/
+  void set_history_horizon(double h){m_history_horizon = h>0 ? h : 0;}
+  virtual void retire_history(double);
+  /*share the variable sample size budget with samplers for other processes, not owned*/
+  void set_divergence_exchange(Divergence_Exchange * de){m_divergence_exchange = de;}
+  /*the complete state after the last interval completed. read_checkpoint restores it into a
+    sampler set up with the same options which has not been run, returning false if the
+    checkpoint does not match (the sampler must then be discarded). Not for sequential MCMC.*/
+  void write_checkpoint(ostream &) const;
+  bool read_checkpoint(istream &);
+  /*the number of intervals completed when a checkpoint was written*/
+  static bool read_checkpoint_interval(istream &, unsigned int &);
   
 
 private:
@@ -92,9 +123,26 @@ private:
         double **m_rejection_sampling_acceptance_rate;
         unsigned int **m_num_zero_weights;
   bool m_discrete;
+  unsigned int m_num_threads;
+  bool m_foi_difference_arrays;
+  unsigned int m_rejection_block_size;
+  unsigned int m_rejection_envelope;
+  unsigned long long int m_particle_budget;
+  double m_history_horizon;
+  double m_history_cutoff;
+  Divergence_Exchange * m_divergence_exchange;
        
  
   void increase_vector(int, unsigned long long int);
+  virtual void process_telemetry(int);
+  struct Rejuvenation_Worker;
+  rj_pp * rejuvenation_sampler(double, double, int, const char *, probability_model *, int);
+  void rejuvenate_particles(rj_pp *, int, unsigned long long int, unsigned long long int);
+  static void * rejuvenation_thread(void *);
+  static void write_changepoint(ostream &, const changepoint *);
+  static changepoint * read_changepoint(istream &);
+  static void write_particle(ostream &, Particle<changepoint> *);
+  static Particle<changepoint> * read_particle(istream &);
 	static bool MyDataSort(const pair<double,int>&, const pair<double,int>&);
 
 };
@@ -1,6 +1,25 @@
 #include "SNCP.hpp"
 #include "math.h"
+#include "checkpoint.hpp"
 #include <gsl/gsl_sf_gamma.h>
+#include <cstring>
+
+//entries in each of the direct mapped caches of decay factors and normalising constants
+static const unsigned int SNCP_CACHE_SIZE = 1024;
+//the truncated gamma proposals are drawn whole and rejected above the bound while at least
+//this share of the mass lies below it, and by inverting the cdf on [0,bound] otherwise
+static const double TRUNCATED_GAMMA_REJECTION_LIMIT = 0.1;
+static const int TRUNCATED_GAMMA_MAX_ITERATIONS = 100;
+static const double TRUNCATED_GAMMA_TOLERANCE = 1e-12;
+
+static unsigned long long int cache_hash(double x, unsigned long long int h = 0){
+  unsigned long long int bits;
+  memcpy(&bits,&x,sizeof(bits));
+  h ^= bits + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  return h ^ (h >> 29);
+}
 
 sncp_model::sncp_model(double alpha, double kappa, Data<double> * data, int seed)
 :probability_model(data){
@@ -14,14 +33,31 @@ sncp_model::sncp_model(double alpha, double kappa, Data<double> * data, int seed
   m_r = gsl_rng_alloc(r_type);
   gsl_rng_set(m_r,seed);
   m_pp_time_scale = new Decay_Function(m_kappa);
-
+  //NaN keys so that no entry matches until it has been filled
+  m_decay_cache = new Decay_Entry[SNCP_CACHE_SIZE];
+  m_normaliser_cache = new Normaliser_Entry[SNCP_CACHE_SIZE];
+  for(unsigned int i=0; i<SNCP_CACHE_SIZE; i++){
+    m_decay_cache[i].length = NAN;
+    m_normaliser_cache[i].alpha = NAN;
+  }
 
 }
 
 sncp_model::~sncp_model(){
   gsl_rng_free(m_r);
   delete m_pp_time_scale;
+  delete [] m_decay_cache;
+  delete [] m_normaliser_cache;
+
+}
+
+void sncp_model::write_state(ostream & out) const{
+  probability_model::write_state(out);
+  checkpoint_write_rng(out,m_r);
+}
 
+bool sncp_model::read_state(istream & in){
+  return probability_model::read_state(in) && checkpoint_read_rng(in,m_r);
 }
 
 double sncp_model::log_likelihood_interval(changepoint *obj1, changepoint *obj2, changepoint *ojbl1){
@@ -39,7 +75,7 @@ double sncp_model::log_likelihood_interval(changepoint *obj1, changepoint *obj2,
 
   double theta = obj1->getmeanvalue();
 
-  long double likelihood=1-exp(-m_kappa*length);
+  long double likelihood=1-decay(length);
 
   likelihood*=m_inv_kappa;
 
@@ -66,7 +102,7 @@ void sncp_model::propose_combined_parameters(Particle<changepoint>* A_particle,P
   double theta1 = c1->getmeanvalue();
   double theta2 = c2->getmeanvalue();
 
-  double discontinuity =theta1*exp(-m_kappa*(d-c1->getchangepoint()))-theta2*exp(-m_kappa*(d-c2->getchangepoint()));  
+  double discontinuity =theta1*decay(d-c1->getchangepoint())-theta2*decay(d-c2->getchangepoint());  
   m_prior_ratio=-m_prior_ratio_log_term-m_alpha*theta2;
 
   if(dim_B==0){
@@ -90,7 +126,7 @@ void sncp_model::propose_combined_parameters(Particle<changepoint>* A_particle,P
       m_proposal_ratio-= c1->getlikelihood();
       //cout<<m_proposal_ratio<<endl;
       original_mean = c1->getmeanvalue();
-      exp_term=exp(-m_kappa*(c1->getchangepoint()-d));
+      exp_term=decay(c1->getchangepoint()-d);
       new_mean = original_mean+discontinuity*exp_term;
       c1->setmeanvalue(new_mean);
       double likelihood = log_likelihood_interval(c1,c2);
@@ -100,7 +136,7 @@ void sncp_model::propose_combined_parameters(Particle<changepoint>* A_particle,P
     }
     original_mean = c1->getmeanvalue();
     m_proposal_ratio-=c1->getlikelihood();
-    exp_term=exp(-m_kappa*(c1->getchangepoint()-d));
+    exp_term=decay(c1->getchangepoint()-d);
     new_mean = original_mean+discontinuity*exp_term;
     c1->setmeanvalue(new_mean);
     double likelihood = log_likelihood_interval(c1,eoi);
@@ -141,13 +177,13 @@ void sncp_model::propose_new_parameters(Particle<changepoint> * parti, int posit
     cpobjact = parti->get_theta_component(position);
     mean = cpobj_left->getmeanvalue();
     m_prior_ratio=-m_prior_ratio_log_term;
-    m_prior_ratio+=m_alpha*(cpobjact->getmeanvalue()+mean-mean*exp(-m_kappa*(cpobjact->getchangepoint()-cpobj_left->getchangepoint())));
+    m_prior_ratio+=m_alpha*(cpobjact->getmeanvalue()+mean-mean*decay(cpobjact->getchangepoint()-cpobj_left->getchangepoint()));
     m_proposal_ratio += gamma_distribution_calculations(cpobj_double_left,cpobj_left,cpobjact,cpobj_right,0);
     m_proposal_ratio+= gamma_distribution_calculations(cpobj_left,cpobjact,cpobj_right,NULL,0);
   }else if(move_type==2/*move changepoint*/){
     mean = cpobj_left->getmeanvalue();
     cpobjact= parti->get_theta_component(position);
-    m_prior_ratio=m_alpha*(mean+cpobjact->getmeanvalue()-mean*exp(-m_kappa*(cpobjact->getchangepoint()-cpobj_left->getchangepoint())));
+    m_prior_ratio=m_alpha*(mean+cpobjact->getmeanvalue()-mean*decay(cpobjact->getchangepoint()-cpobj_left->getchangepoint()));
     m_proposal_ratio += gamma_distribution_calculations(cpobj_double_left,cpobj_left,cpobjact,cpobj_right,0);
     m_proposal_ratio += gamma_distribution_calculations(cpobj_left,cpobjact,cpobj_right,NULL,0);
   }else if(move_type==3){
@@ -170,12 +206,12 @@ void sncp_model::propose_new_parameters(Particle<changepoint> * parti, int posit
   /* prior after parameters have been changed*/
   if(move_type==0){
     mean = cpobj_left->getmeanvalue();
-    m_prior_ratio-=m_alpha*(mean+new_value->getmeanvalue()-mean*exp(-m_kappa*(new_value->getchangepoint()-cpobj_left->getchangepoint())));
+    m_prior_ratio-=m_alpha*(mean+new_value->getmeanvalue()-mean*decay(new_value->getchangepoint()-cpobj_left->getchangepoint()));
   }else if(move_type==1){
     m_prior_ratio-=m_alpha*(cpobj_left->getmeanvalue());
   }else if(move_type==2){
     mean = cpobj_left->getmeanvalue();
-    m_prior_ratio-=m_alpha*(mean+new_value->getmeanvalue()-mean*exp(-m_kappa*(new_value->getchangepoint()-cpobj_left->getchangepoint())));
+    m_prior_ratio-=m_alpha*(mean+new_value->getmeanvalue()-mean*decay(new_value->getchangepoint()-cpobj_left->getchangepoint()));
   }else if(move_type==3){
     m_prior_ratio-=m_alpha*cpobj_left->getmeanvalue();
   }else{cerr<<"no valid move"<<endl; exit(1);}
@@ -197,10 +233,10 @@ double sncp_model::gamma_distribution_calculations(changepoint * cpobjleft, chan
   if(cpobjleft){
     t2 = cpobjleft->getchangepoint();
     double length1 = t1-t2;    
-    previous_height = cpobjleft->getmeanvalue()*exp(-m_kappa*length1);
+    previous_height = cpobjleft->getmeanvalue()*decay(length1);
   }
   
-  long double z = -m_inv_kappa*exp(-m_kappa*length2)+m_inv_kappa+m_alpha;
+  long double z = -m_inv_kappa*decay(length2)+m_inv_kappa+m_alpha;
   unsigned long long int i1 = cpobjact->getdataindex();
   unsigned long long int i2 = cpobjright->getdataindex();
   unsigned long long int r = i2-i1;
@@ -227,7 +263,7 @@ double sncp_model::gamma_distribution_calculations(changepoint * cpobjleft, chan
   }
 
   if(m>0){
-    bound = m*exp(m_kappa*length_bound)-previous_height;
+    bound = m/decay(length_bound)-previous_height;
   }
  
  
@@ -263,36 +299,65 @@ double sncp_model::calculate_pdf(double value, double alpha,double z){
   return pdf;
 }
 
+double sncp_model::decay(double length){
+  Decay_Entry & e = m_decay_cache[cache_hash(length) % SNCP_CACHE_SIZE];
+  if(e.length != length){
+    e.length = length;
+    e.value = exp(-m_kappa*length);
+  }
+  return e.value;
+}
+
 double sncp_model::calculate_normalising_constant(double alpha,double z,double bound){
-  long double norm =1 ; 
-  if(bound>0){
-   norm = gsl_cdf_gamma_P(bound,alpha,1.0/(double)z);
+  if(!(bound>0))
+    return 1;
+  Normaliser_Entry & e = m_normaliser_cache[cache_hash(bound,cache_hash(z,cache_hash(alpha))) % SNCP_CACHE_SIZE];
+  if(e.alpha != alpha || e.z != z || e.bound != bound){
+    e.alpha = alpha;
+    e.z = z;
+    e.bound = bound;
+    e.norm = gsl_cdf_gamma_P(bound,alpha,1.0/(double)z);
   }
-  return norm;
+  return e.norm;
 }
 
+/*a draw from the gamma(alpha, 1/z) distribution truncated to [0,bound], or not truncated if
+  bound is not positive, norm being the mass below the bound. alpha is never less than 1.
+  When the bound cuts off most of the mass the cdf is inverted by Newton steps on its log,
+  kept inside a bracket which shrinks every step, starting from the inverse of the leading
+  power of the lower tail, so there is always an answer in [0,bound].*/
 double sncp_model::propose_new_parameters(double alpha,double z,double  previous_height, double bound,double norm){
 
-  gsl_error_handler_t * old_handler = gsl_set_error_handler_off();
-  double new_value=NAN;
-  int count =0;
-  while(new_value!=new_value){
-    double u = gsl_ran_flat(m_r,0,1);
-    u*=norm;
-
-    new_value = gsl_cdf_gamma_Pinv(u,alpha,1.0/(double)z); 
-
-    //if(new_value!=new_value)
-    //  cout<<u<<" "<<norm<<" "<<bound<<" "<<alpha<<" "<<z<<" "<<previous_height<<endl;
-    
-    count++;
-    if(count>20 and bound>0){
-      new_value=(previous_height+bound)/2;
-      //cout<<new_value<<endl;
-    }
+  double scale = 1.0/(double)z;
+  double new_value;
+  if(!(bound>0))
+    return gsl_ran_gamma(m_r,alpha,scale);
+  if(norm>=TRUNCATED_GAMMA_REJECTION_LIMIT){
+    do{
+      new_value = gsl_ran_gamma(m_r,alpha,scale);
+    }while(new_value>bound);
+    return new_value;
+  }
+
+  double u = gsl_rng_uniform_pos(m_r);
+  new_value = bound*pow(u,1.0/alpha);
+  if(!(norm>0))
+    return new_value;
+  double log_target = log(u*norm);
+  double lo = 0, hi = bound;
+  for(int i=0; i<TRUNCATED_GAMMA_MAX_ITERATIONS; i++){
+    double p = gsl_cdf_gamma_P(new_value,alpha,scale);
+    double difference = log(p)-log_target;
+    if(difference<0)
+      lo = new_value;
+    else
+      hi = new_value;
+    double next = new_value-difference*p/gsl_ran_gamma_pdf(new_value,alpha,scale);
+    if(!(next>lo && next<hi))
+      next = (lo+hi)/2;
+    if(fabs(next-new_value)<=TRUNCATED_GAMMA_TOLERANCE*new_value)
+      return next;
+    new_value = next;
   }
-  gsl_set_error_handler(old_handler);
   return new_value;
 }
-				       
-
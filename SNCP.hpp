@@ -24,11 +24,16 @@ public:
  double gamma_distribution_calculations(changepoint *, changepoint *, changepoint *,changepoint * =NULL, bool=1);
  virtual double proposal_ratio(Particle<changepoint>*,unsigned int){return(m_proposal_ratio);}
  virtual double get_mean_function( double t ){ return m_pp_time_scale->function(t); }
+ virtual bool constant_mean_function(){ return false; }
  virtual void propose_combined_parameters(Particle<changepoint>*,Particle<changepoint>*,changepoint *, double);/*int tells the index of the particle for the combined region*/
  virtual double non_conjugate_weight_terms(Particle<changepoint>*);
  double calculate_pdf(double, double, double);
  double calculate_normalising_constant(double , double , double);
  double propose_new_parameters(double, double, double, double, double);
+ /*exp(-kappa*length), remembered for the lengths seen lately*/
+ double decay(double length);
+ virtual void write_state(ostream &) const;
+ virtual bool read_state(istream &);
   
 private:
 
@@ -43,6 +48,20 @@ private:
 
  const gsl_rng_type * r_type;
  gsl_rng * m_r;
+
+ /*The decay factors and the truncated gamma normalising constants of the changepoints come
+   from the positions, means and data indices of their neighbours, so they are kept in small
+   direct mapped tables keyed on exactly those inputs: a changepoint whose neighbours have not
+   moved finds its values again on the next proposal, and one whose neighbours have misses
+   and has them worked out afresh.*/
+ struct Decay_Entry{
+   double length, value;
+ };
+ struct Normaliser_Entry{
+   double alpha, z, bound, norm;
+ };
+ Decay_Entry * m_decay_cache;
+ Normaliser_Entry * m_normaliser_cache;
 };
 
 
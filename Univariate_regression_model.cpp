@@ -2,30 +2,70 @@
 #include <gsl/gsl_sf_gamma.h>
 #include <math.h>
 
+ur_series_block::ur_series_block(Data<double> * data, unsigned int num_series){
+  m_num_series = num_series>0 && num_series<data->get_rows() ? num_series : data->get_rows();
+  m_data_points = data->get_cols();
+  m_ysum = new double[m_num_series*m_data_points];
+  m_ysum2 = new double[m_num_series*m_data_points];
+  for (unsigned int k=0; k<m_num_series; k++){
+    const double * x = data->m_X[k];
+    double * ysum = m_ysum+k*m_data_points;
+    double * ysum2 = m_ysum2+k*m_data_points;
+    ysum[0] = x[0];
+    ysum2[0] = x[0]*x[0];
+    for (unsigned long long int i=1; i<m_data_points; i++){
+      ysum[i] = x[i] + ysum[i-1];
+      ysum2[i] = x[i]*x[i] + ysum2[i-1];
+    }
+  }
+}
+
+ur_series_block::~ur_series_block(){
+  delete [] m_ysum;
+  delete [] m_ysum2;
+}
+
 ur_model::ur_model(double alpha,double gamma, double vconst, Data<double> *data)
-:probability_model(),m_alpha(alpha),m_gamma(gamma),m_v(vconst)
+:probability_model(),m_alpha(alpha),m_gamma(gamma),m_v(vconst),m_lgamma(0.5)
+{
+  m_data_ur = data;
+  m_own_block = new ur_series_block(data,1);
+  construct(m_own_block,0);
+}
+
+ur_model::ur_model(double alpha,double gamma, double vconst, const ur_series_block * block, unsigned int series)
+:probability_model(),m_alpha(alpha),m_gamma(gamma),m_v(vconst),m_lgamma(0.5)
 {
+  m_data_ur = NULL;
+  m_own_block = NULL;
+  construct(block,series);
+}
+
+void ur_model::construct(const ur_series_block * block, unsigned int series){
   m_prior_mean = 0;
-    m_data_ur = data;
-    m_data_points = m_data_ur->get_cols();
-    m_likelihood_term = -0.5*log(m_v)+m_alpha*log(m_gamma)-gsl_sf_lngamma(m_alpha);
-    m_inv_v = 1.0 / m_v;
-    m_ysum = new double[m_data_points];
-    m_ysum2 = new double[m_data_points];
-    m_ysum[0]= m_data_ur->m_X[0][0];
-    m_ysum2[0] = (m_data_ur->m_X[0][0])*(m_data_ur->m_X[0][0]);
-    for (unsigned int i=1; i<m_data_points; i++){
-        m_ysum[i]=m_data_ur->m_X[0][i] + m_ysum[i-1];
-        m_ysum2[i]=(m_data_ur->m_X[0][i])*(m_data_ur->m_X[0][i]) +m_ysum2[i-1];
-    }
-    m_estimate_variance=false;
+  m_data_points = block->get_data_points();
+  m_likelihood_term = -0.5*log(m_v)+m_alpha*log(m_gamma)-gsl_sf_lngamma(m_alpha);
+  m_inv_v = 1.0 / m_v;
+  m_ysum = block->get_ysum(series);
+  m_ysum2 = block->get_ysum2(series);
+  m_lgamma.reset(m_alpha,m_data_points);
+  m_estimate_variance=false;
 }
 
 ur_model::~ur_model(){
   //    if(m_data_ur)
   //        delete m_data_ur;
-    delete [] m_ysum;
-    delete[] m_ysum2;
+  if(m_own_block)
+    delete m_own_block;
+}
+
+probability_model* ur_model::clone() const{
+  if(m_prior_mean)
+    return NULL;
+  ur_model* pm = new ur_model(*this);
+  pm->release_shared_ownership();
+  pm->m_own_block = NULL;
+  return pm;
 }
 
 void ur_model::use_random_mean(int seed) {
@@ -58,7 +98,7 @@ double ur_model::log_likelihood_interval(changepoint *obj1, changepoint *obj2, c
 	y2=m_ysum2[dataindex2-1]-m_ysum2[dataindex1-1];
       }
       double r_foo = r / 2.0;
-      like += -0.5*log(m_inv_v+r)-(r_foo)*LOG_PI + gsl_sf_lngamma(r_foo+m_alpha)-(r_foo+m_alpha)*log(m_gamma+0.5*(y2-y*y*(1.0/(m_inv_v+r))));
+      like += -0.5*log(m_inv_v+r)-(r_foo)*LOG_PI + m_lgamma(m_alpha,dataindex2-dataindex1)-(r_foo+m_alpha)*log(m_gamma+0.5*(y2-y*y*(1.0/(m_inv_v+r))));
     }
     return(like);
 }
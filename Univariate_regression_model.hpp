@@ -2,18 +2,44 @@
 #define UNIVARIATE_REGRESSION_MODEL_HPP
 
 #include "probability_model.hpp"
+#include "lgamma_table.hpp"
 
 //#define M_PI 3.14159265358979323846264338327950288419716939937510
 #define LOG_PI log(M_PI)//1.14472988584940017414342735135305871164729481291531
 
 
+/*The running sums of y and y*y of a number of series of the same length, the rows of a data
+  matrix, in one block for all of them: the sums of each series in turn, then the sums of
+  squares. A batch of ur_models, one for each series, reads them from here rather than each
+  holding its own copy.*/
+class ur_series_block{
+
+ public:
+  /*the first num_series rows of data, all of them if 0*/
+  ur_series_block(Data<double> * data, unsigned int num_series = 0);
+  ~ur_series_block();
+  unsigned int get_num_series() const {return m_num_series;}
+  unsigned long long int get_data_points() const {return m_data_points;}
+  const double * get_ysum(unsigned int series) const {return m_ysum+series*m_data_points;}
+  const double * get_ysum2(unsigned int series) const {return m_ysum2+series*m_data_points;}
+
+ private:
+  unsigned int m_num_series;
+  unsigned long long int m_data_points;
+  double * m_ysum;
+  double * m_ysum2;
+};
 
 class ur_model : public probability_model{
 
   public:
 
   ur_model(double, double, double, Data<double> *);
+  /*the model of one series of a block, which must outlive it*/
+  ur_model(double, double, double, const ur_series_block *, unsigned int series);
   ~ur_model();
+  /*shares the running sums, NULL with random means*/
+  virtual probability_model* clone() const;
 
   virtual  double log_likelihood_interval(changepoint *, changepoint *, changepoint * = NULL);
   virtual  double calculate_mean(changepoint *, changepoint *, changepoint * = NULL);
@@ -28,11 +54,15 @@ class ur_model : public probability_model{
    const double m_v; //regressor prior variance parameter
    double m_inv_v;
    double m_likelihood_term;
-   double * m_ysum;
-   double * m_ysum2;
+   Lgamma_Table m_lgamma;//lgamma(m_alpha+r/2) for the interval lengths r seen so far
+   ur_series_block * m_own_block;//NULL unless the model reads its own data
+   const double * m_ysum;
+   const double * m_ysum2;
    unsigned long long int m_data_points;
    bool m_estimate_variance;//if true, report E[sigma^2] rather than E[mu]
   bool m_prior_mean;
+
+  void construct(const ur_series_block *, unsigned int series);
 };
 
 
@@ -13,6 +13,7 @@ struct option ArgumentOptions::lopts[] = {
     {"modelprior2", required_argument, NULL, 'b'},
     {"seed", required_argument, NULL, 's'},
     {"mean", no_argument, NULL, 'l'},
+    {"bands", no_argument, NULL, 'Q'},
     {"grid", required_argument, NULL, 'g'},
     {"emptyintervals", no_argument, NULL, 'e'},
     {"writecps", no_argument, NULL, 'v'},
@@ -36,6 +37,7 @@ ArgumentOptions::ArgumentOptions(){
   srand (time(NULL));
   m_seed = rand() % 10000;
   m_calculate_posterior_mean = 1;
+  m_intensity_bands = 0;
   m_grid = 0;
   m_disallow_empty_intervals_between_cps = 0;
   m_write_cps_to_file = 0;
@@ -49,7 +51,7 @@ ArgumentOptions::ArgumentOptions(){
 
 void ArgumentOptions::parse(int argc, char * argv[]){
 
-   const char *sopts="hi:d:t:c:m:n:a:b:s:lg:evwzS:T:D:";
+   const char *sopts="hi:d:t:c:m:n:a:b:s:lg:evwzS:T:D:Q";
 
   //Parse arguments
   char opt;
@@ -82,6 +84,9 @@ void ArgumentOptions::parse(int argc, char * argv[]){
     case 'l':
       m_calculate_posterior_mean = 1;
       break;
+    case 'Q':
+      m_intensity_bands = 1;
+      break;
     case 'g':
       m_grid = stringtolong(optarg,opt);
       break;
@@ -156,6 +161,8 @@ void ArgumentOptions::usage(int status,char * programname){
   cerr << "-b | --modelprior2       prior parameter 2 (dependent on model), see documentation (default = " << m_gamma_prior_2 << ")" << endl;
   cerr << "-s | --seed              set the seed for generating random variables (default = current time)" << endl;
   cerr << "-l | --mean              calculate the posterior mean over --grid, no argument required (default = " << m_calculate_posterior_mean << ")" << endl;
+  cerr << "-Q | --bands             also write the 5%, 50% and 95% posterior quantiles of the intensity to intensity_bands.txt," << endl;
+  cerr << "                         estimated as the sample goes, no argument required (default = " << m_intensity_bands << ")" << endl;
   cerr << "-g | --grid              the number of grid points over which to calculate the posterior mean (default = END)" << endl;
   cerr << "-e | --emptyintervals    do not allow intervals between changepoints with no datapoints, no argument required (default = " <<  m_disallow_empty_intervals_between_cps << ")" << endl;
   cerr << "-v | --writecps          write changepoints and intensity, dimension and log posterior to file, no argument required (default = " << m_write_cps_to_file << ")" << endl;
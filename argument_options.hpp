@@ -33,6 +33,7 @@ class ArgumentOptions{
   double m_gamma_prior_2;
   int m_seed;
   bool m_calculate_posterior_mean;
+  bool m_intensity_bands;
   int m_grid;
   bool m_disallow_empty_intervals_between_cps;
   bool m_write_cps_to_file;
@@ -15,17 +15,33 @@ struct option ArgumentOptionsSMC::lopts[] = {
     {"modelprior1", required_argument, NULL, 'a'},
     {"modelprior2", required_argument, NULL, 'b'},
     {"modelpriorur", required_argument, NULL, 'A'},
+    {"series", no_argument, NULL, 'K'},
     {"seed", required_argument, NULL, 's'},
     {"mean", no_argument, NULL, 'l'},
+    {"bands", no_argument, NULL, 'Q'},
+    {"adaptivegrid", no_argument, NULL, 'G'},
     {"grid", required_argument, NULL, 'g'},
     {"emptyintervals", no_argument, NULL, 'e'},
     {"writecps", no_argument, NULL, 'v'},
     {"model", required_argument, NULL, 'c'},
     {"essthreshold",required_argument,NULL,'f'},
     {"writeess",no_argument,NULL,'w'},
+    {"resampling",required_argument,NULL,'R'},
+    {"alwaysresample",no_argument,NULL,'E'},
+    {"threads",required_argument,NULL,'T'},
+    {"foidifferences",no_argument,NULL,'D'},
+    {"latency",required_argument,NULL,'L'},
+    {"minparticles",required_argument,NULL,'M'},
+    {"horizon",required_argument,NULL,'H'},
+    {"checkpoint",required_argument,NULL,'C'},
+    {"checkpointevery",required_argument,NULL,'k'},
+    {"resume",no_argument,NULL,'u'},
+    {"telemetry",required_argument,NULL,'j'},
     {"importsampling", no_argument, NULL, 'z'},
     {"spacingprior", no_argument, NULL,  'P'},
     {"rejectionsampling", no_argument, NULL, 'r'},
+    {"rejectionblock", required_argument, NULL, 'B'},
+    {"envelope", required_argument, NULL, 'V'},
     {"sequentialmcmc", no_argument, NULL, 'S'},
     {"priorproposal", no_argument, NULL, 'o'},
     {NULL, 0, NULL, 0}
@@ -43,17 +59,33 @@ ArgumentOptionsSMC::ArgumentOptionsSMC(){
   m_gamma_prior_1 = 0.1;
   m_gamma_prior_2 = 0.1;
   m_v = 10;
+  m_series = 0;
   srand (time(NULL));
   m_seed = rand() % 10000;
   m_calculate_filtering_mean = 1;
+  m_intensity_bands = 0;
+  m_adaptive_grid = 0;
   m_grid = 0;
   m_disallow_empty_intervals_between_cps = 0;
   m_write_cps_to_file = 0;
   m_model = "poisson";
   m_ESS_threshold = 0.5;
   m_print_ESS = 0;
+  m_resampling_type = SYSTEMATIC;
+  m_resample_every_interval = 0;
+  m_num_threads = 1;
+  m_foi_difference_arrays = 0;
+  m_target_latency = 0;
+  m_min_particles = 100;
+  m_history_horizon = 0;
+  m_checkpoint_file = "";
+  m_checkpoint_every = 1;
+  m_resume = 0;
+  m_telemetry_file = "";
   m_importance_sampling = 0;
   m_rejection_sampling = 0;
+  m_rejection_block_size = 0;
+  m_rejection_envelope = 0;
   m_spacing_prior = 0;
   m_smcmc=false;
   m_prior_proposals=false;
@@ -64,7 +96,7 @@ ArgumentOptionsSMC::ArgumentOptionsSMC(){
 
 void ArgumentOptionsSMC::parse(int argc, char * argv[]){
 
-   const char *sopts="hi:p:d:t:m:n:a:b:A:s:lg:evwc:f:zPrSo";
+   const char *sopts="hi:p:d:t:m:n:a:b:A:Ks:lg:evwc:f:zPrB:V:SoR:ET:L:M:H:C:k:uj:DQG";
 
   //Parse arguments
   char opt;
@@ -97,12 +129,21 @@ void ArgumentOptionsSMC::parse(int argc, char * argv[]){
     case 'A':
       m_v = stringtodouble(optarg,opt);
       break;
+    case 'K':
+      m_series = 1;
+      break;
     case 's':
       m_seed = stringtolong(optarg,opt);
       break;
     case 'l':
       m_calculate_filtering_mean = 1;
       break;
+    case 'Q':
+      m_intensity_bands = 1;
+      break;
+    case 'G':
+      m_adaptive_grid = 1;
+      break;
     case 'g':
       m_grid = stringtolong(optarg,opt);
       break;
@@ -115,6 +156,39 @@ void ArgumentOptionsSMC::parse(int argc, char * argv[]){
     case 'w':
       m_print_ESS = 1;
       break;
+    case 'R':
+      m_resampling_type = Resampler::resampling_type_from_string(optarg);
+      break;
+    case 'E':
+      m_resample_every_interval = 1;
+      break;
+    case 'T':
+      m_num_threads = stringtolong(optarg,opt);
+      break;
+    case 'D':
+      m_foi_difference_arrays = 1;
+      break;
+    case 'L':
+      m_target_latency = stringtodouble(optarg,opt);
+      break;
+    case 'M':
+      m_min_particles = stringtolong(optarg,opt);
+      break;
+    case 'H':
+      m_history_horizon = stringtodouble(optarg,opt);
+      break;
+    case 'C':
+      m_checkpoint_file = optarg;
+      break;
+    case 'k':
+      m_checkpoint_every = stringtolong(optarg,opt);
+      break;
+    case 'u':
+      m_resume = 1;
+      break;
+    case 'j':
+      m_telemetry_file = optarg;
+      break;
     case 'c':
       m_model = optarg;
       break;
@@ -127,6 +201,12 @@ void ArgumentOptionsSMC::parse(int argc, char * argv[]){
     case 'r':
       m_rejection_sampling = 1;
       break;
+    case 'B':
+      m_rejection_block_size = stringtolong(optarg,opt);
+      break;
+    case 'V':
+      m_rejection_envelope = stringtolong(optarg,opt);
+      break;
     case 'P':
       m_spacing_prior = 1;
       break;
@@ -160,6 +240,23 @@ void ArgumentOptionsSMC::parse(int argc, char * argv[]){
     m_grid = m_num_intervals;
   }
   
+  if(m_series && m_model != "ur"){
+    cerr << "--series is only for the ur model" << endl;
+    usage(1,argv[0]);
+  }
+  if(m_series && (m_write_cps_to_file || !m_checkpoint_file.empty() || !m_telemetry_file.empty())){
+    cerr << "--writecps, --checkpoint and --telemetry are not available with --series" << endl;
+    usage(1,argv[0]);
+  }
+
+  if(m_checkpoint_every < 1){
+    m_checkpoint_every = 1;
+  }
+  if(m_resume && m_checkpoint_file.empty()){
+    cerr << "--resume needs a --checkpoint file" << endl;
+    usage(1,argv[0]);
+  }
+
   if(m_move_width == 0){
     double change_in_time = (m_end-m_start)/(double)m_num_intervals;
     m_move_width = change_in_time/3.0;
@@ -181,18 +278,50 @@ void ArgumentOptionsSMC::usage(int status,char * programname){
   cerr << "-a | --modelprior1       prior parameter 1 (dependent on model), see documentation (default = " << m_gamma_prior_1 << ")" << endl;
   cerr << "-b | --modelprior2       prior parameter 2 (dependent on model), see documentation (default = " << m_gamma_prior_2 << ")" << endl;
   cerr << "-A | --modelpriorur      regressor prior variance parameter for univariate regression (default = " << m_v << ")" << endl;
+  cerr << "-K | --series            ur model only: each line of DATAFILE is a series of its own, all segmented in" << endl;
+  cerr << "                         the one run sharing the --threads, and each written to files numbered by" << endl;
+  cerr << "                         its line from 0, eg intensitySMC_0.txt, no argument required (default = " << m_series << ")" << endl;
   cerr << "-s | --seed              set the seed for generating random variables (default = current time)" << endl;
   cerr << "-l | --mean              calculate the filtering estimate of the mean over --grid," << endl;
   cerr << "                         no argument required (default = " << m_calculate_filtering_mean << ")" << endl;
+  cerr << "-Q | --bands             also write the 5%, 50% and 95% quantiles of the filtered intensity next to it," << endl;
+  cerr << "                         estimated as the particles stream through, no argument required (default = " << m_intensity_bands << ")" << endl;
   cerr << "-g | --grid              the number of grid points over which to calculate the mean" << endl;
   cerr << "                         must be a multiple of intervals (default = END)" << endl;
+  cerr << "-G | --adaptivegrid      place the --grid cells of each interval where the changepoints and the jumps in" << endl;
+  cerr << "                         the intensity of the particles are dense, rather than evenly; the intensity is" << endl;
+  cerr << "                         then written with the boundaries of each cell, no argument required (default = " << m_adaptive_grid << ")" << endl;
   cerr << "-v | --writecps          write changepoints, intensity, and weights at the final time point," << endl;
   cerr << "                         no argument required (default = " << m_write_cps_to_file << ")" << endl;
   cerr << "-w | --writeess          write ESS to file (default = " << m_print_ESS << ")" << endl;
+  cerr << "-R | --resampling        resampling scheme: systematic, stratified, residual or multinomial" << endl;
+  cerr << "                         (default = " << Resampler::resampling_type_to_string(m_resampling_type) << ")" << endl;
+  cerr << "-E | --alwaysresample    resample every interval rather than only when the ESS of a process falls" << endl;
+  cerr << "                         below --essthreshold, no argument required (default = " << m_resample_every_interval << ")" << endl;
+  cerr << "-T | --threads           number of threads used to move the particles after resampling and to make" << endl;
+  cerr << "                         --rejectionblock proposals (default = " << m_num_threads << ")" << endl;
+  cerr << "-D | --foidifferences    add up the estimates over --grid with difference arrays over --threads," << endl;
+  cerr << "                         quicker for fine grids, the same estimates up to rounding (default = " << m_foi_difference_arrays << ")" << endl;
+  cerr << "-L | --latency           online mode only: target time in milliseconds to process an interval, the number" << endl;
+  cerr << "                         of new particles is adapted to meet it, 0 for no target (default = " << m_target_latency << ")" << endl;
+  cerr << "-M | --minparticles      online mode only: least number of new particles when meeting --latency (default = " << m_min_particles << ")" << endl;
+  cerr << "-H | --horizon           drop changepoints older than this from the particles once estimates up to" << endl;
+  cerr << "                         them have been made, bounding memory on long runs, 0 keeps them all (default = " << m_history_horizon << ")" << endl;
+  cerr << "-C | --checkpoint        write the complete sampler state to this file as the run goes on" << endl;
+  cerr << "-k | --checkpointevery   number of intervals between checkpoints (default = " << m_checkpoint_every << ")" << endl;
+  cerr << "-u | --resume            carry on from the --checkpoint file if there is one, no argument required" << endl;
+  cerr << "-j | --telemetry         write the time taken by each stage, the sample sizes and the ESS of every" << endl;
+  cerr << "                         interval to this file as JSON lines" << endl;
   cerr << "-z | --importsampling    do importance sampling for the coal data, no argument required (default = " << m_importance_sampling << ")" << endl;
   cerr << "-P | --spacingprior      use spacing prior for the coal data, no argument required (default = " << m_spacing_prior << ")" << endl;
   cerr << "-r | --rejectionsampling use rejection sampling rather than mcmc for the coal data," << endl;
   cerr << "                         no argument required (default = " << m_rejection_sampling << ")" << endl;
+  cerr << "-B | --rejectionblock    make the rejection sampling proposals in blocks of this size, each with its own random" << endl;
+  cerr << "                         numbers, over --threads; the sample does not depend on the number of threads," << endl;
+  cerr << "                         0 proposes one at a time (default = " << m_rejection_block_size << ")" << endl;
+  cerr << "-V | --envelope          propose rejection sampling changepoints from an envelope over the likelihood refined" << endl;
+  cerr << "                         at rejections up to this many segments, for data with strongly varying rates," << endl;
+  cerr << "                         0 proposes from the prior (default = " << m_rejection_envelope << ")" << endl;
   cerr << "-S | --sequentialmcmc    use full MCMC on the whole interval [0,t_i] at each update (default = " << m_smcmc << ")" << endl;
   cerr << "-o | --priorproposal     make proposals from prior in each SMC update interval (default = " << m_prior_proposals << ")" << endl;
  
@@ -224,6 +353,10 @@ void ArgumentOptionsSMC::usage(int status,char * programname){
   cerr << programname << " --model ur --intervals 100 --grid 100 --cpprior $(echo '1.0/1000.0' | bc -l) --essthreshold 0.3 --writeess --mean -a 2 -b 2 ur.txt 0 1000" << endl;
   cerr << endl;
 
+  cerr << "Example: Univariate regression of many series of the same length, one to a line" << endl;
+  cerr << programname << " --model ur --series --threads 4 --intervals 100 --grid 100 --cpprior $(echo '1.0/1000.0' | bc -l) --mean -a 2 -b 2 ur_series.txt 0 1000" << endl;
+  cerr << endl;
+
   cerr << "Example: Poisson regression  (first run the script simulate_poisson_regression.R)" << endl;
   cerr << programname << " --model ur --intervals 100 --grid 100 --cpprior $(echo '1.0/1000.0' | bc -l) --essthreshold 0.3 --writeess --mean -a .1 -b .1 ur.txt 0 1000" << endl;
   exit(status);
@@ -4,6 +4,7 @@
 #include <string>
 #include <stdlib.h>
 #include <iostream>
+#include "resampling.hpp"
 using namespace std;
 
 class ArgumentOptionsSMC{
@@ -31,15 +32,35 @@ class ArgumentOptionsSMC{
   double m_gamma_prior_2;
   int m_seed;
   bool m_calculate_filtering_mean;
+  bool m_intensity_bands;
+  bool m_adaptive_grid;
   int m_grid;
   bool m_write_cps_to_file;
   string m_model;
   double m_ESS_threshold;
   bool m_print_ESS;
+  Resampling_Type m_resampling_type;
+  bool m_resample_every_interval;
+  unsigned int m_num_threads;
+  bool m_foi_difference_arrays;
+  /*online mode: target per-interval latency in milliseconds and the least number of particles*/
+  double m_target_latency;
+  unsigned long int m_min_particles;
+  double m_history_horizon;
+  /*checkpoint file written every m_checkpoint_every intervals, and whether to resume from it*/
+  string m_checkpoint_file;
+  unsigned int m_checkpoint_every;
+  bool m_resume;
+  /*per interval timings and sample sizes, one JSON object per line*/
+  string m_telemetry_file;
   bool m_importance_sampling;
   bool m_rejection_sampling;
+  unsigned int m_rejection_block_size;
+  unsigned int m_rejection_envelope;
   bool m_spacing_prior;
   double m_v;
+  /*ur model: each line of the data file is a series of its own, all segmented in the one run*/
+  bool m_series;
   /*RJ paramters when sampling on the intervals over time*/
   int m_burnin;
   int m_thinning;
@@ -16,10 +16,23 @@ struct option ArgumentOptionsVast::lopts[] = {
     {"modelprior2", required_argument, NULL, 'b'},
     {"seed", required_argument, NULL, 's'},
     {"mean", no_argument, NULL, 'l'},
+    {"bands", no_argument, NULL, 'Q'},
+    {"adaptivegrid", no_argument, NULL, 'G'},
     {"grid", required_argument, NULL, 'g'},
     {"emptyintervals", no_argument, NULL, 'e'},
     {"essthreshold",required_argument,NULL,'f'},
     {"writeess",no_argument,NULL,'w'},
+    {"resampling",required_argument,NULL,'R'},
+    {"alwaysresample",no_argument,NULL,'E'},
+    {"threads",required_argument,NULL,'T'},
+    {"foidifferences",no_argument,NULL,'D'},
+    {"workers",required_argument,NULL,'W'},
+    {"checkpoint",required_argument,NULL,'C'},
+    {"checkpointevery",required_argument,NULL,'k'},
+    {"resume",no_argument,NULL,'u'},
+    {"telemetry",required_argument,NULL,'j'},
+    {"histograms",required_argument,NULL,'H'},
+    {"pvalues",required_argument,NULL,'O'},
     {"num_bins",required_argument,NULL,'B'},
     {"loss_function", required_argument, NULL, 'L'},
     {"min_iterations", required_argument, NULL, 'M'},
@@ -41,10 +54,23 @@ ArgumentOptionsVast::ArgumentOptionsVast(){
   srand (time(NULL));
   m_seed = rand() % 10000;
   m_calculate_filtering_mean = 1;
+  m_intensity_bands = 0;
+  m_adaptive_grid = 0;
   m_grid = 0;
   m_disallow_empty_intervals_between_cps = 0;
   m_ESS_threshold = 0.5;
   m_print_ESS = 0;
+  m_resampling_type = SYSTEMATIC;
+  m_resample_every_interval = 0;
+  m_num_threads = 1;
+  m_foi_difference_arrays = 0;
+  m_num_workers = 1;
+  m_checkpoint_file = "";
+  m_checkpoint_every = 1;
+  m_resume = 0;
+  m_telemetry_file = "";
+  m_histogram_file = "";
+  m_p_value_file = "";
   m_num_bins = 50;
   m_loss_type = AVERAGE;
   m_min_iterations = 500;
@@ -54,7 +80,7 @@ ArgumentOptionsVast::ArgumentOptionsVast(){
 
 void ArgumentOptionsVast::parse(int argc, char * argv[]){
 
-   const char *sopts="hi:p:d:t:m:n:a:b:s:lg:evwf:B:L:M:F";
+   const char *sopts="hi:p:d:t:m:n:a:b:s:lg:evwf:B:L:M:FR:ET:W:C:k:uj:H:DQGO:";
 
   //Parse arguments
   char opt;
@@ -90,6 +116,12 @@ void ArgumentOptionsVast::parse(int argc, char * argv[]){
     case 'l':
       m_calculate_filtering_mean = 1;
       break;
+    case 'Q':
+      m_intensity_bands = 1;
+      break;
+    case 'G':
+      m_adaptive_grid = 1;
+      break;
     case 'g':
       m_grid = stringtolong(optarg,opt);
       break;
@@ -99,6 +131,39 @@ void ArgumentOptionsVast::parse(int argc, char * argv[]){
     case 'w':
       m_print_ESS = 1;
       break;
+    case 'R':
+      m_resampling_type = Resampler::resampling_type_from_string(optarg);
+      break;
+    case 'E':
+      m_resample_every_interval = 1;
+      break;
+    case 'T':
+      m_num_threads = stringtolong(optarg,opt);
+      break;
+    case 'D':
+      m_foi_difference_arrays = 1;
+      break;
+    case 'W':
+      m_num_workers = stringtolong(optarg,opt);
+      break;
+    case 'C':
+      m_checkpoint_file = optarg;
+      break;
+    case 'k':
+      m_checkpoint_every = stringtolong(optarg,opt);
+      break;
+    case 'u':
+      m_resume = 1;
+      break;
+    case 'j':
+      m_telemetry_file = optarg;
+      break;
+    case 'H':
+      m_histogram_file = optarg;
+      break;
+    case 'O':
+      m_p_value_file = optarg;
+      break;
     case 'f':
       m_ESS_threshold = stringtodouble(optarg,opt);
       break;
@@ -141,6 +206,14 @@ void ArgumentOptionsVast::parse(int argc, char * argv[]){
     m_grid = m_num_intervals;
   }
   
+  if(m_checkpoint_every < 1){
+    m_checkpoint_every = 1;
+  }
+  if(m_resume && m_checkpoint_file.empty()){
+    cerr << "--resume needs a --checkpoint file" << endl;
+    usage(1,argv[0]);
+  }
+
   if(m_move_width == 0){
     double change_in_time = (m_end-m_start)/(double)m_num_intervals;
     m_move_width = change_in_time/3.0;
@@ -165,9 +238,38 @@ void ArgumentOptionsVast::usage(int status,char * programname){
   cerr << "-s | --seed              set the seed for generating random variables (default = current time)" << endl;
   cerr << "-l | --mean              calculate the filtering estimate of the mean over --grid," << endl;
   cerr << "                         no argument required (default = " << m_calculate_filtering_mean << ")" << endl;
+  cerr << "-Q | --bands             also write the 5%, 50% and 95% quantiles of the filtered intensity next to it," << endl;
+  cerr << "                         estimated as the particles stream through, no argument required (default = " << m_intensity_bands << ")" << endl;
   cerr << "-g | --grid              the number of grid points over which to calculate the mean" << endl;
   cerr << "                         must be a multiple of intervals (default = END)" << endl;
+  cerr << "-G | --adaptivegrid      place the --grid cells of each interval where the changepoints and the jumps in" << endl;
+  cerr << "                         the intensity of the particles are dense, rather than evenly; the intensity is" << endl;
+  cerr << "                         then written with the boundaries of each cell, no argument required (default = " << m_adaptive_grid << ")" << endl;
   cerr << "-w | --writeess          write ESS to file, no argument required (default = " << m_print_ESS << ")" << endl;
+  cerr << "-R | --resampling        resampling scheme: systematic, stratified, residual or multinomial" << endl;
+  cerr << "                         (default = " << Resampler::resampling_type_to_string(m_resampling_type) << ")" << endl;
+  cerr << "-E | --alwaysresample    resample every interval rather than only when the ESS of a process falls" << endl;
+  cerr << "                         below --essthreshold, no argument required (default = " << m_resample_every_interval << ")" << endl;
+  cerr << "-T | --threads           number of threads used to move the particles after resampling and to bin" << endl;
+  cerr << "                         the final sample for the JSD (default = " << m_num_threads << ")" << endl;
+  cerr << "-D | --foidifferences    add up the estimates over --grid with difference arrays over --threads," << endl;
+  cerr << "                         quicker for fine grids, the same estimates up to rounding (default = " << m_foi_difference_arrays << ")" << endl;
+  cerr << "-W | --workers           number of worker processes the individuals are split between, each worker" << endl;
+  cerr << "                         only loads its own individuals (default = " << m_num_workers << ")" << endl;
+  cerr << "-C | --checkpoint        write the complete sampler state to this file as the run goes on," << endl;
+  cerr << "                         with --workers one file for each worker, FILE.w<worker>" << endl;
+  cerr << "-k | --checkpointevery   number of intervals between checkpoints (default = " << m_checkpoint_every << ")" << endl;
+  cerr << "-u | --resume            carry on from the --checkpoint file if there is one, no argument required" << endl;
+  cerr << "-j | --telemetry         write the time taken by each stage, the sample sizes and the ESS of every" << endl;
+  cerr << "                         interval to this file as JSON lines" << endl;
+  cerr << "                         with --workers one file for each worker, FILE.w<worker>" << endl;
+  cerr << "-H | --histograms        write the histogram of the changepoints of the final sample of the first" << endl;
+  cerr << "                         individual to this file in binary, FILE.<run> if there are several runs," << endl;
+  cerr << "                         with --workers one file for each worker, FILE.w<worker>. The files of many" << endl;
+  cerr << "                         runs can be added together with mainMerge_histograms" << endl;
+  cerr << "-O | --pvalues           before sampling, write the sequential predictive p-value of the number of events" << endl;
+  cerr << "                         of every individual in every interval to this file as CSV, the individuals scored" << endl;
+  cerr << "                         over --threads, with --workers one file for each worker, FILE.w<worker>" << endl;
 
   cerr << endl;
 
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <iostream>
 #include "mc_divergence.hpp"
+#include "resampling.hpp"
 using namespace std;
 
 class ArgumentOptionsVast{
@@ -31,9 +32,26 @@ class ArgumentOptionsVast{
   double m_gamma_prior_2;
   int m_seed;
   bool m_calculate_filtering_mean;
+  bool m_intensity_bands;
+  bool m_adaptive_grid;
   int m_grid;
   double m_ESS_threshold;
   bool m_print_ESS;
+  Resampling_Type m_resampling_type;
+  bool m_resample_every_interval;
+  unsigned int m_num_threads;
+  bool m_foi_difference_arrays;
+  unsigned int m_num_workers;
+  /*checkpoint file written every m_checkpoint_every intervals, and whether to resume from it*/
+  string m_checkpoint_file;
+  unsigned int m_checkpoint_every;
+  bool m_resume;
+  /*per interval timings and sample sizes, one JSON object per line*/
+  string m_telemetry_file;
+  /*the histogram of the final sample of the first individual of each run, in binary*/
+  string m_histogram_file;
+  /*the sequential p-values of every individual in every interval, as CSV*/
+  string m_p_value_file;
   unsigned int m_num_bins;
   Loss_Function m_loss_type;
   unsigned int m_min_iterations;
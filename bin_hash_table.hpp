@@ -0,0 +1,162 @@
+#ifndef BIN_HASH_TABLE_HPP
+#define BIN_HASH_TABLE_HPP
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/*Counts or weights of the bins of a transdimensional histogram, keyed by the bin in each
+  dimension. Open addressing on a 64 bit hash of the bins and the dimension, with the keys
+  themselves held back to back in one pool so colliding hashes are told apart exactly.
+  Entries are numbered 0,...,size()-1 in the order they were first seen.*/
+template<class V>
+class Bin_Hash_Table{
+
+ public:
+  Bin_Hash_Table();
+  static unsigned long long int hash(const unsigned int * bin, unsigned int dim);
+  /*the value of the bin, added as V() if it is new, in which case inserted is set*/
+  V & find_or_insert(const unsigned int * bin, unsigned int dim, unsigned long long int h, bool & inserted);
+  V & find_or_insert(const vector<unsigned int> & bin, bool & inserted);
+  V & operator[](const vector<unsigned int> & bin);
+  /*NULL if the bin has not been seen*/
+  V * find(const unsigned int * bin, unsigned int dim);
+  unsigned long long int size() const { return m_entries.size(); }
+  void clear();
+  const unsigned int * key(unsigned long long int i) const { return m_key_pool.empty() ? NULL : &m_key_pool[0]+m_entries[i].key_start; }
+  unsigned int dim(unsigned long long int i) const { return m_entries[i].dim; }
+  unsigned long long int hash(unsigned long long int i) const { return m_entries[i].hash; }
+  vector<unsigned int> key_vector(unsigned long long int i) const { return vector<unsigned int>(key(i),key(i)+dim(i)); }
+  V & value(unsigned long long int i){ return m_entries[i].value; }
+  /*the entries in the order of their keys as vectors, shorter keys first on a common prefix*/
+  void sorted_order(vector<unsigned long long int> & order) const;
+
+ private:
+  struct Entry{
+    unsigned long long int hash;
+    unsigned long long int key_start;
+    unsigned int dim;
+    V value;
+  };
+  struct Key_Order;
+  vector<Entry> m_entries;
+  vector<unsigned int> m_key_pool;
+  vector<unsigned int> m_slots;//entry number plus one, 0 if empty; a power of two long
+  unsigned long long int m_mask;
+
+  bool matches(const Entry &, const unsigned int *, unsigned int, unsigned long long int) const;
+  void grow();
+};
+
+template<class V>
+struct Bin_Hash_Table<V>::Key_Order{
+  const Bin_Hash_Table<V> * table;
+  bool operator()(unsigned long long int i, unsigned long long int j) const {
+    return lexicographical_compare(table->key(i),table->key(i)+table->dim(i),table->key(j),table->key(j)+table->dim(j));
+  }
+};
+
+template<class V>
+Bin_Hash_Table<V>::Bin_Hash_Table()
+  :m_slots(16,0),m_mask(15)
+{
+}
+
+template<class V>
+unsigned long long int Bin_Hash_Table<V>::hash(const unsigned int * bin, unsigned int dim){
+  unsigned long long int h = 0xcbf29ce484222325ULL;
+  for(unsigned int k=0; k<dim; k++)
+    h = (h ^ bin[k]) * 0x100000001b3ULL;
+  h ^= dim;
+  h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+  h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+  return h ^ (h >> 33);
+}
+
+template<class V>
+bool Bin_Hash_Table<V>::matches(const Entry & e, const unsigned int * bin, unsigned int dim, unsigned long long int h) const{
+  return e.hash==h && e.dim==dim && equal(bin,bin+dim,m_key_pool.begin()+e.key_start);
+}
+
+template<class V>
+V & Bin_Hash_Table<V>::find_or_insert(const unsigned int * bin, unsigned int dim, unsigned long long int h, bool & inserted){
+  unsigned long long int s = h & m_mask;
+  while(m_slots[s]){
+    Entry & e = m_entries[m_slots[s]-1];
+    if(matches(e,bin,dim,h)){
+      inserted = false;
+      return e.value;
+    }
+    s = (s+1) & m_mask;
+  }
+  inserted = true;
+  Entry e;
+  e.hash = h;
+  e.key_start = m_key_pool.size();
+  e.dim = dim;
+  e.value = V();
+  m_key_pool.insert(m_key_pool.end(),bin,bin+dim);
+  m_entries.push_back(e);
+  m_slots[s] = m_entries.size();
+  //kept at most half full so the probes stay short
+  if(2*m_entries.size() > m_slots.size())
+    grow();
+  return m_entries.back().value;
+}
+
+template<class V>
+V & Bin_Hash_Table<V>::find_or_insert(const vector<unsigned int> & bin, bool & inserted){
+  const unsigned int * b = bin.empty() ? NULL : &bin[0];
+  return find_or_insert(b,bin.size(),hash(b,bin.size()),inserted);
+}
+
+template<class V>
+V & Bin_Hash_Table<V>::operator[](const vector<unsigned int> & bin){
+  bool inserted;
+  return find_or_insert(bin,inserted);
+}
+
+template<class V>
+V * Bin_Hash_Table<V>::find(const unsigned int * bin, unsigned int dim){
+  unsigned long long int h = hash(bin,dim);
+  unsigned long long int s = h & m_mask;
+  while(m_slots[s]){
+    Entry & e = m_entries[m_slots[s]-1];
+    if(matches(e,bin,dim,h))
+      return &e.value;
+    s = (s+1) & m_mask;
+  }
+  return NULL;
+}
+
+template<class V>
+void Bin_Hash_Table<V>::grow(){
+  m_slots.assign(2*m_slots.size(),0);
+  m_mask = m_slots.size()-1;
+  for(unsigned long long int i=0; i<m_entries.size(); i++){
+    unsigned long long int s = m_entries[i].hash & m_mask;
+    while(m_slots[s])
+      s = (s+1) & m_mask;
+    m_slots[s] = i+1;
+  }
+}
+
+template<class V>
+void Bin_Hash_Table<V>::clear(){
+  m_entries.clear();
+  m_key_pool.clear();
+  fill(m_slots.begin(),m_slots.end(),0);
+}
+
+template<class V>
+void Bin_Hash_Table<V>::sorted_order(vector<unsigned long long int> & order) const{
+  order.resize(m_entries.size());
+  for(unsigned long long int i=0; i<order.size(); i++)
+    order[i] = i;
+  Key_Order key_order;
+  key_order.table = this;
+  sort(order.begin(),order.end(),key_order);
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include "checkpoint.hpp"
+#include <stdio.h>
+#include <unistd.h>
+
+void checkpoint_write_rng(ostream & out, const gsl_rng * r){
+  unsigned long long int size = gsl_rng_size(r);
+  checkpoint_write(out,size);
+  checkpoint_write(out,(const char*)gsl_rng_state(r),size);
+}
+
+bool checkpoint_read_rng(istream & in, gsl_rng * r){
+  unsigned long long int size;
+  if(!checkpoint_read(in,size) || size!=gsl_rng_size(r))
+    return false;
+  return checkpoint_read(in,(char*)gsl_rng_state(r),size);
+}
+
+string checkpoint_generation(const string & file, unsigned int g){
+  if(g==0)
+    return file;
+  stringstream name;
+  name << file << '.' << g;
+  return name.str();
+}
+
+Checkpoint_Writer::Checkpoint_Writer(unsigned int generations)
+  :m_generations(generations>0 ? generations : 1),m_running(false),m_ok(true)
+{
+}
+
+Checkpoint_Writer::~Checkpoint_Writer(){
+  wait();
+}
+
+ostream & Checkpoint_Writer::begin(){
+  wait();
+  m_buffer.str("");
+  m_buffer.clear();
+  return m_buffer;
+}
+
+void Checkpoint_Writer::commit(const string & file){
+  wait();
+  m_contents = m_buffer.str();
+  m_buffer.str("");
+  m_file = file;
+  m_running = pthread_create(&m_thread,NULL,write_thread,(void*)this)==0;
+  //no thread to spare, write it here
+  if(!m_running){
+    m_ok = write_file();
+    string().swap(m_contents);
+  }
+}
+
+bool Checkpoint_Writer::wait(){
+  if(m_running){
+    pthread_join(m_thread,NULL);
+    m_running = false;
+  }
+  return m_ok;
+}
+
+void * Checkpoint_Writer::write_thread(void * arg){
+  Checkpoint_Writer * writer = (Checkpoint_Writer*)arg;
+  writer->m_ok = writer->write_file();
+  string().swap(writer->m_contents);
+  return NULL;
+}
+
+bool Checkpoint_Writer::write_file(){
+  string temporary = m_file + ".tmp";
+  FILE * f = fopen(temporary.c_str(),"wb");
+  if(!f){
+    cerr << "Checkpoint file " << temporary << " could not be opened" << endl;
+    return false;
+  }
+  bool ok = fwrite(m_contents.data(),1,m_contents.size(),f)==m_contents.size();
+  ok = fflush(f)==0 && ok;
+  ok = fsync(fileno(f))==0 && ok;
+  ok = fclose(f)==0 && ok;
+  if(!ok){
+    cerr << "Checkpoint file " << temporary << " could not be written" << endl;
+    remove(temporary.c_str());
+    return false;
+  }
+  for(unsigned int g=m_generations-1; g>0; g--)
+    rename(checkpoint_generation(m_file,g-1).c_str(),checkpoint_generation(m_file,g).c_str());
+  if(rename(temporary.c_str(),m_file.c_str())){
+    cerr << "Checkpoint file " << m_file << " could not be replaced" << endl;
+    return false;
+  }
+  return true;
+}
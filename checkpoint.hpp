@@ -0,0 +1,71 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+
+using namespace std;
+
+/*raw binary snapshots of sampler state, read back by the same build on the same machine*/
+template<class V>
+void checkpoint_write(ostream & out, const V * values, unsigned long long int n){
+  if(n>0)
+    out.write((const char*)values,n*sizeof(V));
+}
+
+template<class V>
+void checkpoint_write(ostream & out, const V & value){
+  out.write((const char*)&value,sizeof(V));
+}
+
+template<class V>
+bool checkpoint_read(istream & in, V * values, unsigned long long int n){
+  if(n>0)
+    in.read((char*)values,n*sizeof(V));
+  return !in.fail();
+}
+
+template<class V>
+bool checkpoint_read(istream & in, V & value){
+  in.read((char*)&value,sizeof(V));
+  return !in.fail();
+}
+
+void checkpoint_write_rng(ostream &, const gsl_rng *);
+bool checkpoint_read_rng(istream &, gsl_rng *);
+
+/*generation g of a checkpoint file: file itself for 0, then file.1, file.2, ...*/
+string checkpoint_generation(const string & file, unsigned int g);
+
+/*Writes checkpoints on a background thread so the sampler can carry on with the next
+  interval. The state is serialised into buffer() between begin() and commit(file);
+  begin() first waits for the previous write. Each file is written under a temporary
+  name and renamed into place, the older generations are kept as file.1, file.2, ...*/
+class Checkpoint_Writer{
+
+ public:
+  Checkpoint_Writer(unsigned int generations = 1);
+  ~Checkpoint_Writer();
+  ostream & begin();
+  ostream & buffer(){ return m_buffer; }
+  void commit(const string & file);
+  /*waits for the last write, false if it failed*/
+  bool wait();
+
+ private:
+  unsigned int m_generations;
+  ostringstream m_buffer;
+  string m_contents;
+  string m_file;
+  pthread_t m_thread;
+  bool m_running;
+  bool m_ok;
+
+  bool write_file();
+  static void * write_thread(void *);
+};
+
+#endif
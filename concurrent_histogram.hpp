@@ -0,0 +1,145 @@
+#ifndef CONCURRENT_HISTOGRAM_HPP
+#define CONCURRENT_HISTOGRAM_HPP
+
+#include <pthread.h>
+#include "histogram_type.hpp"
+
+/*A histogram split into shards, each a Histogram_Type<T> with the same bins, that can be
+  filled from several threads at once as long as no two threads write to the same shard.
+  Nothing is locked while the shards are filled; reduce() then adds them into one histogram,
+  always in shard order, so the result does not depend on how many threads did the work.
+
+  The shards keep no divergence and no autocorrelation estimate, neither of which can be
+  merged. As with add_histogram(), the histogram reduced into keeps its own divergence and
+  works its entropy out again from the merged bins.*/
+template<class T>
+class Concurrent_Histogram{
+
+ public:
+  Concurrent_Histogram(double start, double end, unsigned int num_bins, double bin_width, bool bounded, bool weighted, bool one_d, unsigned int max_dim, unsigned int num_shards);
+  ~Concurrent_Histogram();
+  unsigned int get_num_shards(){ return m_num_shards; }
+  Histogram_Type<T>* get_shard(unsigned int s){ return m_shards[s]; }
+  void set_value_function(double (T::*get_component_value)() const);
+  void use_single_component(unsigned short int option = 1);
+  /*bins particles[0,...,n-1], the i-th with weight weights[i]*weight_scale (1 if weights is NULL),
+    splitting them into one contiguous block per shard*/
+  void bin_particles(Particle<T>** particles, const double* weights, unsigned long long int n, double weight_scale, unsigned int num_threads);
+  /*adds all the shards into h and empties them*/
+  void reduce(Histogram* h);
+  void reset();
+
+ private:
+  struct Shard_Worker;
+  unsigned int m_num_shards;
+  Histogram_Type<T>** m_shards;
+
+  static void * shard_thread(void *);
+};
+
+template<class T>
+struct Concurrent_Histogram<T>::Shard_Worker{
+  Concurrent_Histogram<T> * histogram;
+  Particle<T> ** particles;
+  const double * weights;
+  unsigned long long int n;
+  double weight_scale;
+  unsigned int * next_shard;
+  pthread_mutex_t * lock;
+};
+
+template<class T>
+Concurrent_Histogram<T>::Concurrent_Histogram(double start, double end, unsigned int num_bins, double bin_width, bool bounded, bool weighted, bool one_d, unsigned int max_dim, unsigned int num_shards){
+  m_num_shards = num_shards>0 ? num_shards : 1;
+  m_shards = new Histogram_Type<T>*[m_num_shards];
+  for(unsigned int s=0; s<m_num_shards; s++)
+    m_shards[s] = new Histogram_Type<T>(start,end,num_bins,bin_width,bounded,weighted,one_d,max_dim,NULL,false,BIAS,MINIMAX,0,false);
+}
+
+template<class T>
+Concurrent_Histogram<T>::~Concurrent_Histogram(){
+  for(unsigned int s=0; s<m_num_shards; s++)
+    delete m_shards[s];
+  delete [] m_shards;
+}
+
+template<class T>
+void Concurrent_Histogram<T>::set_value_function(double (T::*get_component_value)() const){
+  for(unsigned int s=0; s<m_num_shards; s++)
+    m_shards[s]->set_value_function(get_component_value);
+}
+
+template<class T>
+void Concurrent_Histogram<T>::use_single_component(unsigned short int option){
+  for(unsigned int s=0; s<m_num_shards; s++)
+    m_shards[s]->use_single_component(option);
+}
+
+template<class T>
+void * Concurrent_Histogram<T>::shard_thread(void * arg){
+  Shard_Worker * worker = (Shard_Worker*)arg;
+  unsigned int num_shards = worker->histogram->m_num_shards;
+  unsigned int s;
+  while(true){
+    pthread_mutex_lock(worker->lock);
+    s = (*worker->next_shard)++;
+    pthread_mutex_unlock(worker->lock);
+    if(s >= num_shards)
+      break;
+    Histogram_Type<T> * shard = worker->histogram->m_shards[s];
+    unsigned long long int first = (worker->n*s)/num_shards;
+    unsigned long long int last = (worker->n*(s+1))/num_shards;
+    for(unsigned long long int i=first; i<last; i++){
+      shard->calculate_bin(worker->particles[i],worker->particles[i]->get_dim_theta());
+      shard->increment_bin_counts(NULL,worker->weights ? worker->weights[i]*worker->weight_scale : 1);
+    }
+  }
+  return NULL;
+}
+
+template<class T>
+void Concurrent_Histogram<T>::bin_particles(Particle<T>** particles, const double* weights, unsigned long long int n, double weight_scale, unsigned int num_threads){
+  if(num_threads > m_num_shards)
+    num_threads = m_num_shards;
+  if(num_threads < 1)
+    num_threads = 1;
+  unsigned int next_shard = 0;
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock,NULL);
+  Shard_Worker worker;
+  worker.histogram = this;
+  worker.particles = particles;
+  worker.weights = weights;
+  worker.n = n;
+  worker.weight_scale = weight_scale;
+  worker.next_shard = &next_shard;
+  worker.lock = &lock;
+  //any shards left by a thread which could not be started are picked up by the others
+  pthread_t * threads = new pthread_t[num_threads];
+  bool * started = new bool[num_threads];
+  for(unsigned int t=1; t<num_threads; t++)
+    started[t] = pthread_create(&threads[t],NULL,shard_thread,(void*)&worker)==0;
+  shard_thread((void*)&worker);
+  for(unsigned int t=1; t<num_threads; t++)
+    if(started[t])
+      pthread_join(threads[t],NULL);
+  pthread_mutex_destroy(&lock);
+  delete [] started;
+  delete [] threads;
+}
+
+template<class T>
+void Concurrent_Histogram<T>::reduce(Histogram* h){
+  for(unsigned int s=0; s<m_num_shards; s++){
+    h->add_histogram(m_shards[s]);
+    m_shards[s]->reset();
+  }
+}
+
+template<class T>
+void Concurrent_Histogram<T>::reset(){
+  for(unsigned int s=0; s<m_num_shards; s++)
+    m_shards[s]->reset();
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include "divergence_exchange.hpp"
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+struct Exchange_Report{
+  unsigned long long int iterations;
+  double max_divergence;
+};
+
+struct Exchange_Grant{
+  unsigned long long int allowance;
+  double threshold;
+  int ties_win;
+};
+
+static bool read_full(int fd, void * buf, size_t n){
+  char * p = (char*)buf;
+  while(n>0){
+    ssize_t r = read(fd,p,n);
+    if(r<0 && errno==EINTR)
+      continue;
+    if(r<=0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const void * buf, size_t n){
+  const char * p = (const char*)buf;
+  while(n>0){
+    ssize_t r = write(fd,p,n);
+    if(r<0 && errno==EINTR)
+      continue;
+    if(r<=0)
+      return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+Socket_Divergence_Exchange::~Socket_Divergence_Exchange(){
+  close(m_fd);
+}
+
+void Socket_Divergence_Exchange::report(unsigned long long int iterations, double max_divergence){
+  Exchange_Report r;
+  r.iterations = iterations;
+  r.max_divergence = max_divergence;
+  if(!write_full(m_fd,&r,sizeof(r))){
+    cerr << "divergence_exchange.cpp: lost the connection to the coordinator" << endl;
+    exit(1);
+  }
+}
+
+unsigned long long int Socket_Divergence_Exchange::grant(double & threshold, bool & ties_win){
+  Exchange_Grant g;
+  if(!read_full(m_fd,&g,sizeof(g))){
+    cerr << "divergence_exchange.cpp: lost the connection to the coordinator" << endl;
+    exit(1);
+  }
+  threshold = g.threshold;
+  ties_win = g.ties_win;
+  return g.allowance;
+}
+
+/*the worker holding the largest divergence runs until it no longer does, so the
+  iterations go to the same processes as a single sampler over all of them would choose,
+  ties going to the lower process index*/
+bool share_out_iterations(int * fds, unsigned int num_workers, unsigned int num_intervals, unsigned long long int budget){
+  double * max_divergence = new double[num_workers];
+  Exchange_Report r;
+  Exchange_Grant g;
+  bool ok = true;
+  for(unsigned int i=0; i<num_intervals && ok; i++){
+    unsigned long long int total = 0;
+    for(unsigned int w=0; w<num_workers && ok; w++){
+      ok = read_full(fds[w],&r,sizeof(r));
+      if(!ok)
+	break;
+      total += r.iterations;
+      max_divergence[w] = r.max_divergence;
+    }
+    while(ok && total<budget){
+      unsigned int best = 0;
+      for(unsigned int w=1; w<num_workers; w++){
+	if(max_divergence[w] > max_divergence[best])
+	  best = w;
+      }
+      if(max_divergence[best] == -HUGE_VAL)
+	break;
+      unsigned int owner = num_workers;
+      g.threshold = -HUGE_VAL;
+      for(unsigned int w=0; w<num_workers; w++){
+	if(w != best && (owner == num_workers || max_divergence[w] > g.threshold)){
+	  g.threshold = max_divergence[w];
+	  owner = w;
+	}
+      }
+      g.allowance = budget-total;
+      g.ties_win = best < owner;
+      ok = write_full(fds[best],&g,sizeof(g)) && read_full(fds[best],&r,sizeof(r));
+      if(!ok)
+	break;
+      total += r.iterations;
+      max_divergence[best] = r.max_divergence;
+      if(!r.iterations)
+	break;
+    }
+    g.allowance = 0;
+    for(unsigned int w=0; w<num_workers && ok; w++)
+      ok = write_full(fds[w],&g,sizeof(g));
+  }
+  delete [] max_divergence;
+  return ok;
+}
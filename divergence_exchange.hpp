@@ -0,0 +1,42 @@
+#ifndef DIVERGENCE_EXCHANGE_HPP
+#define DIVERGENCE_EXCHANGE_HPP
+
+#include <stdlib.h>
+#include <iostream>
+
+using namespace std;
+
+/*When the data processes are split over several SMC_PP_MCMC objects (eg one per worker
+  process), the variable sample size iterations of an interval are still shared out
+  greedily to the process with the largest divergence over all of them. Each sampler
+  reports how many iterations it has run and its largest divergence, and is granted a
+  number of iterations it may run while its largest divergence stays above a threshold,
+  the largest divergence held elsewhere. A grant of 0 ends the interval.*/
+class Divergence_Exchange{
+
+ public:
+  virtual ~Divergence_Exchange(){}
+  virtual void report(unsigned long long int iterations, double max_divergence) = 0;
+  /*ties_win is true if the sampler should keep going when its divergence equals the threshold*/
+  virtual unsigned long long int grant(double & threshold, bool & ties_win) = 0;
+};
+
+/*worker side of an exchange over a connected stream socket, eg one end of a socketpair*/
+class Socket_Divergence_Exchange : public Divergence_Exchange{
+
+ public:
+  Socket_Divergence_Exchange(int fd):m_fd(fd){}
+  ~Socket_Divergence_Exchange();
+  void report(unsigned long long int iterations, double max_divergence);
+  unsigned long long int grant(double & threshold, bool & ties_win);
+
+ private:
+  int m_fd;
+};
+
+/*coordinator side: serves the reports of num_workers workers, one socket each, for
+  num_intervals intervals with a total of budget iterations per interval. Returns false
+  if a worker goes away.*/
+bool share_out_iterations(int * fds, unsigned int num_workers, unsigned int num_intervals, unsigned long long int budget);
+
+#endif
@@ -1,11 +1,54 @@
 
 #include "function_of_interest.hpp"
+#include "checkpoint.hpp"
+#include <pthread.h>
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+//the particles are split into this many blocks whatever the number of threads, so that the
+//estimates are always added up in the same order
+static const unsigned int FOI_DIFFERENCE_BLOCKS = 16;
+
+/*The range updates of a block of particles to the cells lo,...,fe-1 of the grid, as differences
+  between neighbouring cells. With t the time of a cell less that of cell lo, the time since the
+  last changepoint on a segment is g = t + u until it is capped at delta, so the sums over
+  particles of w*g and w*g*g/sum_weights are t*linear + constant and t*t*square + t*cross + offset*/
+struct Function_of_Interest::Difference_Block{
+  vector<long double> intensity;
+  vector<long double> linear, constant;
+  vector<long double> square, cross, offset;
+  vector<long double> prob;
+  long double average_distance;
+  double min_distance;
+};
+
+struct Function_of_Interest::Difference_Worker{
+  Function_of_Interest * foi;
+  Difference_Block * blocks;
+  Particle<changepoint> ** sample;
+  double * weights;
+  double sum_weights;
+  double begin;
+  long long int first, last;
+  int lo, fb, fe;
+  unsigned int * next_block;
+  pthread_mutex_t * lock;
+};
 
 Function_of_Interest::Function_of_Interest(int grid,double start, double end, double prior_term, bool g, bool prob, bool intensity, bool online, bool sequential,int intervals,bool instant, double delta )
 :m_grid(grid),m_start(start),m_end(end),m_prior(prior_term),m_calculate_g(g),m_calculate_prob(prob),m_calculate_intensity(intensity),m_online(online),m_update(sequential),m_instantaneous(instant),m_delta(delta)
 {
 
   m_coal_importance_sampling = 0;
+  m_difference_arrays = false;
+  m_num_threads = 1;
+  m_intensity_bands = NULL;
+  m_boundaries = NULL;
+  m_cells_placed = 0;
+  m_adaptive_resolution = 16;
+  m_adaptive_uniform_share = 0.25;
+  m_intervals = intervals;
    m_prior_expectation_function_of_interest=NULL;
    m_prior_sd_function_of_interest=NULL;
    m_exp_last_changepoint_sequential=NULL;
@@ -172,6 +215,190 @@ Function_of_Interest::~Function_of_Interest(){
  
   delete [] m_prior_expectation_function_of_interest;
   delete [] m_prior_sd_function_of_interest;
+  delete m_intensity_bands;
+  delete [] m_boundaries;
+}
+
+void Function_of_Interest::use_adaptive_grid(unsigned int resolution, double uniform_share){
+  if(m_calculate_g || m_calculate_prob || m_cont){
+    cerr << "Error: an adaptive grid is only for the intensity" << endl;
+    exit(1);
+  }
+  if(!(uniform_share > 0 && uniform_share <= 1)){
+    cerr << "Error: the uniform share of an adaptive grid must be in (0,1]" << endl;
+    exit(1);
+  }
+  m_adaptive_resolution = resolution>0 ? resolution : 1;
+  m_adaptive_uniform_share = uniform_share;
+  //the cells not yet placed stay uniform
+  delete [] m_boundaries;
+  m_boundaries = new double[m_grid+1];
+  for(int i=0; i<=m_grid; i++)
+    m_boundaries[i] = m_start + (m_end-m_start)*(i/(double)m_grid);
+  m_cells_placed = 0;
+}
+
+//the number of grid cells which end at or before t
+int Function_of_Interest::cells_ending_by(double t) const{
+  if(!m_boundaries)
+    return static_cast<int>(floor((10000*t)/(10000*m_grid_points)));
+  return upper_bound(m_boundaries+1,m_boundaries+m_grid+1,t)-(m_boundaries+1);
+}
+
+double Function_of_Interest::cell_end(int k) const{
+  return m_boundaries ? m_boundaries[k+1] : m_grid_points*(k+1);
+}
+
+//the first end of a grid cell at or after t
+double Function_of_Interest::first_cell_end_from(double t) const{
+  if(!m_boundaries)
+    return ceil((10000*t)/(10000*m_grid_points))*m_grid_points;
+  const double * b = lower_bound(m_boundaries,m_boundaries+m_grid+1,t);
+  return b<m_boundaries+m_grid+1 ? *b : m_boundaries[m_grid];
+}
+
+/*places this interval's share of the cells, from the last one placed up to end_time, by
+  equidistributing a density over fine bins: a uniform part, the changepoints of the particles
+  and the size of the jumps in their intensity, each weighted by the particle weights*/
+void Function_of_Interest::place_cells(double end_time, Particle<changepoint> ** sample, long long int sample_size, double * weights){
+  double from = m_boundaries[m_cells_placed];
+  if(m_cells_placed>=m_grid || end_time<=from)
+    return;
+  int last = end_time>=m_end ? m_grid : static_cast<int>(floor(m_grid*((end_time-m_start)/(m_end-m_start))+0.5));
+  if(last>m_grid)
+    last = m_grid;
+  if(last<=m_cells_placed)
+    last = m_cells_placed+1;
+  int cells = last-m_cells_placed;
+
+  unsigned int bins = cells*m_adaptive_resolution;
+  double width = (end_time-from)/bins;
+  vector<double> changepoints(bins,0), jumps(bins,0);
+  double sum_changepoints = 0, sum_jumps = 0;
+  for(long long int i=m_start_of_sample; i<sample_size; i++){
+    int dim = sample[i]->get_dim_theta();
+    for(int j=dim-1; j>=0; j--){
+      double cp = sample[i]->get_theta_component(j)->getchangepoint();
+      if(cp<=from)
+	break;
+      if(cp>end_time)
+	continue;
+      unsigned int b = static_cast<unsigned int>((cp-from)/width);
+      if(b>=bins)
+	b = bins-1;
+      double jump = fabs(sample[i]->get_theta_component(j)->getmeanvalue()-sample[i]->get_theta_component(j-1)->getmeanvalue());
+      changepoints[b] += weights[i];
+      jumps[b] += weights[i]*jump;
+      sum_changepoints += weights[i];
+      sum_jumps += weights[i]*jump;
+    }
+  }
+
+  double uniform_share = m_adaptive_uniform_share;
+  double changepoint_share = (1-uniform_share)*(sum_jumps>0 ? 0.5 : 1);
+  double jump_share = sum_jumps>0 ? (1-uniform_share)*0.5 : 0;
+  if(!(sum_changepoints>0)){
+    uniform_share = 1;
+    changepoint_share = jump_share = 0;
+  }
+
+  //every bin has some density, so the boundaries increase strictly
+  int k = m_cells_placed+1;
+  double cumulative = 0;
+  for(unsigned int b=0; b<bins && k<last; b++){
+    double density = uniform_share/bins;
+    if(changepoint_share>0)
+      density += changepoint_share*changepoints[b]/sum_changepoints;
+    if(jump_share>0)
+      density += jump_share*jumps[b]/sum_jumps;
+    while(k<last && cumulative+density>=(k-m_cells_placed)/(double)cells){
+      m_boundaries[k] = from + width*(b+((k-m_cells_placed)/(double)cells-cumulative)/density);
+      k++;
+    }
+    cumulative += density;
+  }
+  //only rounding can leave any, which then go at the end
+  for(; k<last; k++)
+    m_boundaries[k] = from + (end_time-from)*((k-m_cells_placed)/(double)cells);
+  m_boundaries[last] = end_time;
+  m_cells_placed = last;
+}
+
+void Function_of_Interest::calculate_intensity_bands(double lower, double upper){
+  vector<double> probabilities;
+  probabilities.push_back(lower);
+  probabilities.push_back(0.5);
+  probabilities.push_back(upper);
+  delete m_intensity_bands;
+  m_intensity_bands = new Quantile_Sketch(m_grid,probabilities);
+}
+
+void Function_of_Interest::write_state(ostream & out) const{
+  checkpoint_write(out,m_grid);
+  checkpoint_write(out,m_intervals);
+  if(m_calculate_g){
+    if(m_online || m_fixed){
+      checkpoint_write(out,m_exp_last_changepoint,m_grid);
+      checkpoint_write(out,m_variance_exp_last_changepoint,m_grid);
+    }
+    if(m_update)
+      checkpoint_write(out,m_exp_last_changepoint_sequential[0],(unsigned long long int)m_grid*m_intervals);
+  }
+  if(m_calculate_prob){
+    if(m_online || m_fixed)
+      checkpoint_write(out,m_prob_function_of_interest,m_grid);
+    if(m_update)
+      checkpoint_write(out,m_prob_last_changepoint_sequential[0],(unsigned long long int)m_grid*m_intervals);
+  }
+  if(m_calculate_intensity)
+    checkpoint_write(out,m_intensity,m_grid);
+  if(m_intensity_bands)
+    m_intensity_bands->write_state(out);
+  if(m_boundaries){
+    checkpoint_write(out,m_boundaries,m_grid+1);
+    checkpoint_write(out,m_cells_placed);
+  }
+  checkpoint_write(out,m_average_distance);
+  checkpoint_write(out,m_min_distance);
+  checkpoint_write(out,m_average_distance_squared);
+  checkpoint_write(out,m_variance_distance);
+  checkpoint_write(out,m_start_of_sample);
+  checkpoint_write(out,m_sample_size);
+}
+
+bool Function_of_Interest::read_state(istream & in){
+  int grid, intervals;
+  if(!checkpoint_read(in,grid) || !checkpoint_read(in,intervals) || grid!=m_grid || intervals!=m_intervals)
+    return false;
+  bool ok = true;
+  if(m_calculate_g){
+    if(m_online || m_fixed){
+      ok = ok && checkpoint_read(in,m_exp_last_changepoint,m_grid);
+      ok = ok && checkpoint_read(in,m_variance_exp_last_changepoint,m_grid);
+    }
+    if(m_update)
+      ok = ok && checkpoint_read(in,m_exp_last_changepoint_sequential[0],(unsigned long long int)m_grid*m_intervals);
+  }
+  if(m_calculate_prob){
+    if(m_online || m_fixed)
+      ok = ok && checkpoint_read(in,m_prob_function_of_interest,m_grid);
+    if(m_update)
+      ok = ok && checkpoint_read(in,m_prob_last_changepoint_sequential[0],(unsigned long long int)m_grid*m_intervals);
+  }
+  if(m_calculate_intensity)
+    ok = ok && checkpoint_read(in,m_intensity,m_grid);
+  if(m_intensity_bands)
+    ok = ok && m_intensity_bands->read_state(in);
+  if(m_boundaries){
+    ok = ok && checkpoint_read(in,m_boundaries,m_grid+1);
+    ok = ok && checkpoint_read(in,m_cells_placed);
+  }
+  ok = ok && checkpoint_read(in,m_average_distance);
+  ok = ok && checkpoint_read(in,m_min_distance);
+  ok = ok && checkpoint_read(in,m_average_distance_squared);
+  ok = ok && checkpoint_read(in,m_variance_distance);
+  ok = ok && checkpoint_read(in,m_start_of_sample);
+  return ok && checkpoint_read(in,m_sample_size);
 }
 
 void Function_of_Interest::reset_prob(){
@@ -186,6 +413,8 @@ void Function_of_Interest::reset_prob(){
       m_intensity[i]=0;
 
   }
+  if(m_intensity_bands)
+    m_intensity_bands->reset();
 
   /*for(int i=0; i<m_grid; i++){
   m_prob_function_of_interest[i]*=m_sample_size;
@@ -289,13 +518,19 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
     end_changepoint = new changepoint(interval_end,0,0,0);
   }
   
-  int fb=static_cast<int>(floor((10000*(double)interval_begin)/(10000*(double)m_grid_points)));
-  int fe =static_cast<int>(floor((10000*(double)interval_end)/(10000*(double)m_grid_points)));
+  if(m_boundaries)
+    place_cells(interval_end,sample,sample_size,weights);
 
-  
-  for (int i=m_start_of_sample; i<sample_size; i++){
+  int fb=cells_ending_by(interval_begin);
+  int fe=cells_ending_by(interval_end);
+
+  bool by_differences = m_difference_arrays && !m_cont && !m_boundaries && !(m_calculate_intensity && m_intensity_bands) && !(m_calculate_intensity && pm && !pm->constant_mean_function());
+  if(by_differences)
+    calculate_function_by_differences(begin,sample,sample_size,weights,sum_weights,iters,cells_ending_by(begin),fb,fe);
 
-    loc_index_1=static_cast<int>(floor((10000*begin)/(10000*m_grid_points)));
+  for (int i=by_differences ? sample_size : m_start_of_sample; i<sample_size; i++){
+
+    loc_index_1=cells_ending_by(begin);
    
     dim = sample[i]->get_dim_theta();
     
@@ -307,7 +542,7 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
       for (int j=0; j<dim; j++){
 	cpobj = sample[i]->get_theta_component(j);
 
-	if(cpobj->getchangepoint()>(ceil((10000*begin)/(10000*m_grid_points))*m_grid_points)){
+	if(cpobj->getchangepoint()>first_cell_end_from(begin)){
 	  ind=1;
 	  start_index=j-1;
 	  break;
@@ -325,7 +560,7 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
       }
       else{
 	cpobj = sample[i]->get_theta_component(j+1);
-	loc_index_2 = static_cast<int>(floor((10000*((double)cpobj->getchangepoint()))/(10000*(double)m_grid_points)));
+	loc_index_2 = cells_ending_by(cpobj->getchangepoint());
       }
 
       
@@ -343,10 +578,10 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
 
       for (int k=loc_index_1; k<loc_index_2; k++){
 	
-	g= (m_grid_points*(k+1) - cpobj->getchangepoint());
+	g= (cell_end(k) - cpobj->getchangepoint());
 	
 	if(m_cont){
-	  g1=cpobj1->getchangepoint()-(m_grid_points*(k+1));
+	  g1=cpobj1->getchangepoint()-cell_end(k);
 	}
 
 	
@@ -361,7 +596,10 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
 	if(m_calculate_intensity && k>=fb){
 	  double e;
 	  pm?e = pm->get_mean_function(g):e=1;
-	  m_intensity[k] += cpobj->getmeanvalue()*e*weights[i];
+	  double intensity = cpobj->getmeanvalue()*e;
+	  m_intensity[k] += intensity*weights[i];
+	  if(m_intensity_bands)
+	    m_intensity_bands->add(k,intensity,weights[i]);
    	}
 	
 	if(m_instantaneous){
@@ -406,7 +644,7 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
   }
 
  
-  loc_index_1=(int)floor((10000*begin)/(10000*m_grid_points));
+  loc_index_1=cells_ending_by(begin);
       
   loc_index_2=fe;
 
@@ -436,6 +674,230 @@ void Function_of_Interest::calculate_function(double interval_begin, double inte
  
 }
 
+long double Function_of_Interest::capped_g(int k, double changepoint_position) const{
+  long double g = (m_grid_points*(k+1) - changepoint_position);
+  if(m_instantaneous && g>m_delta)
+    g=m_delta;
+  return g;
+}
+
+//the same cells and terms as the loop over k in calculate_function, as range updates
+void Function_of_Interest::add_particle_differences(Difference_Block & block, Particle<changepoint> * particle, double weight, double sum_weights, double begin, int lo, int fb, int fe) const{
+  int dim = particle->get_dim_theta();
+  int start_index = -1;
+  double first_cell_end = ceil((10000*begin)/(10000*m_grid_points))*m_grid_points;
+  for (int j=0; j<dim; j++){
+    if(particle->get_theta_component(j)->getchangepoint()>first_cell_end){
+      start_index=j-1;
+      break;
+    }
+    if(j==(dim-1))
+      start_index=dim-1;
+  }
+
+  double cell_lo = m_grid_points*(lo+1);
+  double scaled_weight = weight/sum_weights;
+  int loc_index_1 = lo;
+  for (int j=start_index; j<dim; j++){
+    int loc_index_2 = fe;
+    //no changepoints are sampled after the end of the interval, so the cells stop at fe
+    if(j<(dim-1))
+      loc_index_2 = min(fe,static_cast<int>(floor((10000*((double)particle->get_theta_component(j+1)->getchangepoint()))/(10000*(double)m_grid_points))));
+    if(loc_index_1>=loc_index_2)
+      continue;
+    int a = loc_index_1, b = loc_index_2;
+    loc_index_1 = loc_index_2;
+    changepoint * cpobj = particle->get_theta_component(j);
+    double cp = cpobj->getchangepoint();
+
+    if(m_online && a<=fe-1 && fe-1<b){
+      long double g = (m_grid_points*fe - cp);
+      block.average_distance += g*scaled_weight;
+      if (cp < block.min_distance && weight > 0)
+	block.min_distance = cp;
+    }
+
+    if(m_calculate_intensity && max(a,fb)<b){
+      long double intensity = cpobj->getmeanvalue()*weight;
+      block.intensity[max(a,fb)-lo] += intensity;
+      block.intensity[b-lo] -= intensity;
+    }
+
+    //g grows with k, the first cell where it is capped
+    int capped = b;
+    if(m_instantaneous){
+      int l = a;
+      while(l<capped){
+	int mid = l+(capped-l)/2;
+	if((long double)(m_grid_points*(mid+1) - cp)>m_delta)
+	  capped = mid;
+	else
+	  l = mid+1;
+      }
+    }
+
+    if(m_calculate_g){
+      long double u = cell_lo - (long double)cp;
+      if(a<capped){
+	block.linear[a-lo] += weight;
+	block.linear[capped-lo] -= weight;
+	block.constant[a-lo] += weight*u;
+	block.constant[capped-lo] -= weight*u;
+	block.square[a-lo] += scaled_weight;
+	block.square[capped-lo] -= scaled_weight;
+	block.cross[a-lo] += 2*scaled_weight*u;
+	block.cross[capped-lo] -= 2*scaled_weight*u;
+	block.offset[a-lo] += scaled_weight*u*u;
+	block.offset[capped-lo] -= scaled_weight*u*u;
+      }
+      if(capped<b){
+	block.constant[capped-lo] += weight*m_delta;
+	block.constant[b-lo] -= weight*m_delta;
+	block.offset[capped-lo] += scaled_weight*m_delta*m_delta;
+	block.offset[b-lo] -= scaled_weight*m_delta*m_delta;
+      }
+    }
+
+    if(m_calculate_prob){
+      /*the prior expectation grows no faster than g, so g is below it on the first cells before
+	the cap and, as it flattens out towards its limit, on the last cells after the cap*/
+      int l = a, below = capped;
+      while(l<below){
+	int mid = l+(below-l)/2;
+	if((capped_g(mid,cp)-m_prior_expectation_function_of_interest[mid])<0)
+	  l = mid+1;
+	else
+	  below = mid;
+      }
+      if(a<below){
+	block.prob[a-lo] += weight;
+	block.prob[below-lo] -= weight;
+      }
+      l = capped;
+      below = b;
+      while(l<below){
+	int mid = l+(below-l)/2;
+	if((capped_g(mid,cp)-m_prior_expectation_function_of_interest[mid])<0)
+	  below = mid;
+	else
+	  l = mid+1;
+      }
+      if(below<b){
+	block.prob[below-lo] += weight;
+	block.prob[b-lo] -= weight;
+      }
+    }
+  }
+}
+
+void * Function_of_Interest::difference_thread(void * arg){
+  Difference_Worker * worker = (Difference_Worker*)arg;
+  unsigned int b;
+  while(true){
+    pthread_mutex_lock(worker->lock);
+    b = (*worker->next_block)++;
+    pthread_mutex_unlock(worker->lock);
+    if(b>=FOI_DIFFERENCE_BLOCKS)
+      break;
+    Difference_Block & block = worker->blocks[b];
+    unsigned int cells = worker->fe-worker->lo+1;
+    block.intensity.assign(worker->foi->m_calculate_intensity ? cells : 0,0);
+    block.linear.assign(worker->foi->m_calculate_g ? cells : 0,0);
+    block.constant.assign(worker->foi->m_calculate_g ? cells : 0,0);
+    block.square.assign(worker->foi->m_calculate_g ? cells : 0,0);
+    block.cross.assign(worker->foi->m_calculate_g ? cells : 0,0);
+    block.offset.assign(worker->foi->m_calculate_g ? cells : 0,0);
+    block.prob.assign(worker->foi->m_calculate_prob ? cells : 0,0);
+    block.average_distance = 0;
+    block.min_distance = DBL_MAX;
+    long long int n = worker->last-worker->first;
+    long long int first = worker->first+(n*b)/FOI_DIFFERENCE_BLOCKS;
+    long long int last = worker->first+(n*(b+1))/FOI_DIFFERENCE_BLOCKS;
+    for(long long int i=first; i<last; i++)
+      worker->foi->add_particle_differences(block,worker->sample[i],worker->weights[i],worker->sum_weights,worker->begin,worker->lo,worker->fb,worker->fe);
+  }
+  return NULL;
+}
+
+void Function_of_Interest::calculate_function_by_differences(double begin, Particle<changepoint> ** sample, long long int sample_size, double * weights, double sum_weights, int iters, int lo, int fb, int fe){
+  if(lo>=fe)
+    return;
+  Difference_Block * blocks = new Difference_Block[FOI_DIFFERENCE_BLOCKS];
+  unsigned int next_block = 0;
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock,NULL);
+  Difference_Worker worker;
+  worker.foi = this;
+  worker.blocks = blocks;
+  worker.sample = sample;
+  worker.weights = weights;
+  worker.sum_weights = sum_weights;
+  worker.begin = begin;
+  worker.first = m_start_of_sample;
+  worker.last = sample_size > m_start_of_sample ? sample_size : m_start_of_sample;
+  worker.lo = lo;
+  worker.fb = fb;
+  worker.fe = fe;
+  worker.next_block = &next_block;
+  worker.lock = &lock;
+  unsigned int num_threads = m_num_threads < FOI_DIFFERENCE_BLOCKS ? m_num_threads : FOI_DIFFERENCE_BLOCKS;
+  //any blocks left by a thread which could not be started are picked up by the others
+  pthread_t * threads = new pthread_t[num_threads];
+  bool * started = new bool[num_threads];
+  for(unsigned int t=1; t<num_threads; t++)
+    started[t] = pthread_create(&threads[t],NULL,difference_thread,(void*)&worker)==0;
+  difference_thread((void*)&worker);
+  for(unsigned int t=1; t<num_threads; t++)
+    if(started[t])
+      pthread_join(threads[t],NULL);
+  pthread_mutex_destroy(&lock);
+  delete [] started;
+  delete [] threads;
+
+  //the blocks are added in order, then the differences summed along the grid
+  long double intensity=0, linear=0, constant=0, square=0, cross=0, offset=0, prob=0;
+  double cell_lo = m_grid_points*(lo+1);
+  for(int k=lo; k<fe; k++){
+    int d = k-lo;
+    for(unsigned int b=0; b<FOI_DIFFERENCE_BLOCKS; b++){
+      if(m_calculate_intensity)
+	intensity += blocks[b].intensity[d];
+      if(m_calculate_g){
+	linear += blocks[b].linear[d];
+	constant += blocks[b].constant[d];
+	square += blocks[b].square[d];
+	cross += blocks[b].cross[d];
+	offset += blocks[b].offset[d];
+      }
+      if(m_calculate_prob)
+	prob += blocks[b].prob[d];
+    }
+    long double t = m_grid_points*(k+1) - cell_lo;
+    if(m_calculate_g){
+      if(m_update)
+	m_exp_last_changepoint_sequential[iters][k] += t*linear + constant;
+      if(k>=fb){
+	m_exp_last_changepoint[k] += t*linear + constant;
+	m_variance_exp_last_changepoint[k] += t*t*square + t*cross + offset;
+      }
+    }
+    if(m_calculate_prob){
+      if(m_update)
+	m_prob_last_changepoint_sequential[iters][k] += prob;
+      if(k>=fb)
+	m_prob_function_of_interest[k] += prob;
+    }
+    if(m_calculate_intensity && k>=fb)
+      m_intensity[k] += intensity;
+  }
+  for(unsigned int b=0; b<FOI_DIFFERENCE_BLOCKS; b++){
+    m_average_distance += blocks[b].average_distance;
+    if(blocks[b].min_distance < m_min_distance)
+      m_min_distance = blocks[b].min_distance;
+  }
+  delete [] blocks;
+}
+
 void Function_of_Interest::normalise_function(double sum_weights, int loc_index_1, int loc_index_2, int fb,int iters){
 
 
@@ -474,6 +936,18 @@ void Function_of_Interest::normalise_function(double sum_weights, int loc_index_
 }
 
 
+//the filtered intensity in the grid cell ending at or before time t
+double Function_of_Interest::get_intensity(double t) const{
+  if(!m_intensity)
+    return 0;
+  int k = cells_ending_by(t)-1;
+  if(k<0)
+    k=0;
+  if(k>=m_grid)
+    k=m_grid-1;
+  return m_intensity[k];
+}
+
 void Function_of_Interest::write_mean_to_file(const string output_filename){
   if(!m_intensity){
     cerr << "function_of_interest.h: intensity has not been calculated" << endl;
@@ -490,7 +964,12 @@ void Function_of_Interest::write_mean_to_file(const string output_filename){
   }
 
   for(int i = 0; i < m_grid; i++){
+    if(m_boundaries)
+      OutputStream << m_boundaries[i] << "\t" << m_boundaries[i+1] << "\t";
     OutputStream << m_intensity[i] << endl;
   }
   OutputStream.close();
+
+  if(m_intensity_bands)
+    m_intensity_bands->write_to_file(Quantile_Sketch::bands_file(output_filename));
 }
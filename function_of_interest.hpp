@@ -4,6 +4,7 @@
 #include "particle.hpp"
 #include "changepoint.hpp"
 #include "probability_model.hpp"
+#include "quantile_sketch.hpp"
 
 class Function_of_Interest{
 
@@ -18,6 +19,7 @@ class Function_of_Interest{
   long double * get_g(){return m_exp_last_changepoint;}
   long double * get_variance_g(){return m_variance_exp_last_changepoint;}
   double * get_intensity(){return m_intensity;}
+  double get_intensity(double) const;
  long  double * get_prob(){return m_prob_function_of_interest;}
   double ** get_prob_sequential(){return m_prob_last_changepoint_sequential;}
   double ** get_g_sequential(){return m_exp_last_changepoint_sequential;}
@@ -29,10 +31,30 @@ class Function_of_Interest{
   void set_start(int st){m_start_of_sample = st;}
   void write_mean_to_file(const string output_filename = "intensity.txt");
   void set_importance_sampling() {m_coal_importance_sampling = 1;}
+  /*add up the estimates on the grid with difference arrays, each particle's segments as a few
+    range updates rather than one update per grid cell, split between num_threads threads. The
+    same estimates up to rounding, but not used for a time varying mean function of the model
+    or with intensity bands*/
+  void use_difference_arrays(unsigned int num_threads = 1){ m_difference_arrays = true; m_num_threads = num_threads>0 ? num_threads : 1; }
+  /*also estimate the lower, median and upper quantiles of the intensity in each grid cell as
+    the particles stream through, written next to the mean by write_mean_to_file*/
+  void calculate_intensity_bands(double lower = 0.05, double upper = 0.95);
+  Quantile_Sketch * get_intensity_bands(){return m_intensity_bands;}
+  /*rather than a uniform grid, place the cells of each interval the first time its estimates are
+    made, where the changepoints of the particles and the jumps in their intensity are dense.
+    Each fine bin of resolution to a cell gets uniform_share of the cells spread evenly and the
+    rest in proportion to those densities. Only for the intensity, which is then written with the
+    boundaries of each cell*/
+  void use_adaptive_grid(unsigned int resolution = 16, double uniform_share = 0.25);
+  const double * get_grid_boundaries() const {return m_boundaries;}
+  /*the estimates accumulated so far, for checkpoints*/
+  void write_state(ostream &) const;
+  bool read_state(istream &);
 
   private:
 
    int m_grid;
+   int m_intervals;
    double m_start;
    double m_end;
    double m_prior;
@@ -61,7 +83,24 @@ class Function_of_Interest{
    int m_start_of_sample;
    int m_sample_size;
   bool m_coal_importance_sampling;
+  Quantile_Sketch * m_intensity_bands;
+  double * m_boundaries;//m_grid+1 cell boundaries for an adaptive grid, otherwise NULL
+  int m_cells_placed;
+  unsigned int m_adaptive_resolution;
+  double m_adaptive_uniform_share;
+  int cells_ending_by(double) const;
+  double cell_end(int) const;
+  double first_cell_end_from(double) const;
+  void place_cells(double, Particle<changepoint> **, long long int, double *);
+  bool m_difference_arrays;
+  unsigned int m_num_threads;
+  struct Difference_Block;
+  struct Difference_Worker;
   double log_gamma_pdf(double, double, double);
+  long double capped_g(int, double) const;
+  void add_particle_differences(Difference_Block &, Particle<changepoint> *, double, double, double, int, int, int) const;
+  void calculate_function_by_differences(double, Particle<changepoint> **, long long int, double *, double, int, int, int, int);
+  static void * difference_thread(void *);
    
 
 };
@@ -12,9 +12,9 @@ Histogram::Histogram(double start, double end, unsigned int num_bins, double bin
 Histogram::Histogram( const Histogram& h ){
   m_histogram_parent = &h;
   if(!h.m_mc_divergence)
-    construct(h.m_start,h.m_end,h.m_bin_width,h.m_dim_num_bins,h.m_bounded,h.m_weighted,h.m_1d_histogram_bin_counts!=NULL&&m_1d_histogram_bin_weights!=NULL);
+    construct(h.m_start,h.m_end,h.m_bin_width,h.m_dim_num_bins,h.m_bounded,h.m_weighted,(h.m_1d_histogram_bin_counts!=NULL||h.m_1d_histogram_bin_weights!=NULL));
   else
-    construct(h.m_start,h.m_end,h.m_bin_width,h.m_dim_num_bins,h.m_bounded,h.m_weighted,h.m_1d_histogram_bin_counts!=NULL&&m_1d_histogram_bin_weights!=NULL,true,h.m_mc_divergence->get_divergence_type(),h.m_mc_divergence->get_loss_function(),0,h.m_estimate_autocorrelation,h.m_max_dim);
+    construct(h.m_start,h.m_end,h.m_bin_width,h.m_dim_num_bins,h.m_bounded,h.m_weighted,(h.m_1d_histogram_bin_counts!=NULL||h.m_1d_histogram_bin_weights!=NULL),true,h.m_mc_divergence->get_divergence_type(),h.m_mc_divergence->get_loss_function(),0,h.m_estimate_autocorrelation,h.m_max_dim);
 }
 
 void Histogram::construct(double start, double end, double bin_width, unsigned int num_bins, bool bounded, bool weighted, bool one_d, bool calculate_divergence, Divergence_Type divergence_type, Loss_Function loss_fn, unsigned int look_up_length, bool estimate_autocorrelation, unsigned int max_dim){
@@ -98,12 +98,18 @@ void Histogram::reset(){
   if( m_1d_histogram_bin_weights)
     for(unsigned int i = 0; i < m_dim_num_bins; i++)
       m_1d_histogram_bin_weights[i] = 0;
+  for(unsigned long long int j = 0; j < m_histogram_bin_counts_dim; j++)
+    if(m_histogram_bin_counts_array)
+      m_histogram_bin_counts_array[j] = 0;
+    else if(m_histogram_bin_weights_array)
+      m_histogram_bin_weights_array[j] = 0;
   if(m_mc_divergence)
     m_mc_divergence->reset();
   m_nonempty_bins = 0;
   m_current_bin_count = 0;
   m_samples = m_1d_samples = 0;
   m_sum_weights = m_1d_sum_weights = 0;
+  m_entropy = 0;
   if(m_histogram_odd)
     m_histogram_odd->reset();
   if(m_histogram_even)
@@ -161,39 +167,31 @@ unsigned long long int Histogram::increment_bin_counts( vector<unsigned int>* bi
 
 void Histogram::increment_histogram_bin_counts(double weight){
   if(!m_weighted){
-    m_bin_count_iter = m_histogram_bin_counts.find(m_current_bin);
-    m_new_bin = m_bin_count_iter == m_histogram_bin_counts.end();
-  }
-  else{
-    m_bin_weight_iter = m_histogram_bin_weights.find(m_current_bin);
-    m_new_bin = m_bin_weight_iter == m_histogram_bin_weights.end();
-    m_sum_weights += weight;
-  }
-  
-  if( !m_new_bin  ){
-    if(!m_weighted){
-      m_bin_count_iter->second++;
-      m_current_bin_count = m_bin_count_iter->second;
+    unsigned long long int & count = m_histogram_bin_counts.find_or_insert(m_current_bin,m_new_bin);
+    if( !m_new_bin ){
+      m_current_bin_count = ++count;
       if(m_track_entropy && m_current_bin_count>1)
 	m_delta_entropy = -m_current_bin_count*log(m_current_bin_count)+(m_current_bin_count-1)*log(m_current_bin_count-1);
     }
     else{
+      m_current_bin_count = count = 1;
+      m_delta_entropy = 0;
+    }
+  }
+  else{
+    double & bin_weight = m_histogram_bin_weights.find_or_insert(m_current_bin,m_new_bin);
+    m_sum_weights += weight;
+    if( !m_new_bin ){
       if(m_track_entropy){
-	m_delta_entropy = -(m_bin_weight_iter->second+weight)*log(m_bin_weight_iter->second+weight);
-	if(m_bin_weight_iter->second>0)
-	  m_delta_entropy += m_bin_weight_iter->second*log(m_bin_weight_iter->second);
+	m_delta_entropy = -(bin_weight+weight)*log(bin_weight+weight);
+	if(bin_weight>0)
+	  m_delta_entropy += bin_weight*log(bin_weight);
       }
-      m_bin_weight_iter->second+= weight;
-      m_current_bin_weight = m_bin_weight_iter->second;
+      bin_weight += weight;
+      m_current_bin_weight = bin_weight;
     }
-  }
-  else
-  {
-    if(!m_weighted){
-      m_current_bin_count = m_histogram_bin_counts[m_current_bin] = 1;
-      m_delta_entropy = 0;}
     else{
-      m_current_bin_weight = m_histogram_bin_weights[m_current_bin] = weight;
+      m_current_bin_weight = bin_weight = weight;
       if(m_track_entropy)
 	m_delta_entropy = -weight*log(weight);
     }
@@ -238,25 +236,18 @@ void Histogram::increment_1d_bin_counts(double weight){
 }
 
 void Histogram::add_histogram( Histogram* hist ){
-  map<vector<unsigned int>,unsigned long long int >::iterator hist_iter;
-  for(hist_iter=hist->m_histogram_bin_counts.begin();hist_iter!=hist->m_histogram_bin_counts.end();++hist_iter){
-    m_bin_count_iter = m_histogram_bin_counts.find(hist_iter->first);
-    if( m_bin_count_iter!= m_histogram_bin_counts.end() )
-      m_bin_count_iter->second += hist_iter->second;
-    else{
-      m_histogram_bin_counts[hist_iter->first] = hist_iter->second;
+  bool new_bin;
+  Bin_Hash_Table<unsigned long long int> & counts = hist->m_histogram_bin_counts;
+  for(unsigned long long int i=0; i<counts.size(); i++){
+    m_histogram_bin_counts.find_or_insert(counts.key(i),counts.dim(i),counts.hash(i),new_bin) += counts.value(i);
+    if(new_bin)
       m_nonempty_bins++;
-    }
   }
-  map<vector<unsigned int>,double >::iterator hist_iter2;
-  for(hist_iter2=hist->m_histogram_bin_weights.begin();hist_iter2!=hist->m_histogram_bin_weights.end();++hist_iter2){
-    m_bin_weight_iter = m_histogram_bin_weights.find(hist_iter2->first);
-    if( m_bin_weight_iter!= m_histogram_bin_weights.end() )
-      m_bin_weight_iter->second += hist_iter2->second;
-    else{
-      m_histogram_bin_weights[hist_iter2->first] = hist_iter2->second;
+  Bin_Hash_Table<double> & weights = hist->m_histogram_bin_weights;
+  for(unsigned long long int i=0; i<weights.size(); i++){
+    m_histogram_bin_weights.find_or_insert(weights.key(i),weights.dim(i),weights.hash(i),new_bin) += weights.value(i);
+    if(new_bin)
       m_nonempty_bins++;
-    }
   }
   m_samples += hist->m_samples;
   m_sum_weights += hist->m_sum_weights;
@@ -271,21 +262,25 @@ void Histogram::add_histogram( Histogram* hist ){
     m_1d_sum_weights += hist->m_1d_sum_weights;
   }
   if(m_histogram_bin_counts_array && hist->m_histogram_bin_counts_array)
-    for(unsigned long long int j = 0; j < m_histogram_bin_counts_dim; j++)
+    for(unsigned long long int j = 0; j < m_histogram_bin_counts_dim; j++){
+      if(!m_histogram_bin_counts_array[j] && hist->m_histogram_bin_counts_array[j])
+	m_nonempty_bins++;
       m_histogram_bin_counts_array[j]+=hist->m_histogram_bin_counts_array[j];
+    }
   if(m_histogram_bin_weights_array && hist->m_histogram_bin_weights_array)
-    for(unsigned long long int j = 0; j < m_histogram_bin_counts_dim; j++)
+    for(unsigned long long int j = 0; j < m_histogram_bin_counts_dim; j++){
+      if(!m_histogram_bin_weights_array[j] && hist->m_histogram_bin_weights_array[j])
+	m_nonempty_bins++;
       m_histogram_bin_weights_array[j]+=hist->m_histogram_bin_weights_array[j];
+    }
   m_track_entropy = false;
 }
 
 void Histogram::bin_data( Data<double>* X ){
   unsigned int n = X->get_cols();
   for(unsigned int j = 0; j < n; j++){
-    if(!m_bounded ||((*X)[0][j] >= m_start && (*X)[0][j] <= m_end )){
-	calculate_bin( (*X)[0][j], true );
-	increment_bin_counts();
-    }
+    if(!m_bounded ||((*X)[0][j] >= m_start && (*X)[0][j] <= m_end ))
+      push( (*X)[0][j] );
   }
   calculate_sum_exponentiated_differences();
 }
@@ -297,22 +292,28 @@ void Histogram::write_histogram_to_file(const string output_filename){
     write_histogram_bin_counts_array_to_file(output_filename);
 }
 
+//in the order of the bins, so that the files do not depend on the order the bins were found
 void Histogram::write_histogram_bin_counts_to_file(const string output_filename){
   ofstream OutputStream(output_filename.c_str(), ios::out);
-  if(!m_weighted)
-    for(m_bin_count_iter=m_histogram_bin_counts.begin();m_bin_count_iter!=m_histogram_bin_counts.end();++m_bin_count_iter){
-      OutputStream<< m_bin_count_iter->second;
-      for(unsigned int i = 0; i < m_bin_count_iter->first.size(); i++)
-        OutputStream << " " << (m_bin_count_iter->first)[i];
+  vector<unsigned long long int> order;
+  if(!m_weighted){
+    m_histogram_bin_counts.sorted_order(order);
+    for(unsigned long long int j = 0; j < order.size(); j++){
+      OutputStream<< m_histogram_bin_counts.value(order[j]);
+      for(unsigned int i = 0; i < m_histogram_bin_counts.dim(order[j]); i++)
+        OutputStream << " " << m_histogram_bin_counts.key(order[j])[i];
       OutputStream << endl;
     }
-  else
-    for(m_bin_weight_iter=m_histogram_bin_weights.begin();m_bin_weight_iter!=m_histogram_bin_weights.end();++m_bin_weight_iter){
-      OutputStream<< m_bin_weight_iter->second;
-      for(unsigned int i = 0; i < m_bin_weight_iter->first.size(); i++)
-        OutputStream << " " << (m_bin_weight_iter->first)[i];
+  }
+  else{
+    m_histogram_bin_weights.sorted_order(order);
+    for(unsigned long long int j = 0; j < order.size(); j++){
+      OutputStream<< m_histogram_bin_weights.value(order[j]);
+      for(unsigned int i = 0; i < m_histogram_bin_weights.dim(order[j]); i++)
+        OutputStream << " " << m_histogram_bin_weights.key(order[j])[i];
       OutputStream << endl;
     }
+  }
 }
 
 void Histogram::write_histogram_bin_counts_array_to_file(const string output_filename){
@@ -374,6 +375,80 @@ void Histogram::read_histogram_bin_counts_from_file(const string input_filename)
   }
 }
 
+void Histogram::write_histogram_to_binary_file(const string output_filename){
+  if(m_max_dim){
+    cerr << "Error: histograms with a maximum dimension are not written in binary" << endl;
+    exit(1);
+  }
+  Histogram_File_Writer writer(output_filename,m_weighted);
+  if(!writer.is_open()){
+    cerr << "Histogram file " << output_filename << " could not be opened" << endl;
+    return;
+  }
+  vector<unsigned long long int> order;
+  if(!m_weighted){
+    m_histogram_bin_counts.sorted_order(order);
+    for(unsigned long long int j = 0; j < order.size(); j++)
+      writer.write_count(m_histogram_bin_counts.key(order[j]),m_histogram_bin_counts.dim(order[j]),m_histogram_bin_counts.value(order[j]));
+  }
+  else{
+    m_histogram_bin_weights.sorted_order(order);
+    for(unsigned long long int j = 0; j < order.size(); j++)
+      writer.write_weight(m_histogram_bin_weights.key(order[j]),m_histogram_bin_weights.dim(order[j]),m_histogram_bin_weights.value(order[j]));
+  }
+  writer.close();
+}
+
+//the bins are added to those already there when incrementing
+void Histogram::read_histogram_from_binary_file(const string input_filename, bool increment){
+  if(m_max_dim){
+    cerr << "Error: histograms with a maximum dimension are not read in binary" << endl;
+    exit(1);
+  }
+  Histogram_File_Reader reader(input_filename);
+  if(!reader.is_open())
+    return;
+  if(reader.is_weighted() != m_weighted){
+    cerr << "Error: histogram file " << input_filename << (m_weighted ? " has counts" : " has weights") << endl;
+    exit(1);
+  }
+  if(!increment)
+    reset();
+  bool new_bin;
+  while(reader.next()){
+    const vector<unsigned int> & v = reader.key();
+    if(!m_weighted){
+      m_current_bin_count = reader.count();
+      m_histogram_bin_counts.find_or_insert(v,new_bin) += m_current_bin_count;
+      m_samples += m_current_bin_count;
+      m_1d_samples += m_current_bin_count;
+    }
+    else{
+      m_current_bin_weight = reader.weight();
+      m_histogram_bin_weights.find_or_insert(v,new_bin) += m_current_bin_weight;
+      m_sum_weights += m_current_bin_weight;
+      m_1d_sum_weights += m_current_bin_weight;
+    }
+    if(new_bin)
+      m_nonempty_bins++;
+    int previous_bin = -1;
+    for(unsigned int i = 0; i < v.size(); i++){
+      if(previous_bin != (int)v[i] && v[i] < m_dim_num_bins){
+	if(m_1d_histogram_bin_counts)
+	  m_1d_histogram_bin_counts[v[i]] += m_current_bin_count;
+	if(m_1d_histogram_bin_weights)
+	  m_1d_histogram_bin_weights[v[i]] += m_current_bin_weight;
+      }
+      previous_bin = (int)v[i];
+    }
+  }
+  if(reader.failed()){
+    cerr << "Error: histogram file " << input_filename << " is corrupt" << endl;
+    exit(1);
+  }
+  m_track_entropy = false;
+}
+
 void Histogram::read_histogram_bin_counts_array_from_file(const string input_filename){
   ifstream InputStream(input_filename.c_str(), ios::in);
   if(InputStream.is_open()){
@@ -403,18 +478,18 @@ void Histogram::write_marginal_histogram_to_file(const string output_filename, u
     exit(1);
   }
   unsigned int num_appropriate_samples = 0;
-  for(m_bin_count_iter=m_histogram_bin_counts.begin();m_bin_count_iter!=m_histogram_bin_counts.end();++m_bin_count_iter){
-    if(m_bin_count_iter->first.size()==dimension)
-      num_appropriate_samples+=m_bin_count_iter->second;
+  for(unsigned long long int j = 0; j < m_histogram_bin_counts.size(); j++){
+    if(m_histogram_bin_counts.dim(j)==dimension)
+      num_appropriate_samples+=m_histogram_bin_counts.value(j);
   }
   if(!num_appropriate_samples)
     return;
   unsigned long long int* counts = new unsigned long long int[ m_dim_num_bins ];
   for(unsigned int i = 0; i < m_dim_num_bins; i++ )
     counts[i]=0;
-  for(m_bin_count_iter=m_histogram_bin_counts.begin();m_bin_count_iter!=m_histogram_bin_counts.end();++m_bin_count_iter)
-    if(m_bin_count_iter->first.size()==dimension)
-      counts[m_bin_count_iter->first[margin]] += m_bin_count_iter->second;
+  for(unsigned long long int j = 0; j < m_histogram_bin_counts.size(); j++)
+    if(m_histogram_bin_counts.dim(j)==dimension)
+      counts[m_histogram_bin_counts.key(j)[margin]] += m_histogram_bin_counts.value(j);
   ofstream OutputStream(output_filename.c_str(), ios::out);
   OutputStream<<setiosflags(ios::fixed);
   OutputStream.precision((int)ceil(log10(num_appropriate_samples)));
@@ -483,12 +558,53 @@ void Histogram::calculate_bin( double val, bool empty_bin_first ){
 
 void Histogram::push( double val ){
   calculate_bin( val, true );
-  increment_bin_counts();
+  if(!m_1d_histogram_bin_counts && !m_1d_histogram_bin_weights){
+    increment_bin_counts();
+    return;
+  }
+  increment_dense_1d_bin_counts();
+  if(m_histogram_odd){
+    if(m_samples%2)
+      m_histogram_odd->push(val);
+    else
+      m_histogram_even->push(val);
+  }
+}
+
+//the bookkeeping of increment_bin_counts() for a scalar sample, with the 1d arrays as the store
+void Histogram::increment_dense_1d_bin_counts(double weight){
+  //a bounded histogram closes its last bin on the right
+  unsigned int bin = m_current_dim_bin < m_dim_num_bins ? m_current_dim_bin : m_dim_num_bins-1;
+  m_samples++;
+  m_1d_samples++;
+  m_1d_sum_weights += weight;
+  if(!m_weighted){
+    m_new_bin = !m_1d_histogram_bin_counts[bin];
+    m_current_bin_count = ++m_1d_histogram_bin_counts[bin];
+  }
+  else{
+    m_new_bin = !m_1d_histogram_bin_weights[bin];
+    m_sum_weights += weight;
+    m_current_bin_weight = m_1d_histogram_bin_weights[bin] += weight;
+  }
+  if( m_new_bin )
+    m_nonempty_bins++;
+  if(m_mc_divergence)
+    m_mc_divergence->update_divergence(m_current_bin_count);
+  if(m_estimate_autocorrelation && m_samples>1)
+    estimate_repeat_prob();
 }
 
 double Histogram::density( double val ){
   calculate_bin( val, true );
-  return m_histogram_bin_counts[m_current_bin]/(m_samples * m_bin_width);
+  if(m_1d_histogram_bin_counts || m_1d_histogram_bin_weights){
+    unsigned int bin = m_current_dim_bin < m_dim_num_bins ? m_current_dim_bin : m_dim_num_bins-1;
+    if(!m_weighted)
+      return m_1d_histogram_bin_counts[bin]/(m_1d_samples * m_bin_width);
+    return m_1d_histogram_bin_weights[bin]/(m_1d_sum_weights * m_bin_width);
+  }
+  unsigned long long int * count = m_histogram_bin_counts.find(&m_current_bin[0],m_current_bin.size());
+  return (count ? *count : 0)/(m_samples * m_bin_width);
 }
 
 double Histogram::get_shannon_entropy(){
@@ -503,14 +619,14 @@ double Histogram::get_shannon_entropy(){
     return get_shannon_entropy_from_array();
   double entropy = 0;
   if(!m_weighted){
-    for(m_bin_count_iter=m_histogram_bin_counts.begin();m_bin_count_iter!=m_histogram_bin_counts.end();++m_bin_count_iter)
-      if(m_bin_count_iter->second>1)
-        entropy -= m_bin_count_iter->second*log(m_bin_count_iter->second);
+    for(unsigned long long int j = 0; j < m_histogram_bin_counts.size(); j++)
+      if(m_histogram_bin_counts.value(j)>1)
+        entropy -= m_histogram_bin_counts.value(j)*log(m_histogram_bin_counts.value(j));
     entropy = entropy/m_samples + log(m_samples);
   }
   else{
-    for(m_bin_weight_iter=m_histogram_bin_weights.begin();m_bin_weight_iter!=m_histogram_bin_weights.end();++m_bin_weight_iter)
-      entropy -= m_bin_weight_iter->second*log(m_bin_weight_iter->second);
+    for(unsigned long long int j = 0; j < m_histogram_bin_weights.size(); j++)
+      entropy -= m_histogram_bin_weights.value(j)*log(m_histogram_bin_weights.value(j));
     entropy = entropy/m_sum_weights + log(m_sum_weights);
   }
   m_entropy = entropy;
@@ -519,14 +635,15 @@ double Histogram::get_shannon_entropy(){
 
 double Histogram::get_cross_entropy(Histogram* h){
   double entropy = 0;
+  bool new_bin;
   if(!m_weighted){
-    for(m_bin_count_iter=m_histogram_bin_counts.begin();m_bin_count_iter!=m_histogram_bin_counts.end();++m_bin_count_iter)
-        entropy -= m_bin_count_iter->second*log(h->m_histogram_bin_counts[m_bin_count_iter->first]);
+    for(unsigned long long int j = 0; j < m_histogram_bin_counts.size(); j++)
+        entropy -= m_histogram_bin_counts.value(j)*log(h->m_histogram_bin_counts.find_or_insert(m_histogram_bin_counts.key(j),m_histogram_bin_counts.dim(j),m_histogram_bin_counts.hash(j),new_bin));
     entropy = entropy/m_samples + log(h->m_samples);
   }
   else{
-    for(m_bin_weight_iter=m_histogram_bin_weights.begin();m_bin_weight_iter!=m_histogram_bin_weights.end();++m_bin_weight_iter)
-      entropy -= m_bin_weight_iter->second*log(h->m_histogram_bin_weights[m_bin_weight_iter->first]);
+    for(unsigned long long int j = 0; j < m_histogram_bin_weights.size(); j++)
+      entropy -= m_histogram_bin_weights.value(j)*log(h->m_histogram_bin_weights.find_or_insert(m_histogram_bin_weights.key(j),m_histogram_bin_weights.dim(j),m_histogram_bin_weights.hash(j),new_bin));
     entropy = entropy/m_sum_weights + log(h->m_sum_weights);
   }
   return entropy;
@@ -572,11 +689,12 @@ double Histogram::get_true_shannon_entropy( double(*cdf)(double) ){
 void Histogram::normalise_histogram(){
   if(!m_max_dim){
     if(m_weighted)
-      for(m_bin_weight_iter=m_histogram_bin_weights.begin();m_bin_weight_iter!=m_histogram_bin_weights.end();++m_bin_weight_iter)
-	m_bin_weight_iter->second/=m_sum_weights;
+      for(unsigned long long int j = 0; j < m_histogram_bin_weights.size(); j++)
+	m_histogram_bin_weights.value(j)/=m_sum_weights;
     else{
-      for(m_bin_count_iter=m_histogram_bin_counts.begin();m_bin_count_iter!=m_histogram_bin_counts.end();++m_bin_count_iter)
-	m_histogram_bin_weights[m_bin_count_iter->first] = m_bin_count_iter->second/(double)m_samples;
+      bool new_bin;
+      for(unsigned long long int j = 0; j < m_histogram_bin_counts.size(); j++)
+	m_histogram_bin_weights.find_or_insert(m_histogram_bin_counts.key(j),m_histogram_bin_counts.dim(j),m_histogram_bin_counts.hash(j),new_bin) = m_histogram_bin_counts.value(j)/(double)m_samples;
       m_weighted = true;
       m_histogram_bin_counts.clear();
     }
@@ -611,13 +729,21 @@ void Histogram::convert_current_bin_to_int(){
     m_current_bin_int += m_current_bin[i]*m_num_bins_powers[i];
 }
 
+//bins never seen count 0
+unsigned long long int Histogram::get_1d_bin_count(unsigned int bin){
+  if(m_1d_histogram_bin_counts)
+    return bin < m_dim_num_bins ? m_1d_histogram_bin_counts[bin] : 0;
+  unsigned long long int * count = m_histogram_bin_counts.find(&bin,1);
+  return count ? *count : 0;
+}
+
 unsigned int Histogram::sample_bin(){
   unsigned int sampled_bin = 0;
-  double u = gsl_ran_flat(m_r,0,1) * m_samples;
-  double cum_prob = m_histogram_bin_counts[vector<unsigned int>(1,sampled_bin)];
-  while( u > cum_prob ){
+  double u = gsl_ran_flat(m_r,0,1) * (m_1d_histogram_bin_counts ? m_1d_samples : m_samples);
+  double cum_prob = get_1d_bin_count(sampled_bin);
+  while( u > cum_prob && sampled_bin+1 < m_dim_num_bins ){
     sampled_bin++;
-    cum_prob += m_histogram_bin_counts[vector<unsigned int>(1,sampled_bin)];
+    cum_prob += get_1d_bin_count(sampled_bin);
   }
   return sampled_bin;
 }
@@ -627,12 +753,12 @@ double Histogram::sample(){
 }
 
 void Histogram::calculate_sum_exponentiated_differences(){
-  int left_count = m_histogram_bin_counts[vector<unsigned int>(1,0)];
-  int count = m_histogram_bin_counts[vector<unsigned int>(1,1)];
+  int left_count = get_1d_bin_count(0);
+  int count = get_1d_bin_count(1);
   int max_diff = count - left_count;
   m_log_sum_exponentiated_differences = 1.0;
   for(unsigned int bin = 2; bin < m_dim_num_bins; bin++){
-    count = m_histogram_bin_counts[vector<unsigned int>(1,bin)];
+    count = get_1d_bin_count(bin);
     int diff = count-left_count;
     if(diff>max_diff){
       m_log_sum_exponentiated_differences*=exp(diff-max_diff);
@@ -650,15 +776,15 @@ void Histogram::calculate_sum_exponentiated_differences(){
 
 unsigned int Histogram::sample_bin_by_differences(){
   unsigned int bin = 1;
-  int left_count = m_histogram_bin_counts[vector<unsigned int>(1,0)];
-  int count = m_histogram_bin_counts[vector<unsigned int>(1,1)];
+  int left_count = get_1d_bin_count(0);
+  int count = get_1d_bin_count(1);
   double max_diff = count - left_count;
   double log_u = log(gsl_ran_flat(m_r,0,1)) + m_log_sum_exponentiated_differences;
   if( log_u <= max_diff )
     return bin;
   double log_cum_prob = 1.0;
   for(bin = 2; bin < m_dim_num_bins; bin++){
-    count = m_histogram_bin_counts[vector<unsigned int>(1,bin)];
+    count = get_1d_bin_count(bin);
     int diff = count-left_count;
     if(diff>max_diff){
       log_cum_prob*=exp(diff-max_diff);
@@ -681,7 +807,7 @@ double Histogram::sample_by_differences(){
 
 double Histogram::sampling_by_differences_log_density( double val ){
   unsigned int bin = static_cast<unsigned int>((val-m_start)/m_difference_bin_width);
-  int count = m_histogram_bin_counts[vector<unsigned int>(1,bin+1)];
-  int left_count = m_histogram_bin_counts[vector<unsigned int>(1,bin)];
+  int count = get_1d_bin_count(bin+1);
+  int left_count = get_1d_bin_count(bin);
   return count-left_count-m_log_sum_exponentiated_differences-log(m_difference_bin_width);
 }
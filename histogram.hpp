@@ -14,6 +14,8 @@
 #include <map>
 #include "Data.hpp"
 #include "mc_divergence.hpp"
+#include "bin_hash_table.hpp"
+#include "histogram_file.hpp"
 #include <gsl/gsl_randist.h>
 #include <gsl/gsl_rng.h>
 
@@ -39,8 +41,8 @@ public:
   void increment_1d_bin_counts(double weight = 1);
   void increment_num_bin_repeats(){m_num_bin_repeats++;}
   void add_histogram( Histogram* hist );
-  map<vector<unsigned int>,long long unsigned int >* get_bin_counts(){ return &m_histogram_bin_counts; }
-  map<vector<unsigned int>,double >* get_bin_weights(){ return &m_histogram_bin_weights; }
+  Bin_Hash_Table<unsigned long long int>* get_bin_counts(){ return &m_histogram_bin_counts; }
+  Bin_Hash_Table<double>* get_bin_weights(){ return &m_histogram_bin_weights; }
   void bin_data( Data<double>* X );
   void write_histogram_to_file(const string output_filename);
   void write_histogram_bin_counts_to_file(const string output_filename);
@@ -48,6 +50,9 @@ public:
   void read_histogram_from_file(const string output_filename, bool increment = false);
   void read_histogram_bin_counts_from_file(const string input_filename);
   void read_histogram_bin_counts_array_from_file(const string input_filename);
+  /*the binary format of histogram_file.hpp, for histograms without a max_dim*/
+  void write_histogram_to_binary_file(const string output_filename);
+  void read_histogram_from_binary_file(const string input_filename, bool increment = false);
   void write_1d_histogram_to_file(const string output_filename);
   void write_marginal_histogram_to_file(const string output_filename, unsigned int dimension=1, unsigned int margin=0);
   void write_true_marginal_histogram_to_file(double(*cdf)(double), const string output_filename);
@@ -56,6 +61,8 @@ public:
   static void set_divergence_delta(double delta){ mc_divergence::set_delta(delta); }
   double get_divergence();
   void calculate_bin( double val, bool empty_bin_first=false );
+  /*a one_d histogram keeps scalar samples only in its dense 1d counts, which density() and the
+    sampling functions then read; otherwise they go to the transdimensional bins*/
   void push( double val );
   double density( double val );
   double get_shannon_entropy();
@@ -77,11 +84,9 @@ public:
   void track_entropy(){ m_track_entropy = true;}
 
 protected:
-  map<vector<unsigned int>,long long unsigned int > m_histogram_bin_counts;
-  map<vector<unsigned int>,double > m_histogram_bin_weights;
+  Bin_Hash_Table<unsigned long long int> m_histogram_bin_counts;
+  Bin_Hash_Table<double> m_histogram_bin_weights;
   vector<unsigned int> m_current_bin;
-  map<vector<unsigned int>,long long unsigned int >::iterator m_bin_count_iter;
-  map<vector<unsigned int>,double >::iterator m_bin_weight_iter;
   unsigned long long int m_current_bin_int;
   unsigned long long int m_current_base;
   unsigned long long int* m_histogram_bin_counts_array;
@@ -122,6 +127,9 @@ protected:
   double m_sum_exponentiated_differences;
   double m_log_sum_exponentiated_differences;
   double m_difference_bin_width;
+
+  void increment_dense_1d_bin_counts(double weight = 1);
+  unsigned long long int get_1d_bin_count(unsigned int bin);
 };
 
 
@@ -0,0 +1,136 @@
+#include "histogram_file.hpp"
+#include <cstdlib>
+#include <cstring>
+
+static const char HISTOGRAM_FILE_MAGIC[6] = {'C','P','H','I','S','T'};
+static const char HISTOGRAM_FILE_VERSION = 1;
+
+Histogram_File_Writer::Histogram_File_Writer(const string & file, bool weighted)
+  :m_out(file.c_str(), ios::out | ios::binary),m_file(file),m_weighted(weighted),m_first(true)
+{
+  m_open = m_out.is_open();
+  if(!m_open)
+    return;
+  m_out.write(HISTOGRAM_FILE_MAGIC,sizeof(HISTOGRAM_FILE_MAGIC));
+  m_out.put(HISTOGRAM_FILE_VERSION);
+  m_out.put(m_weighted ? 1 : 0);
+}
+
+Histogram_File_Writer::~Histogram_File_Writer(){
+  if(m_open)
+    close();
+}
+
+void Histogram_File_Writer::write_varint(unsigned long long int v){
+  while(v >= 0x80){
+    m_out.put((char)(0x80 | (v & 0x7f)));
+    v >>= 7;
+  }
+  m_out.put((char)v);
+}
+
+void Histogram_File_Writer::write_key(const unsigned int * key, unsigned int dim){
+  unsigned int prefix = 0;
+  while(prefix < dim && prefix < m_previous.size() && key[prefix] == m_previous[prefix])
+    prefix++;
+  bool in_order = m_first || (prefix < dim && (prefix == m_previous.size() || key[prefix] > m_previous[prefix]));
+  if(!in_order){
+    cerr << "Error: histogram bins written to " << m_file << " out of order" << endl;
+    exit(1);
+  }
+  write_varint(dim-prefix+1ULL);
+  write_varint(prefix);
+  if(prefix < dim){
+    write_varint(prefix < m_previous.size() ? key[prefix]-m_previous[prefix] : key[prefix]);
+    for(unsigned int i = prefix+1; i < dim; i++)
+      write_varint(key[i]);
+  }
+  m_previous.assign(key,key+dim);
+  m_first = false;
+}
+
+void Histogram_File_Writer::write_count(const unsigned int * key, unsigned int dim, unsigned long long int count){
+  write_key(key,dim);
+  write_varint(count);
+}
+
+void Histogram_File_Writer::write_weight(const unsigned int * key, unsigned int dim, double weight){
+  write_key(key,dim);
+  unsigned long long int bits;
+  memcpy(&bits,&weight,sizeof(bits));
+  for(int i = 0; i < 8; i++)
+    m_out.put((char)((bits >> (8*i)) & 0xff));
+}
+
+bool Histogram_File_Writer::close(){
+  if(!m_open)
+    return false;
+  write_varint(0);
+  m_out.close();
+  m_open = false;
+  if(m_out.fail()){
+    cerr << "Histogram file " << m_file << " could not be written" << endl;
+    return false;
+  }
+  return true;
+}
+
+Histogram_File_Reader::Histogram_File_Reader(const string & file)
+  :m_in(file.c_str(), ios::in | ios::binary),m_weighted(false),m_failed(false),m_count(0),m_weight(0)
+{
+  char header[sizeof(HISTOGRAM_FILE_MAGIC)+2];
+  m_open = m_in.is_open() && m_in.read(header,sizeof(header)) && !memcmp(header,HISTOGRAM_FILE_MAGIC,sizeof(HISTOGRAM_FILE_MAGIC)) && header[sizeof(HISTOGRAM_FILE_MAGIC)] == HISTOGRAM_FILE_VERSION;
+  if(m_open)
+    m_weighted = header[sizeof(HISTOGRAM_FILE_MAGIC)+1] != 0;
+}
+
+bool Histogram_File_Reader::read_varint(unsigned long long int & v){
+  v = 0;
+  for(int shift = 0; shift < 64; shift += 7){
+    int c = m_in.get();
+    if(c == EOF)
+      return false;
+    v |= (unsigned long long int)(c & 0x7f) << shift;
+    if(!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool Histogram_File_Reader::next(){
+  if(!m_open || m_failed)
+    return false;
+  unsigned long long int suffix, prefix, bin;
+  m_failed = true;
+  if(!read_varint(suffix))
+    return false;
+  if(suffix == 0){
+    m_failed = false;
+    return false;
+  }
+  suffix--;
+  if(!read_varint(prefix) || prefix > m_key.size())
+    return false;
+  unsigned long long int previous_dim = m_key.size();
+  m_key.resize(prefix+suffix);
+  for(unsigned long long int i = prefix; i < m_key.size(); i++){
+    if(!read_varint(bin))
+      return false;
+    m_key[i] = (unsigned int)(i == prefix && prefix < previous_dim ? m_key[i]+bin : bin);
+  }
+  if(!m_weighted){
+    if(!read_varint(m_count))
+      return false;
+  }else{
+    unsigned long long int bits = 0;
+    for(int i = 0; i < 8; i++){
+      int c = m_in.get();
+      if(c == EOF)
+	return false;
+      bits |= (unsigned long long int)(c & 0xff) << (8*i);
+    }
+    memcpy(&m_weight,&bits,sizeof(bits));
+  }
+  m_failed = false;
+  return true;
+}
@@ -0,0 +1,73 @@
+#ifndef HISTOGRAM_FILE_HPP
+#define HISTOGRAM_FILE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*Binary files of the bins of a transdimensional histogram, in increasing order of their keys
+  (shorter keys first on a common prefix). After an 8 byte header ("CPHIST", a version and
+  whether the values are weights) each bin is
+
+  suffix+1, prefix, first, rest..., value
+
+  all unsigned LEB128 varints but for weights, which are the 8 bytes of the double, low
+  byte first. prefix is the number of leading bins shared with the key before, suffix the
+  number which follow. first is the first of those less the bin in the same place in the key
+  before, or the bin itself if the key before ended there, and rest the others as they are.
+  A 0 in place of suffix+1 ends the file. Files are written and read one bin at a time, so
+  they never have to be held in memory whole.*/
+class Histogram_File_Writer{
+
+ public:
+  Histogram_File_Writer(const string & file, bool weighted);
+  ~Histogram_File_Writer();
+  bool is_open() const { return m_open; }
+  bool is_weighted() const { return m_weighted; }
+  /*the keys must be written in increasing order*/
+  void write_count(const unsigned int * key, unsigned int dim, unsigned long long int count);
+  void write_weight(const unsigned int * key, unsigned int dim, double weight);
+  /*false if anything could not be written*/
+  bool close();
+
+ private:
+  ofstream m_out;
+  string m_file;
+  bool m_weighted;
+  bool m_open;
+  bool m_first;
+  vector<unsigned int> m_previous;
+
+  void write_key(const unsigned int * key, unsigned int dim);
+  void write_varint(unsigned long long int);
+};
+
+class Histogram_File_Reader{
+
+ public:
+  Histogram_File_Reader(const string & file);
+  bool is_open() const { return m_open; }
+  bool is_weighted() const { return m_weighted; }
+  /*moves on to the next bin, false at the end of the file or if it is corrupt*/
+  bool next();
+  bool failed() const { return m_failed; }
+  const vector<unsigned int> & key() const { return m_key; }
+  unsigned long long int count() const { return m_count; }
+  double weight() const { return m_weight; }
+
+ private:
+  ifstream m_in;
+  bool m_weighted;
+  bool m_open;
+  bool m_failed;
+  vector<unsigned int> m_key;
+  unsigned long long int m_count;
+  double m_weight;
+
+  bool read_varint(unsigned long long int &);
+};
+
+#endif
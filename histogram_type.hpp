@@ -47,7 +47,7 @@ Histogram_Type<T>::~Histogram_Type(){}
 template <class T>
 void Histogram_Type<T>::calculate_bin( Particle<T>* particle, unsigned int particle_dim ){
   if(m_estimate_autocorrelation && m_samples > 0){
-      m_previous_bin = m_current_bin;
+      m_previous_bin.swap(m_current_bin);
       m_previous_dim = m_current_dim;
   }
   m_current_bin.clear();
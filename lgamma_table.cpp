@@ -0,0 +1,19 @@
+#include "lgamma_table.hpp"
+#include <gsl/gsl_sf_gamma.h>
+#include <limits>
+
+void Lgamma_Table::reset(double offset, unsigned long long int limit){
+  m_offset = offset;
+  m_limit = limit;
+  m_values.clear();
+}
+
+double Lgamma_Table::calculate(double offset, unsigned long long int n){
+  double value = gsl_sf_lngamma(offset+n*m_step);
+  if(offset != m_offset || n > m_limit)
+    return value;
+  if(n >= m_values.size())
+    m_values.resize(n+1,numeric_limits<double>::quiet_NaN());
+  m_values[n] = value;
+  return value;
+}
@@ -0,0 +1,36 @@
+#ifndef LGAMMA_TABLE_HPP
+#define LGAMMA_TABLE_HPP
+
+#include <vector>
+
+using namespace std;
+
+/*lgamma(offset+n*step) for whole n up to a limit, eg the number of data points, each calculated
+  the first time it is asked for and kept. The conjugate likelihoods look up the same few counts
+  over and over, with a prior shape as the offset. Asked for another offset, or an n beyond the
+  limit, the table calculates the value directly instead, so a prior that changes between
+  intervals still gets the right answer. A copy holds a table of its own, so a model and its
+  clones on other threads never fill in the same one.*/
+class Lgamma_Table{
+
+ public:
+  Lgamma_Table(double step = 1):m_offset(0),m_step(step),m_limit(0){}
+  /*forgets the table, which is then filled in for offset up to n = limit*/
+  void reset(double offset, unsigned long long int limit);
+  /*equal to gsl_sf_lngamma(offset+n*step)*/
+  double operator()(double offset, unsigned long long int n){
+    if(n < m_values.size() && offset == m_offset && m_values[n] == m_values[n])
+      return m_values[n];
+    return calculate(offset,n);
+  }
+
+ private:
+  double m_offset;
+  double m_step;
+  unsigned long long int m_limit;
+  vector<double> m_values;//NaN until calculated
+
+  double calculate(double offset, unsigned long long int n);
+};
+
+#endif
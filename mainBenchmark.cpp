@@ -0,0 +1,544 @@
+#include "Data.hpp"
+#include "Poisson_process_model.hpp"
+#include "SNCP.hpp"
+#include "RJMCMC_PP.hpp"
+#include "SMC_PP_MCMC_nc.hpp"
+#include "step_function.hpp"
+#include "histogram.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <getopt.h>
+#include <time.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+using namespace std;
+
+/*Timings of the sampling hot paths, for attaching a number to a performance change.
+
+  Each benchmark is run --repeats times and the median, least and greatest of the
+  repeats are written as JSON, one benchmark to a line. Given the file of an earlier
+  run with --baseline, the medians are compared with it, and the exit status is 1 if
+  any benchmark is worse by more than --tolerance.
+
+  The microbenchmarks time one call on random arguments drawn with a fixed seed, so
+  that every run makes the same calls. The RJMCMC benchmarks run the chains of the
+  two examples without a function of interest, so they time the sampler alone. The
+  SMC benchmark runs the vast data example with a fixed sample size on the first
+  --individuals processes and times each interval.*/
+
+static const char * BENCHMARK_FORMAT = "rjmcmc-benchmark-1";
+static const unsigned int MICRO_CALLS = 1000000;
+static const unsigned int DISTINCT_ARGUMENTS = 4096;//the arguments are cycled through, so that drawing them is not timed
+static const unsigned int STEP_FUNCTION_KNOTS = 1000;
+static const unsigned int HISTOGRAM_BINS = 112;
+static const unsigned int HISTOGRAM_MAX_DIMENSION = 6;
+static const long long int RJ_COAL_ITERATIONS = 5000000;
+static const long long int RJ_SHOT_NOISE_ITERATIONS = 20000;
+static const unsigned int VAST_INTERVALS = 240;
+static const double VAST_START = 0;
+static const double VAST_END = 10;
+
+static volatile double sink;//results are added in here so that the timed calls are not optimised away
+
+struct Benchmark_Options{
+  string m_data_directory;
+  string m_output_file;
+  string m_baseline_file;
+  string m_filter;
+  double m_tolerance;
+  double m_scale;
+  unsigned int m_repeats;
+  unsigned int m_individuals;
+  unsigned long int m_particles;
+  unsigned int m_num_threads;
+  unsigned int m_seed;
+};
+
+struct Benchmark_Result{
+  string m_name;
+  string m_unit;
+  bool m_higher_is_better;
+  vector<double> m_values;//one for each repeat
+};
+
+class Benchmark_Results{
+
+ public:
+  void add(const string & name, const string & unit, bool higher_is_better, double value){
+    for(unsigned int i=0; i<m_results.size(); i++)
+      if(m_results[i].m_name == name){
+	m_results[i].m_values.push_back(value);
+	return;
+      }
+    Benchmark_Result r;
+    r.m_name = name;
+    r.m_unit = unit;
+    r.m_higher_is_better = higher_is_better;
+    r.m_values.push_back(value);
+    m_results.push_back(r);
+  }
+  unsigned int size() const { return m_results.size(); }
+  const Benchmark_Result & operator[](unsigned int i) const { return m_results[i]; }
+
+ private:
+  vector<Benchmark_Result> m_results;
+};
+
+static double now_ms(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec*1e3 + t.tv_nsec*1e-6;
+}
+
+static double median(vector<double> v){
+  sort(v.begin(),v.end());
+  unsigned int n = v.size();
+  return n%2 ? v[n/2] : (v[n/2-1]+v[n/2])/2;
+}
+
+static unsigned long long int scaled(unsigned long long int n, double scale){
+  unsigned long long int m = (unsigned long long int)(n*scale);
+  return m > 0 ? m : 1;
+}
+
+static Data<double> * read_data(const Benchmark_Options & o, const string & file){
+  string path = o.m_data_directory + "/" + file;
+  ifstream test(path.c_str());
+  if(!test){
+    cerr << "Error: " << path << " could not be opened, see --datadir" << endl;
+    exit(1);
+  }
+  test.close();
+  return new Data<double>(path,false);
+}
+
+/*n times uniform on [start,end)*/
+static void random_times(gsl_rng * r, double start, double end, double * t, unsigned int n){
+  for(unsigned int i=0; i<n; i++)
+    t[i] = start + (end-start)*gsl_rng_uniform(r);
+}
+
+/*pairs s <= t*/
+static void random_intervals(gsl_rng * r, double start, double end, double * s, double * t, unsigned int n){
+  random_times(r,start,end,s,n);
+  random_times(r,start,end,t,n);
+  for(unsigned int i=0; i<n; i++)
+    if(s[i] > t[i])
+      swap(s[i],t[i]);
+}
+
+static void bench_find_data_index(const Benchmark_Options & o, gsl_rng * r, Benchmark_Results & results){
+  Data<double> * data = read_data(o,"shot_noise.txt");
+  double * t = new double[DISTINCT_ARGUMENTS];
+  random_times(r,0,data->get_element(0,data->get_cols()-1),t,DISTINCT_ARGUMENTS);
+  unsigned long long int calls = scaled(MICRO_CALLS,o.m_scale);
+  unsigned long long int sum = 0;
+  double t0 = now_ms();
+  for(unsigned long long int i=0; i<calls; i++)
+    sum += data->find_data_index(t[i%DISTINCT_ARGUMENTS]);
+  double t1 = now_ms();
+  sink += sum;
+  results.add("find_data_index","ns/call",false,(t1-t0)*1e6/calls);
+  delete [] t;
+  delete data;
+}
+
+static void bench_log_likelihood_interval(const Benchmark_Options & o, gsl_rng * r, Benchmark_Results & results){
+  Data<double> * data = read_data(o,"coal_data_renormalised.txt");
+  pp_model model(0.1,0.1,data);
+  double * s = new double[DISTINCT_ARGUMENTS];
+  double * t = new double[DISTINCT_ARGUMENTS];
+  random_intervals(r,0,112,s,t,DISTINCT_ARGUMENTS);
+  unsigned long long int calls = scaled(MICRO_CALLS,o.m_scale);
+  double sum = 0;
+  double t0 = now_ms();
+  for(unsigned long long int i=0; i<calls; i++)
+    sum += model.log_likelihood_interval(s[i%DISTINCT_ARGUMENTS],t[i%DISTINCT_ARGUMENTS]);
+  double t1 = now_ms();
+  sink += sum;
+  results.add("pp_model_log_likelihood_interval","ns/call",false,(t1-t0)*1e6/calls);
+  delete [] s;
+  delete [] t;
+  delete data;
+}
+
+static double time_cumulative_function(Step_Function & f, const double * s, const double * t, unsigned long long int calls){
+  double sum = 0;
+  double t0 = now_ms();
+  for(unsigned long long int i=0; i<calls; i++)
+    sum += f.cumulative_function(s[i%DISTINCT_ARGUMENTS],t[i%DISTINCT_ARGUMENTS]);
+  double t1 = now_ms();
+  sink += sum;
+  return (t1-t0)*1e6/calls;
+}
+
+/*a step function with many random knots, and the seasonality of the vast data example*/
+static void bench_cumulative_function(const Benchmark_Options & o, gsl_rng * r, Benchmark_Results & results){
+  unsigned long long int calls = scaled(MICRO_CALLS,o.m_scale);
+  double * s = new double[DISTINCT_ARGUMENTS];
+  double * t = new double[DISTINCT_ARGUMENTS];
+
+  double * knots = new double[STEP_FUNCTION_KNOTS];
+  double * heights = new double[STEP_FUNCTION_KNOTS];
+  knots[0] = 0;
+  for(unsigned int i=1; i<STEP_FUNCTION_KNOTS; i++)
+    knots[i] = knots[i-1] + gsl_ran_exponential(r,1);
+  for(unsigned int i=0; i<STEP_FUNCTION_KNOTS; i++)
+    heights[i] = gsl_ran_exponential(r,1);
+  double end = knots[STEP_FUNCTION_KNOTS-1] + 1;
+  Step_Function knotted(knots,heights,STEP_FUNCTION_KNOTS,end);
+  random_intervals(r,0,end,s,t,DISTINCT_ARGUMENTS);
+  results.add("step_function_cumulative_function","ns/call",false,time_cumulative_function(knotted,s,t,calls));
+
+  string seasonality = o.m_data_directory + "/vastdata/seasonality.txt";
+  Step_Function seasonal(seasonality,1);
+  if(!seasonal.get_num_changepoints()){
+    cerr << "Error: " << seasonality << " could not be read, see --datadir" << endl;
+    exit(1);
+  }
+  random_intervals(r,VAST_START,VAST_END,s,t,DISTINCT_ARGUMENTS);
+  results.add("step_function_cumulative_function_seasonal","ns/call",false,time_cumulative_function(seasonal,s,t,calls));
+
+  delete [] knots;
+  delete [] heights;
+  delete [] s;
+  delete [] t;
+}
+
+/*the bins of changepoint samples of up to HISTOGRAM_MAX_DIMENSION changepoints, as in an RJMCMC sample histogram*/
+static void bench_increment_bin_counts(const Benchmark_Options & o, gsl_rng * r, Benchmark_Results & results){
+  vector< vector<unsigned int> > bins(DISTINCT_ARGUMENTS);
+  for(unsigned int i=0; i<DISTINCT_ARGUMENTS; i++){
+    unsigned int dim = gsl_rng_uniform_int(r,HISTOGRAM_MAX_DIMENSION+1);
+    for(unsigned int j=0; j<dim; j++)
+      bins[i].push_back(gsl_rng_uniform_int(r,HISTOGRAM_BINS));
+    sort(bins[i].begin(),bins[i].end());
+  }
+  Histogram histogram(0,112,HISTOGRAM_BINS,-1,true,false,false,0,NULL,false,BIAS,MINIMAX,0,false);
+  unsigned long long int calls = scaled(MICRO_CALLS,o.m_scale);
+  unsigned long long int sum = 0;
+  double t0 = now_ms();
+  for(unsigned long long int i=0; i<calls; i++)
+    sum += histogram.increment_bin_counts(&bins[i%DISTINCT_ARGUMENTS]);
+  double t1 = now_ms();
+  sink += sum;
+  results.add("histogram_increment_bin_counts","ns/call",false,(t1-t0)*1e6/calls);
+}
+
+static double time_rj(rj_pp & rj, long long int iterations){
+  double t0 = now_ms();
+  rj.runsimulation();
+  double t1 = now_ms();
+  return iterations/((t1-t0)*1e-3);
+}
+
+/*the settings of the two examples of mainRJ_example*/
+static void bench_rjmcmc(const Benchmark_Options & o, gsl_rng *, Benchmark_Results & results){
+  int max_cps = 1e9;
+  {
+    Data<double> * data = read_data(o,"coal_data_renormalised.txt");
+    pp_model model(0.1,0.1,data);
+    long long int iterations = scaled(RJ_COAL_ITERATIONS,o.m_scale);
+    rj_pp rj(0,112,iterations,max_cps,10,2/112.0,0,&model,1,0,0,0,NULL,o.m_seed,false);
+    results.add("rjmcmc_poisson_coal","iterations/s",true,time_rj(rj,iterations));
+    delete data;
+  }
+  {
+    Data<double> * data = read_data(o,"shot_noise.txt");
+    sncp_model model(2/3.0,0.01,data,o.m_seed);
+    unsigned int num_proposal_histogram_bins = 40000;
+    long long int iterations = scaled(RJ_SHOT_NOISE_ITERATIONS,o.m_scale);
+    rj_pp rj(0,2000,iterations,max_cps,50,0.0025,0,&model,1,0,0,0,NULL,o.m_seed,false);
+    rj.disallow_neighbouring_empty_intervals();
+    rj.non_conjugate();
+    rj.proposal_type("Histogram",(void*)(&num_proposal_histogram_bins));
+    results.add("rjmcmc_sncp_shot_noise","iterations/s",true,time_rj(rj,iterations));
+    delete data;
+  }
+}
+
+/*the defaults of mainSMC_vastdata, but with a fixed sample size*/
+static void bench_smc_vastdata(const Benchmark_Options & o, gsl_rng *, Benchmark_Results & results){
+  string directory = o.m_data_directory + "/vastdata/";
+  ifstream list((directory+"filenames.txt").c_str());
+  vector<string> filenames;
+  string line;
+  while(filenames.size() < o.m_individuals && list >> line)
+    filenames.push_back(line);
+  if(filenames.empty()){
+    cerr << "Error: " << directory << "filenames.txt could not be read, see --datadir" << endl;
+    exit(1);
+  }
+  unsigned int num = filenames.size();
+  probability_model ** models = new probability_model*[num];
+  for(unsigned int i=0; i<num; i++){
+    vector<string> f;
+    f.push_back(directory+filenames[i]);
+    f.push_back(directory+"timescale.txt");
+    f.push_back(directory+"seasonality.txt");
+    models[i] = new pp_model(&f,0.05,0.05,VAST_START,VAST_END,1);
+  }
+  unsigned long int particles = scaled(o.m_particles,o.m_scale)*num;
+  SMC_PP_MCMC * smc = new SMC_PP_MCMC(VAST_START,VAST_END,VAST_INTERVALS,particles,particles,NULL,0.005,0,models,num,false,true,true,false,0,o.m_seed);
+  smc->initialise_function_of_interest(VAST_INTERVALS,0,0,0,2,0);
+  smc->set_RJ_parameters(10,5000,0.01);
+  smc->set_neighbouring_intervals(1);
+  smc->set_look_back(1);
+  smc->set_ESS_threshold(0.5);
+  smc->set_resampling_type(SYSTEMATIC);
+  smc->set_num_threads(o.m_num_threads);
+
+  vector<double> latencies;
+  double t0 = now_ms();
+  while(true){
+    double t1 = now_ms();
+    if(!smc->advance_interval())
+      break;
+    latencies.push_back(now_ms()-t1);
+  }
+  double total = now_ms()-t0;
+  sort(latencies.begin(),latencies.end());
+  results.add("smc_vastdata_interval_median","ms",false,median(latencies));
+  results.add("smc_vastdata_interval_p95","ms",false,latencies[(unsigned int)(0.95*(latencies.size()-1))]);
+  results.add("smc_vastdata_total","ms",false,total);
+
+  delete smc;
+  for(unsigned int i=0; i<num; i++)
+    delete models[i];
+  delete [] models;
+}
+
+typedef void (*Benchmark_Function)(const Benchmark_Options &, gsl_rng *, Benchmark_Results &);
+
+struct Benchmark{
+  const char * m_name;
+  Benchmark_Function m_function;
+};
+
+static const Benchmark BENCHMARKS[] = {
+  {"find_data_index", bench_find_data_index},
+  {"log_likelihood_interval", bench_log_likelihood_interval},
+  {"cumulative_function", bench_cumulative_function},
+  {"increment_bin_counts", bench_increment_bin_counts},
+  {"rjmcmc", bench_rjmcmc},
+  {"smc_vastdata", bench_smc_vastdata}
+};
+static const unsigned int NUM_BENCHMARKS = sizeof(BENCHMARKS)/sizeof(BENCHMARKS[0]);
+
+static void write_results(ostream & out, const Benchmark_Options & o, const Benchmark_Results & results){
+  out << "{\"format\": \"" << BENCHMARK_FORMAT << "\", \"repeats\": " << o.m_repeats << ", \"scale\": " << o.m_scale << ", \"benchmarks\": [" << endl;
+  out << setprecision(6);
+  for(unsigned int i=0; i<results.size(); i++){
+    const Benchmark_Result & r = results[i];
+    out << "{\"name\": \"" << r.m_name << "\", \"unit\": \"" << r.m_unit << "\", \"higher_is_better\": " << (r.m_higher_is_better ? "true" : "false")
+	<< ", \"median\": " << median(r.m_values)
+	<< ", \"min\": " << *min_element(r.m_values.begin(),r.m_values.end())
+	<< ", \"max\": " << *max_element(r.m_values.begin(),r.m_values.end()) << "}"
+	<< (i+1<results.size() ? "," : "") << endl;
+  }
+  out << "]}" << endl;
+}
+
+/*the value of a field on a line written by write_results*/
+static bool read_field(const string & line, const string & field, string & value){
+  string key = "\"" + field + "\": ";
+  size_t start = line.find(key);
+  if(start == string::npos)
+    return false;
+  start += key.size();
+  if(line[start] == '"'){
+    size_t end = line.find('"',start+1);
+    if(end == string::npos)
+      return false;
+    value = line.substr(start+1,end-start-1);
+  }else{
+    size_t end = line.find_first_of(",}",start);
+    value = line.substr(start,end == string::npos ? string::npos : end-start);
+  }
+  return true;
+}
+
+/*prints the change of each median from the baseline file, false if any is worse than the tolerance*/
+static bool compare_with_baseline(const Benchmark_Options & o, const Benchmark_Results & results){
+  ifstream in(o.m_baseline_file.c_str());
+  if(!in){
+    cerr << "Error: baseline " << o.m_baseline_file << " could not be opened" << endl;
+    exit(1);
+  }
+  vector<string> names;
+  vector<double> medians;
+  string line, format, name, value;
+  while(getline(in,line)){
+    if(read_field(line,"format",format) && format != BENCHMARK_FORMAT){
+      cerr << "Error: " << o.m_baseline_file << " was not written by this benchmark" << endl;
+      exit(1);
+    }
+    if(read_field(line,"name",name) && read_field(line,"median",value)){
+      names.push_back(name);
+      medians.push_back(atof(value.c_str()));
+    }
+  }
+
+  bool ok = true;
+  cerr << endl << setiosflags(ios::fixed) << setprecision(1);
+  cerr << left << setw(54) << "benchmark" << right << setw(14) << "baseline" << setw(14) << "current" << setw(10) << "change" << endl;
+  for(unsigned int i=0; i<results.size(); i++){
+    const Benchmark_Result & r = results[i];
+    double current = median(r.m_values);
+    unsigned int j = find(names.begin(),names.end(),r.m_name)-names.begin();
+    cerr << left << setw(54) << r.m_name + " (" + r.m_unit + ")" << right;
+    if(j == names.size()){
+      cerr << setw(14) << "-" << setw(14) << current << endl;
+      continue;
+    }
+    //positive is better, whichever way the unit goes
+    double change = r.m_higher_is_better ? current/medians[j]-1 : medians[j]/current-1;
+    bool worse = change < -o.m_tolerance;
+    ok = ok && !worse;
+    cerr << setw(14) << medians[j] << setw(14) << current << setw(9) << showpos << 100*change << "%" << noshowpos << (worse ? "  WORSE" : "") << endl;
+  }
+  return ok;
+}
+
+static void usage(char * programname, const Benchmark_Options & o, int status){
+  cerr << endl;
+  cerr << "Usage: " << programname << " [OPTIONS]" << endl;
+  cerr << endl;
+  cerr << "Times the sampling hot paths and writes the results as JSON." << endl;
+  cerr << endl;
+  cerr << "-h | --help              print this text and exit" << endl;
+  cerr << "-o | --output            file the results are written to (default = standard output)" << endl;
+  cerr << "-b | --baseline          results of an earlier run to compare with; the exit status is 1 if any" << endl;
+  cerr << "                         benchmark is worse than the tolerance" << endl;
+  cerr << "-T | --tolerance         fraction a benchmark may be worse than the baseline by (default = " << o.m_tolerance << ")" << endl;
+  cerr << "-f | --filter            only the benchmarks whose names contain this, of" << endl;
+  cerr << "                        ";
+  for(unsigned int b=0; b<NUM_BENCHMARKS; b++)
+    cerr << " " << BENCHMARKS[b].m_name;
+  cerr << endl;
+  cerr << "-r | --repeats           number of times each benchmark is run (default = " << o.m_repeats << ")" << endl;
+  cerr << "-x | --scale             multiplies the number of calls, iterations and particles, eg 0.1 for a quick run (default = " << o.m_scale << ")" << endl;
+  cerr << "-D | --datadir           directory of coal_data_renormalised.txt, shot_noise.txt and vastdata (default = " << o.m_data_directory << ")" << endl;
+  cerr << "-I | --individuals       number of vast data processes (default = " << o.m_individuals << ")" << endl;
+  cerr << "-p | --particles         vast data particles for each process (default = " << o.m_particles << ")" << endl;
+  cerr << "-t | --threads           vast data threads (default = " << o.m_num_threads << ")" << endl;
+  cerr << "-s | --seed              seed of the arguments and the samplers (default = " << o.m_seed << ")" << endl;
+  cerr << endl;
+  cerr << "Example:" << endl;
+  cerr << programname << " --output bench.json --baseline bench_baseline.json" << endl;
+  cerr << endl;
+  exit(status);
+}
+
+int main(int argc, char *argv[]){
+  Benchmark_Options o;
+  o.m_data_directory = ".";
+  o.m_tolerance = 0.1;
+  o.m_scale = 1;
+  o.m_repeats = 3;
+  o.m_individuals = 10;
+  o.m_particles = 100;
+  o.m_num_threads = 1;
+  o.m_seed = 0;
+
+  static struct option long_options[] = {
+    {"help",no_argument,NULL,'h'},
+    {"output",required_argument,NULL,'o'},
+    {"baseline",required_argument,NULL,'b'},
+    {"tolerance",required_argument,NULL,'T'},
+    {"filter",required_argument,NULL,'f'},
+    {"repeats",required_argument,NULL,'r'},
+    {"scale",required_argument,NULL,'x'},
+    {"datadir",required_argument,NULL,'D'},
+    {"individuals",required_argument,NULL,'I'},
+    {"particles",required_argument,NULL,'p'},
+    {"threads",required_argument,NULL,'t'},
+    {"seed",required_argument,NULL,'s'},
+    {NULL,0,NULL,0}
+  };
+  int opt;
+  while((opt = getopt_long(argc,argv,"ho:b:T:f:r:x:D:I:p:t:s:",long_options,NULL)) != -1){
+    switch(opt){
+    case 'h':
+      usage(argv[0],o,0);
+      break;
+    case 'o':
+      o.m_output_file = optarg;
+      break;
+    case 'b':
+      o.m_baseline_file = optarg;
+      break;
+    case 'T':
+      o.m_tolerance = atof(optarg);
+      break;
+    case 'f':
+      o.m_filter = optarg;
+      break;
+    case 'r':
+      o.m_repeats = atoi(optarg);
+      break;
+    case 'x':
+      o.m_scale = atof(optarg);
+      break;
+    case 'D':
+      o.m_data_directory = optarg;
+      break;
+    case 'I':
+      o.m_individuals = atoi(optarg);
+      break;
+    case 'p':
+      o.m_particles = atol(optarg);
+      break;
+    case 't':
+      o.m_num_threads = atoi(optarg);
+      break;
+    case 's':
+      o.m_seed = atoi(optarg);
+      break;
+    default:
+      usage(argv[0],o,1);
+    }
+  }
+  if(optind < argc || o.m_repeats < 1 || !(o.m_scale > 0) || !(o.m_tolerance >= 0) || o.m_individuals < 1 || o.m_particles < 1){
+    cerr << "Error: invalid arguments" << endl;
+    usage(argv[0],o,1);
+  }
+
+  gsl_rng * r = gsl_rng_alloc(gsl_rng_taus);
+  Benchmark_Results results;
+  for(unsigned int b=0; b<NUM_BENCHMARKS; b++){
+    if(!o.m_filter.empty() && string(BENCHMARKS[b].m_name).find(o.m_filter) == string::npos)
+      continue;
+    for(unsigned int k=0; k<o.m_repeats; k++){
+      cerr << BENCHMARKS[b].m_name << " " << k+1 << "/" << o.m_repeats << endl;
+      gsl_rng_set(r,o.m_seed);
+      BENCHMARKS[b].m_function(o,r,results);
+    }
+  }
+  gsl_rng_free(r);
+  if(!results.size()){
+    cerr << "Error: no benchmark matches " << o.m_filter << endl;
+    exit(1);
+  }
+
+  if(o.m_output_file.empty())
+    write_results(cout,o,results);
+  else{
+    ofstream out(o.m_output_file.c_str());
+    if(!out){
+      cerr << "Error: " << o.m_output_file << " could not be opened" << endl;
+      exit(1);
+    }
+    write_results(out,o,results);
+  }
+
+  if(!o.m_baseline_file.empty() && !compare_with_baseline(o,results))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include "histogram_file.hpp"
+using namespace std;
+
+/*the reader with the smallest key on top, the earlier file first between equal keys*/
+struct Later_Key{
+  vector<Histogram_File_Reader*> * readers;
+  bool operator()(unsigned int i, unsigned int j) const {
+    const vector<unsigned int> & a = (*readers)[i]->key();
+    const vector<unsigned int> & b = (*readers)[j]->key();
+    if(lexicographical_compare(b.begin(),b.end(),a.begin(),a.end()))
+      return true;
+    if(lexicographical_compare(a.begin(),a.end(),b.begin(),b.end()))
+      return false;
+    return i > j;
+  }
+};
+
+static void usage(char * programname){
+  cerr << endl;
+  cerr << "Usage: " << programname << " OUTPUTFILE INPUTFILE..." << endl;
+  cerr << endl;
+  cerr << "Adds together binary histogram files, eg those written by mainSMC_vastdata --histograms," << endl;
+  cerr << "reading each a bin at a time so that they never have to be held in memory." << endl;
+  cerr << "The input files must all hold counts or all hold weights." << endl;
+  cerr << endl;
+  cerr << "Example:" << endl;
+  cerr << programname << " combined.bin histogram.1.bin histogram.2.bin histogram.3.bin" << endl;
+  cerr << endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[]){
+  if(argc < 3)
+    usage(argv[0]);
+
+  vector<Histogram_File_Reader*> readers;
+  for(int a = 2; a < argc; a++){
+    readers.push_back(new Histogram_File_Reader(argv[a]));
+    if(!readers.back()->is_open()){
+      cerr << "Error: " << argv[a] << " could not be opened as a histogram file" << endl;
+      exit(1);
+    }
+    if(readers.back()->is_weighted() != readers[0]->is_weighted()){
+      cerr << "Error: " << argv[a] << " and " << argv[2] << " do not both hold counts or weights" << endl;
+      exit(1);
+    }
+  }
+  bool weighted = readers[0]->is_weighted();
+
+  Later_Key later_key;
+  later_key.readers = &readers;
+  priority_queue<unsigned int, vector<unsigned int>, Later_Key> heap(later_key);
+  for(unsigned int i = 0; i < readers.size(); i++)
+    if(readers[i]->next())
+      heap.push(i);
+
+  Histogram_File_Writer writer(argv[1],weighted);
+  if(!writer.is_open()){
+    cerr << "Error: " << argv[1] << " could not be opened" << endl;
+    exit(1);
+  }
+  vector<unsigned int> key;
+  unsigned long long int bins = 0;
+  while(!heap.empty()){
+    key = readers[heap.top()]->key();
+    unsigned long long int count = 0;
+    double weight = 0;
+    //the equal keys come off in file order, so the weights are always added up the same way
+    while(!heap.empty() && readers[heap.top()]->key() == key){
+      unsigned int i = heap.top();
+      heap.pop();
+      count += readers[i]->count();
+      weight += readers[i]->weight();
+      if(readers[i]->next())
+	heap.push(i);
+    }
+    const unsigned int * k = key.empty() ? NULL : &key[0];
+    if(!weighted)
+      writer.write_count(k,key.size(),count);
+    else
+      writer.write_weight(k,key.size(),weight);
+    bins++;
+  }
+
+  bool ok = writer.close();
+  for(unsigned int i = 0; i < readers.size(); i++){
+    if(readers[i]->failed()){
+      cerr << "Error: " << argv[i+2] << " is corrupt" << endl;
+      ok = false;
+    }
+    delete readers[i];
+  }
+  cerr << bins << " bins from " << argc-2 << " files written to " << argv[1] << endl;
+  return ok ? 0 : 1;
+}
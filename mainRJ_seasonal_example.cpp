@@ -66,6 +66,8 @@ int main(int argc, char *argv[])
   if(o.m_calculate_posterior_mean){
     rjpobject.calculate_intensity();
     rjpobject.initialise_function_of_interest(o.m_grid);
+    if(o.m_intensity_bands)
+      rjpobject.get_foi()->calculate_intensity_bands();
   }
 
   if(o.m_write_cps_to_file){
@@ -3,15 +3,172 @@
 #include "Poisson_process_model.hpp"
 #include <stdio.h>
 #include <iostream>
+#include <fstream>
 #include <stdlib.h>
 #include <getopt.h>
 #include "argument_options_smc.hpp"
 #include "probability_model.hpp"
 #include "SNCP.hpp"
 #include "function_of_interest.hpp"
+#include "checkpoint.hpp"
 #include "Univariate_regression_model.hpp"
+#include <sstream>
+#include <pthread.h>
 using namespace std;
 
+/*with --series the output files of each series are numbered, eg intensitySMC_3.txt*/
+static string series_file(const string & file, unsigned int series, bool numbered){
+  if(!numbered)
+    return file;
+  size_t dot = file.find_last_of('.');
+  stringstream name;
+  name << file.substr(0,dot) << "_" << series << file.substr(dot);
+  return name.str();
+}
+
+static const double variance_cp_prior = 0; //if using a prior on the Poisson process parameter for the changepoints
+static const bool dovariable = 0; //for doing a variable sample size approach
+static const bool calculate_online_estimate_number_of_cps = true;
+
+/*the sampler of the one process *pm set up from the options, the bins being kept for it by the caller*/
+static SMC_PP_MCMC * create_sampler(const ArgumentOptionsSMC & o, probability_model ** pm, int seed, unsigned int num_threads, unsigned int * num_proposal_histogram_bins){
+
+  SMC_PP_MCMC * SMCobj = new SMC_PP_MCMC(o.m_start, o.m_end, o.m_num_intervals,o.m_particles,o.m_particles,o.m_sample_sizes,o.m_cp_prior,variance_cp_prior,pm,1,dovariable,o.m_calculate_filtering_mean,calculate_online_estimate_number_of_cps,o.m_smcmc, o.m_rejection_sampling, seed);
+
+  if (o.m_spacing_prior) {
+    SMCobj->use_spacing_prior();
+  }
+
+  if (o.m_model == "ur") {
+    SMCobj->set_discrete_model();
+  }
+
+  if(o.m_importance_sampling && o.m_model != "sncp"){
+    SMCobj->do_importance_sampling();
+  }
+
+  if (o.m_prior_proposals) {
+    SMCobj->sample_from_prior();
+  }
+
+  if(o.m_calculate_filtering_mean){
+    SMCobj->initialise_function_of_interest(o.m_grid,0,0);
+    if(o.m_intensity_bands)
+      SMCobj->calculate_intensity_bands();
+    if(o.m_adaptive_grid)
+      SMCobj->use_adaptive_foi_grid();
+  }
+ 
+  if(!(o.m_disallow_empty_intervals_between_cps || o.m_model == "sncp")){
+    SMCobj->set_neighbouring_intervals(1);
+  }
+
+
+  if(o.m_model == "sncp"){
+    SMCobj->non_conjugate();
+    SMCobj->set_RJ_parameters(o.m_thinning,o.m_burnin,o.m_move_width,"Histogram",(void*)num_proposal_histogram_bins);
+  }else{
+    SMCobj->set_RJ_parameters(o.m_thinning,o.m_burnin,o.m_move_width);
+  }
+
+  SMCobj->set_look_back(1);
+
+  SMCobj->set_ESS_threshold(o.m_ESS_threshold);
+  SMCobj->set_resampling_type(o.m_resampling_type);
+  SMCobj->resample_every_interval(o.m_resample_every_interval);
+  SMCobj->set_num_threads(num_threads);
+  SMCobj->use_foi_difference_arrays(o.m_foi_difference_arrays);
+  SMCobj->set_rejection_block_size(o.m_rejection_block_size);
+  SMCobj->set_rejection_envelope(o.m_rejection_envelope);
+  SMCobj->set_history_horizon(o.m_history_horizon);
+  
+  if(o.m_print_ESS && !o.m_smcmc){
+    SMCobj->store_ESS();
+  }
+  return SMCobj;
+}
+
+/*the estimates of the sampler's one process, in files numbered by series if numbered*/
+static void write_estimates(SMC_PP_MCMC & SMCobj, const ArgumentOptionsSMC & o, unsigned int series, bool numbered){
+  if(o.m_calculate_filtering_mean){
+    SMCobj.print_intensity(0,series_file("intensitySMC.txt",series,numbered).c_str());
+  }
+
+  if(calculate_online_estimate_number_of_cps)
+    SMCobj.print_size_of_sample(0,series_file("kSMC.txt",series,numbered).c_str());
+  
+  if(calculate_online_estimate_number_of_cps)
+    SMCobj.print_last_changepoints(0,series_file("taukSMC.txt",series,numbered).c_str());
+
+  if (o.m_spacing_prior) {
+    SMCobj.print_zero_weights(0, series_file("number_zero_weights.txt",series,numbered).c_str());
+  }
+
+  if (o.m_rejection_sampling) {
+    SMCobj.print_rejection_sampling_acceptance_rates(0, series_file("acceptance_rates.txt",series,numbered).c_str());
+  }
+
+  if(o.m_print_ESS & !o.m_smcmc){
+    SMCobj.print_ESS(0,series_file("ess.txt",series,numbered).c_str());
+  }
+}
+
+/*the series are shared out a whole sampler at a time, each run on one thread with the seed
+  of the run plus the number of the series, so that its estimates do not depend on the threads*/
+struct Series_Worker{
+  const ArgumentOptionsSMC * o;
+  probability_model ** models;
+  unsigned int num_series;
+  unsigned int * num_proposal_histogram_bins;
+  unsigned int * next_series;
+  pthread_mutex_t * lock;
+};
+
+static void * series_thread(void * arg){
+  Series_Worker * worker = (Series_Worker*)arg;
+  unsigned int k;
+  while(true){
+    pthread_mutex_lock(worker->lock);
+    k = (*worker->next_series)++;
+    pthread_mutex_unlock(worker->lock);
+    if(k>=worker->num_series)
+      break;
+    SMC_PP_MCMC * SMCobj = create_sampler(*worker->o,&worker->models[k],worker->o->m_seed+k,1,worker->num_proposal_histogram_bins);
+    while(SMCobj->advance_interval());
+    write_estimates(*SMCobj,*worker->o,k,true);
+    delete SMCobj;
+  }
+  return NULL;
+}
+
+static void segment_series(const ArgumentOptionsSMC & o, probability_model ** models, unsigned int num_series, unsigned int * num_proposal_histogram_bins){
+  unsigned int num_threads = o.m_num_threads < num_series ? o.m_num_threads : num_series;
+  if(num_threads < 1)
+    num_threads = 1;
+  unsigned int next_series = 0;
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock,NULL);
+  Series_Worker worker;
+  worker.o = &o;
+  worker.models = models;
+  worker.num_series = num_series;
+  worker.num_proposal_histogram_bins = num_proposal_histogram_bins;
+  worker.next_series = &next_series;
+  worker.lock = &lock;
+  pthread_t * threads = new pthread_t[num_threads];
+  bool * started = new bool[num_threads];
+  //any series left by a thread which could not be started are picked up by the others
+  for(unsigned int t=1; t<num_threads; t++)
+    started[t] = pthread_create(&threads[t],NULL,series_thread,(void*)(&worker))==0;
+  series_thread((void*)(&worker));
+  for(unsigned int t=1; t<num_threads; t++)
+    if(started[t])
+      pthread_join(threads[t],NULL);
+  pthread_mutex_destroy(&lock);
+  delete [] started;
+  delete [] threads;
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -24,7 +181,7 @@ int main(int argc, char *argv[])
   if (o.m_model == "pregression") {
     dataobj_int = new Data<unsigned long long int>(o.m_datafile,false);
   } else {
-    dataobj = new Data<double>(o.m_datafile,false);
+    dataobj = new Data<double>(o.m_datafile,o.m_series);
   }
 
   if (o.m_model == "ur" || o.m_model == "pregression") {
@@ -33,13 +190,12 @@ int main(int argc, char *argv[])
     //    cout << o.m_end << endl;
   }
   probability_model * ppptr = NULL;
+  probability_model ** models = &ppptr;
+  ur_series_block * series_block = NULL;
   cout << "seed " << o.m_seed << endl;
 
-  double variance_cp_prior = 0; //if using a prior on the Poisson process parameter for the changepoints
-  bool dovariable = 0; //for doing a variable sample size approach
   unsigned int num_proposal_histgoram_bins = 40000/o.m_num_intervals; //number of proposal histogram bins for proposing changepoints in the the sncp model
   unsigned int number_of_data_processes = 1;
-  bool calculate_online_estimate_number_of_cps = true;
   bool estimate_var_in_ur = false;
   unsigned long long int* sample_sizes = NULL;
   //  sample_sizes = new unsigned long long int[o.m_num_intervals];
@@ -58,11 +214,23 @@ int main(int argc, char *argv[])
     }
    
   } else if (o.m_model == "ur") {
-    ppptr = new ur_model(o.m_gamma_prior_1,o.m_gamma_prior_2,o.m_v,dataobj);
-    if(estimate_var_in_ur)
-      static_cast<ur_model*>(ppptr)->estimate_variance();
-    if (o.m_prior_proposals) {
-      ppptr->use_random_mean(o.m_seed);
+    //the series are read into one block of running sums, shared by a model for each
+    if(o.m_series){
+      series_block = new ur_series_block(dataobj);
+      number_of_data_processes = series_block->get_num_series();
+      models = new probability_model*[number_of_data_processes];
+      cerr << "Number of series " << number_of_data_processes << endl;
+    }
+    for(unsigned int ds=0; ds<number_of_data_processes; ds++){
+      if(series_block)
+	models[ds] = new ur_model(o.m_gamma_prior_1,o.m_gamma_prior_2,o.m_v,series_block,ds);
+      else
+	models[ds] = new ur_model(o.m_gamma_prior_1,o.m_gamma_prior_2,o.m_v,dataobj);
+      if(estimate_var_in_ur)
+	static_cast<ur_model*>(models[ds])->estimate_variance();
+      if (o.m_prior_proposals) {
+	models[ds]->use_random_mean(o.m_seed+ds);
+      }
     }
   } else if (o.m_model == "pregression") {
     ppptr = new pp_model(dataobj_int,NULL,o.m_gamma_prior_1,o.m_gamma_prior_2);
@@ -88,87 +256,77 @@ int main(int argc, char *argv[])
   }
 
 
-  SMC_PP_MCMC SMCobj(o.m_start, o.m_end, o.m_num_intervals,o.m_particles,o.m_particles,o.m_sample_sizes,o.m_cp_prior,variance_cp_prior,(probability_model**)&ppptr,number_of_data_processes,dovariable,o.m_calculate_filtering_mean,calculate_online_estimate_number_of_cps,o.m_smcmc, o.m_rejection_sampling, o.m_seed);
-
-  if (o.m_spacing_prior) {
-    SMCobj.use_spacing_prior();
-  }
-
-  if (o.m_model == "ur") {
-    SMCobj.set_discrete_model();
-  }
-
-  if(o.m_importance_sampling && o.m_model != "sncp"){
-    SMCobj.do_importance_sampling();
+  if(series_block){
+    segment_series(o,models,number_of_data_processes,&num_proposal_histgoram_bins);
+    for(unsigned int ds=0; ds<number_of_data_processes; ds++)
+      delete models[ds];
+    delete [] models;
+    delete series_block;
+    delete dataobj;
+    return(0);
   }
 
-  if (o.m_prior_proposals) {
-    SMCobj.sample_from_prior();
-  }
+  SMC_PP_MCMC * SMCobj = create_sampler(o,&ppptr,o.m_seed,o.m_num_threads,&num_proposal_histgoram_bins);
 
-  if(o.m_calculate_filtering_mean){
-    SMCobj.initialise_function_of_interest(o.m_grid,0,0);
+  if(!o.m_checkpoint_file.empty() && o.m_smcmc){
+    cerr << "sequential MCMC runs cannot be checkpointed" << endl;
+    exit(1);
   }
- 
-  if(!(o.m_disallow_empty_intervals_between_cps || o.m_model == "sncp")){
-    SMCobj.set_neighbouring_intervals(1);
+  if(o.m_resume){
+    ifstream checkpoint(o.m_checkpoint_file.c_str(), ios::in | ios::binary);
+    if(!checkpoint){
+      cerr << "no checkpoint " << o.m_checkpoint_file << ", starting from the beginning" << endl;
+    }else if(!SMCobj->read_checkpoint(checkpoint)){
+      cerr << "checkpoint " << o.m_checkpoint_file << " could not be restored" << endl;
+      exit(1);
+    }else{
+      cerr << "resuming after interval " << SMCobj->get_num_intervals_completed() << endl;
+    }
   }
 
-
-  if(o.m_model == "sncp"){
-    SMCobj.non_conjugate();
-    SMCobj.set_RJ_parameters(o.m_thinning,o.m_burnin,o.m_move_width,"Histogram",(void*)(&num_proposal_histgoram_bins));
-  }else{
-    SMCobj.set_RJ_parameters(o.m_thinning,o.m_burnin,o.m_move_width);
+  //appended to on resume, the last record of an interval is the one which counts
+  ofstream telemetry;
+  if(!o.m_telemetry_file.empty()){
+    telemetry.open(o.m_telemetry_file.c_str(), o.m_resume ? ios::out | ios::app : ios::out);
+    if(!telemetry){
+      cerr << "Telemetry file " << o.m_telemetry_file << " could not be opened" << endl;
+      exit(1);
+    }
+    SMCobj->set_telemetry(telemetry);
   }
 
-  SMCobj.set_look_back(1);
-
-  SMCobj.set_ESS_threshold(o.m_ESS_threshold);
-  
-  if(o.m_print_ESS && !o.m_smcmc){
-    SMCobj.store_ESS();
+  //the checkpoints are written in the background while the next intervals run
+  Checkpoint_Writer checkpoints;
+  while(SMCobj->advance_interval()){
+    unsigned int completed = SMCobj->get_num_intervals_completed();
+    if(!o.m_checkpoint_file.empty() && completed%o.m_checkpoint_every == 0 && completed < (unsigned int)o.m_num_intervals){
+      SMCobj->write_checkpoint(checkpoints.begin());
+      checkpoints.commit(o.m_checkpoint_file);
+    }
   }
-
-  SMCobj.run_simulation_SMC_PP();
+  checkpoints.wait();
 
 
-  if(o.m_calculate_filtering_mean){
-    SMCobj.print_intensity(0,"intensitySMC.txt");
-  }
-
-  if(calculate_online_estimate_number_of_cps)
-    SMCobj.print_size_of_sample(0,"kSMC.txt");
-  
-  if(calculate_online_estimate_number_of_cps)
-    SMCobj.print_last_changepoints(0,"taukSMC.txt");
-  
+  write_estimates(*SMCobj,o,0,false);
 
   if(o.m_write_cps_to_file){
-    SMCobj.print_sample_A(0);
-    SMCobj.print_weights();
-    SMCobj.print_size_sample_A(0);
-    SMCobj.calculate_function_of_interest(o.m_start,o.m_end);
-    SMCobj.print_intensity(0,"finalintensitySMC.txt");
-  }
-
-  if (o.m_spacing_prior) {
-    SMCobj.print_zero_weights(0, "number_zero_weights.txt");
-  }
-
-  if (o.m_rejection_sampling) {
-    SMCobj.print_rejection_sampling_acceptance_rates(0, "acceptance_rates.txt");
+    SMCobj->print_sample_A(0);
+    SMCobj->print_weights();
+    SMCobj->print_size_sample_A(0);
+    //with a horizon the particles no longer hold the changepoints needed for the smoothed intensity
+    if(!o.m_history_horizon){
+      SMCobj->calculate_function_of_interest(o.m_start,o.m_end);
+      SMCobj->print_intensity(0,"finalintensitySMC.txt");
+    }
   }
 
-  if(o.m_print_ESS & !o.m_smcmc){
-    SMCobj.print_ESS(0,"ess.txt");
-  }
   if (dataobj)
     delete dataobj;
   //  if (dataobj_int)
   //    delete dataobj_int;
   if(sample_sizes)
     delete sample_sizes;
+  delete SMCobj;
   delete ppptr;  
   return(0);
 }
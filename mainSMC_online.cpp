@@ -0,0 +1,221 @@
+#include "SMC_PP_MCMC_nc.hpp"
+#include "Data.hpp"
+#include "Poisson_process_model.hpp"
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "argument_options_smc.hpp"
+#include "probability_model.hpp"
+#include "function_of_interest.hpp"
+using namespace std;
+
+/*Online version of mainSMC_example for the Poisson process model. Event times
+  are read one per line from DATAFILE as they arrive ("-" for stdin, or a named
+  pipe), and each interval of [STARTTIME,ENDTIME] is processed as soon as it
+  closes, either because an event at or beyond its end arrives or because the
+  line "tick" is read. Lines starting with # are ignored.
+
+  After each interval one line is written to stdout and flushed:
+  interval, end time, filtered intensity, expected number of changepoints,
+  expected last changepoint, time taken in milliseconds, particle budget.
+  With --latency, the number of new particles sampled on each interval is
+  adapted between --minparticles and --particles to meet the target.*/
+
+#define NUM_LATENCY_BUCKETS 32
+
+static double elapsed_ms(const struct timeval & t0, const struct timeval & t1){
+  return (t1.tv_sec-t0.tv_sec)*1000.0 + (t1.tv_usec-t0.tv_usec)/1000.0;
+}
+
+//bucket 0 holds latencies below 1ms, bucket b those in [2^(b-1),2^b)ms
+static unsigned int latency_bucket(double ms){
+  unsigned int b = 0;
+  double upper = 1;
+  while(ms >= upper && b < NUM_LATENCY_BUCKETS-1){
+    upper *= 2;
+    b++;
+  }
+  return b;
+}
+
+static void print_latency_histogram(const unsigned long long int * counts, const char * file){
+  ofstream outfile(file, ios::out);
+  if(!outfile){
+    cerr << file << " could not be opened" << endl;
+    return;
+  }
+  double upper = 1;
+  for(unsigned int b = 0; b < NUM_LATENCY_BUCKETS; b++){
+    outfile << upper << ' ' << counts[b] << endl;
+    upper *= 2;
+  }
+  outfile.close();
+}
+
+int main(int argc, char *argv[])
+{
+  ArgumentOptionsSMC o = ArgumentOptionsSMC();
+  o.parse(argc,argv);
+
+  if (o.m_model != "poisson") {
+    cerr << "mainSMC_online: only the poisson model can be run online" << endl;
+    exit(1);
+  }
+
+  istream * events = &cin;
+  ifstream eventfile;
+  if (o.m_datafile != "-") {
+    eventfile.open(o.m_datafile.c_str());
+    if (!eventfile.is_open()) {
+      cerr << "Error: " << o.m_datafile << " could not be opened." << endl;
+      exit(1);
+    }
+    events = &eventfile;
+  }
+
+  //starts empty and grows as events arrive
+  Data<double> * dataobj = new Data<double>((double*)NULL,1,0);
+  probability_model * ppptr = new pp_model(o.m_gamma_prior_1,o.m_gamma_prior_2,dataobj);
+  cerr << "seed " << o.m_seed << endl;
+
+  double variance_cp_prior = 0;
+  unsigned int number_of_data_processes = 1;
+  bool calculate_online_estimate_number_of_cps = true;
+
+  if (o.m_importance_sampling) {
+    ppptr->use_random_mean(o.m_seed);
+    if (o.m_prior_proposals) {
+      ppptr->use_prior_mean();
+    }
+  }
+  if (o.m_prior_proposals) {
+    o.m_rejection_sampling = true;
+    o.m_spacing_prior = false;
+  }
+  if (o.m_rejection_sampling && !o.m_prior_proposals) {
+    o.m_spacing_prior = true;
+  }
+
+  SMC_PP_MCMC SMCobj(o.m_start, o.m_end, o.m_num_intervals,o.m_particles,o.m_particles,NULL,o.m_cp_prior,variance_cp_prior,(probability_model**)&ppptr,number_of_data_processes,0,1,calculate_online_estimate_number_of_cps,o.m_smcmc, o.m_rejection_sampling, o.m_seed);
+
+  if (o.m_spacing_prior) {
+    SMCobj.use_spacing_prior();
+  }
+  if (o.m_importance_sampling) {
+    SMCobj.do_importance_sampling();
+  }
+  if (o.m_prior_proposals) {
+    SMCobj.sample_from_prior();
+  }
+  SMCobj.initialise_function_of_interest(o.m_grid,0,0);
+  if(o.m_intensity_bands)
+    SMCobj.calculate_intensity_bands();
+  if(o.m_adaptive_grid)
+    SMCobj.use_adaptive_foi_grid();
+  if (!o.m_disallow_empty_intervals_between_cps) {
+    SMCobj.set_neighbouring_intervals(1);
+  }
+  SMCobj.set_RJ_parameters(o.m_thinning,o.m_burnin,o.m_move_width);
+  SMCobj.set_look_back(1);
+  SMCobj.set_ESS_threshold(o.m_ESS_threshold);
+  SMCobj.set_resampling_type(o.m_resampling_type);
+  SMCobj.resample_every_interval(o.m_resample_every_interval);
+  SMCobj.set_num_threads(o.m_num_threads);
+  SMCobj.use_foi_difference_arrays(o.m_foi_difference_arrays);
+  SMCobj.set_rejection_block_size(o.m_rejection_block_size);
+  SMCobj.set_rejection_envelope(o.m_rejection_envelope);
+  SMCobj.set_history_horizon(o.m_history_horizon);
+
+  ofstream telemetry;
+  if (!o.m_telemetry_file.empty()) {
+    telemetry.open(o.m_telemetry_file.c_str(), ios::out);
+    if (!telemetry) {
+      cerr << "Telemetry file " << o.m_telemetry_file << " could not be opened" << endl;
+      exit(1);
+    }
+    SMCobj.set_telemetry(telemetry);
+  }
+
+  unsigned long long int max_budget = o.m_particles;
+  unsigned long long int min_budget = o.m_min_particles < o.m_particles ? o.m_min_particles : o.m_particles;
+  if (min_budget < 1) {
+    min_budget = 1;
+  }
+  unsigned long long int budget = max_budget;
+  unsigned long long int latency_counts[NUM_LATENCY_BUCKETS];
+  for (unsigned int b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+    latency_counts[b] = 0;
+  }
+
+  double width = (o.m_end-o.m_start)/(double)o.m_num_intervals;
+  unsigned int completed = 0;
+  double last_event = o.m_start;
+  vector<double> pending;
+  string line;
+  cout << "# interval end intensity k last_changepoint latency_ms particles" << endl;
+
+  while (completed < (unsigned int)o.m_num_intervals && getline(*events,line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    bool tick = line.compare(0,4,"tick") == 0;
+    double t = 0;
+    if (!tick) {
+      char * pend;
+      t = strtod(line.c_str(),&pend);
+      if (pend == line.c_str()) {
+        cerr << "mainSMC_online: ignoring line " << line << endl;
+        continue;
+      }
+      if (t < last_event) {
+        cerr << "mainSMC_online: ignoring out of order event " << t << endl;
+        continue;
+      }
+      last_event = t;
+    }
+    //close every interval which ends at or before this event
+    bool close = tick;
+    while (completed < (unsigned int)o.m_num_intervals && (close || t >= o.m_start+width*(completed+1))) {
+      if (!pending.empty()) {
+        dataobj->append(&pending[0],pending.size());
+        pending.clear();
+      }
+      SMCobj.set_particle_budget(budget < max_budget ? budget : 0);
+      struct timeval t0, t1;
+      gettimeofday(&t0,NULL);
+      SMCobj.advance_interval();
+      gettimeofday(&t1,NULL);
+      double latency = elapsed_ms(t0,t1);
+      latency_counts[latency_bucket(latency)]++;
+      double interval_end = o.m_start+width*(completed+1);
+      cout << completed << ' ' << interval_end << ' ' << SMCobj.get_intensity(0,interval_end) << ' '
+           << SMCobj.get_size_of_sample(0,completed) << ' ' << SMCobj.get_last_changepoint(0,completed) << ' '
+           << latency << ' ' << budget << endl;
+      completed++;
+      if (o.m_target_latency > 0) {
+        if (latency > o.m_target_latency) {
+          budget = budget*3/4 > min_budget ? budget*3/4 : min_budget;
+        } else if (latency < o.m_target_latency/2) {
+          budget = budget*5/4+1 < max_budget ? budget*5/4+1 : max_budget;
+        }
+      }
+      close = false;
+    }
+    if (!tick && completed < (unsigned int)o.m_num_intervals) {
+      pending.push_back(t);
+    }
+  }
+
+  print_latency_histogram(latency_counts,"latencySMC.txt");
+  SMCobj.print_intensity(0,"intensitySMC.txt");
+  SMCobj.print_size_of_sample(0,"kSMC.txt");
+  SMCobj.print_last_changepoints(0,"taukSMC.txt");
+
+  delete ppptr;
+  delete dataobj;
+  return(0);
+}
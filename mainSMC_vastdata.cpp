@@ -9,10 +9,57 @@
 #include <vector>
 #include <fstream>
 #include <map>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #include "SMC_PP_MCMC_nc.hpp"
 #include "argument_options_vastdata.hpp"
+#include "divergence_exchange.hpp"
+#include "checkpoint.hpp"
+#include "concurrent_histogram.hpp"
 using namespace std;
 
+//the final sample is binned in this many blocks for the JSD, whatever the number of threads
+static const unsigned int JSD_HISTOGRAM_SHARDS = 16;
+
+/*each worker writes its own checkpoints and telemetry*/
+static string worker_file(const string & file, unsigned int worker, unsigned int num_workers){
+  if(num_workers < 2)
+    return file;
+  stringstream name;
+  name << file << ".w" << worker;
+  return name.str();
+}
+
+/*the latest number of intervals completed for which every worker has a checkpoint, 0 if
+  there is none, and for each worker the generation of its checkpoint file holding it.
+  The workers write their checkpoints independently, so the newest ones may differ.*/
+static unsigned int common_checkpoint(const string & file, unsigned int num_workers, unsigned int generations, vector<int> & generation){
+  vector< map<unsigned int,int> > available(num_workers);
+  for(unsigned int w=0; w<num_workers; w++){
+    for(unsigned int g=0; g<generations; g++){
+      ifstream in(checkpoint_generation(worker_file(file,w,num_workers),g).c_str(), ios::in | ios::binary);
+      unsigned int interval;
+      if(in && SMC_PP_MCMC::read_checkpoint_interval(in,interval) && !available[w].count(interval))
+	available[w][interval] = g;
+    }
+  }
+  generation.assign(num_workers,-1);
+  map<unsigned int,int>::reverse_iterator it;
+  for(it=available[0].rbegin(); it!=available[0].rend(); ++it){
+    unsigned int w = 1;
+    while(w<num_workers && available[w].count(it->first))
+      w++;
+    if(w == num_workers){
+      for(w=0; w<num_workers; w++)
+	generation[w] = available[w][it->first];
+      return it->first;
+    }
+  }
+  return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -75,12 +122,104 @@ int main(int argc, char *argv[])
   }
   
   cerr<<"Total sample size: "<< o.m_particles << ",   Min. sample size: " << o.m_min_iterations<<endl;
+
+  /*with more than one worker the individuals are split into contiguous blocks, each run
+    by a forked worker process. This process only coordinates the variable sample sizes
+    and merges the sample size files.*/
+  unsigned int num_workers = o.m_num_workers < num_of_individuals ? o.m_num_workers : num_of_individuals;
+  if(num_workers < 1)
+    num_workers = 1;
+  unsigned int worker = 0;
+  Divergence_Exchange * exchange = NULL;
+
+  /*the workers only keep in step over the variable sample sizes, so one may be a couple
+    of checkpoints ahead of another when the run stops. Keeping three generations of each
+    worker's checkpoint leaves one they all have.*/
+  unsigned int checkpoint_generations = num_workers > 1 ? 3 : 1;
+  vector<int> resume_generation(num_workers,-1);
+  unsigned int resume_interval = 0;
+  if(o.m_resume){
+    resume_interval = common_checkpoint(o.m_checkpoint_file,num_workers,checkpoint_generations,resume_generation);
+    if(resume_interval)
+      cerr << "resuming after interval " << resume_interval << endl;
+    else
+      cerr << "no checkpoint " << o.m_checkpoint_file << " to resume from, starting from the beginning" << endl;
+  }
+  if(num_workers > 1){
+    int * fds = new int[num_workers];
+    pid_t * pids = new pid_t[num_workers];
+    for(unsigned int w=0; w<num_workers && !exchange; w++){
+      int sv[2];
+      if(socketpair(AF_UNIX,SOCK_STREAM,0,sv)){
+	cerr << "mainSMC_vastdata: could not create a socket for worker " << w << endl;
+	exit(1);
+      }
+      pids[w] = fork();
+      if(pids[w] < 0){
+	cerr << "mainSMC_vastdata: could not start worker " << w << endl;
+	exit(1);
+      }
+      if(pids[w] == 0){
+	for(unsigned int v=0; v<w; v++)
+	  close(fds[v]);
+	close(sv[0]);
+	exchange = new Socket_Divergence_Exchange(sv[1]);
+	worker = w;
+      }else{
+	close(sv[1]);
+	fds[w] = sv[0];
+      }
+    }
+    if(!exchange){
+      bool failed = !o.m_fixed_sample_size && !share_out_iterations(fds,num_workers,o.m_num_intervals-resume_interval,o.m_particles);
+      for(unsigned int w=0; w<num_workers; w++)
+	close(fds[w]);
+      for(unsigned int w=0; w<num_workers; w++){
+	int status;
+	if(waitpid(pids[w],&status,0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)){
+	  cerr << "mainSMC_vastdata: worker " << w << " failed" << endl;
+	  failed = true;
+	}
+      }
+      if(!failed && !o.m_fixed_sample_size){
+	for(unsigned int run=1; run<=num_runs; run++){
+	  stringstream out_i_sample_sizes;
+	  out_i_sample_sizes << "sample_sizes_";
+	  if ( num_runs > 1 ) {
+	    out_i_sample_sizes << run;
+	  }
+	  ofstream merged((out_i_sample_sizes.str()+".txt").c_str(), ios::out);
+	  for(unsigned int w=0; w<num_workers; w++){
+	    stringstream worker_file;
+	    worker_file << out_i_sample_sizes.str() << "worker" << w << ".txt";
+	    ifstream in(worker_file.str().c_str());
+	    merged << in.rdbuf();
+	    in.close();
+	    remove(worker_file.str().c_str());
+	  }
+	}
+      }
+      delete [] fds;
+      delete [] pids;
+      return(failed ? 1 : 0);
+    }
+    delete [] fds;
+    delete [] pids;
+  }
+  unsigned int first_individual = (unsigned int)(((unsigned long long int)worker*num_of_individuals)/num_workers);
+  unsigned int num_local = (unsigned int)(((unsigned long long int)(worker+1)*num_of_individuals)/num_workers) - first_individual;
+  unsigned long int particles = o.m_particles;
+  if(!o.m_fixed_sample_size){
+    particles = (o.m_particles/num_of_individuals)*num_local;
+  }
+  //the JSD is calculated from the first individual
+  calculate_KL = calculate_KL && first_individual == 0;
   
   vector<string> f;
-  probability_model ** ppptr = new probability_model*[num_of_individuals];
-  for(unsigned int i=0; i<num_of_individuals; i++){
+  probability_model ** ppptr = new probability_model*[num_local];
+  for(unsigned int i=0; i<num_local; i++){
     f.erase(f.begin(),f.end());  
-    f.push_back(filenames[i]);
+    f.push_back(filenames[first_individual+i]);
     f.push_back("timescale.txt");
     f.push_back("seasonality.txt");
     ppptr[i] = new pp_model(&f,o.m_gamma_prior_1,o.m_gamma_prior_2,o.m_start,o.m_end,1);
@@ -88,8 +227,18 @@ int main(int argc, char *argv[])
 
   filenames.erase(filenames.begin(),filenames.end()); 
 
+  if(!o.m_p_value_file.empty()){
+    vector<double> * dfs = new vector<double>[num_local];
+    double increment = (o.m_end-o.m_start)/o.m_num_intervals;
+    probability_model::calculate_window_log_predictive_dfs_of_models(ppptr,num_local,o.m_start,o.m_end,increment,true,false,dfs,o.m_num_threads);
+    if(!probability_model::write_p_values(worker_file(o.m_p_value_file,worker,num_workers),o.m_start,increment,dfs,num_local,first_individual))
+      exit(1);
+    delete [] dfs;
+  }
+
   Histogram_Type<changepoint> combined_histogram(o.m_start,o.m_end,o.m_num_bins,(o.m_end-o.m_start)/o.m_num_bins,true,true,true,0);
   Histogram_Type<changepoint> current_histogram(o.m_start,o.m_end,o.m_num_bins,(o.m_end-o.m_start)/o.m_num_bins,true,true,true,0);
+  Concurrent_Histogram<changepoint> current_shards(o.m_start,o.m_end,o.m_num_bins,(o.m_end-o.m_start)/o.m_num_bins,true,true,true,0,JSD_HISTOGRAM_SHARDS);
   double sum_entropy=0;
  
   SMC_PP_MCMC * SMCobj = NULL;
@@ -104,9 +253,13 @@ int main(int argc, char *argv[])
   for(unsigned int run=1; run<=num_runs; run++){
     unsigned int seed = o.m_seed * run;
 
-    SMCobj = new SMC_PP_MCMC(o.m_start, o.m_end, o.m_num_intervals, o.m_particles, o.m_particles, sample_sizes?&sample_sizes:NULL, o.m_cp_prior, 0, ppptr, num_of_individuals, !o.m_fixed_sample_size, o.m_calculate_filtering_mean, calculate_online_estimate_number_of_cps, SMCMC, 0, seed);
+    SMCobj = new SMC_PP_MCMC(o.m_start, o.m_end, o.m_num_intervals, particles, particles, sample_sizes?&sample_sizes:NULL, o.m_cp_prior, 0, ppptr, num_local, !o.m_fixed_sample_size, o.m_calculate_filtering_mean, calculate_online_estimate_number_of_cps, SMCMC, 0, seed);
 
     SMCobj->initialise_function_of_interest(o.m_grid, calculate_g, calculate_prob_g, set_delta, delta, 0);
+    if(o.m_intensity_bands)
+      SMCobj->calculate_intensity_bands();
+    if(o.m_adaptive_grid)
+      SMCobj->use_adaptive_foi_grid();
 
     if (!o.m_fixed_sample_size) {
       SMCobj->store_sample_sizes();
@@ -124,12 +277,47 @@ int main(int argc, char *argv[])
     SMCobj->set_look_back(1);
 
     SMCobj->set_ESS_threshold(o.m_ESS_threshold);
+    SMCobj->set_resampling_type(o.m_resampling_type);
+    SMCobj->resample_every_interval(o.m_resample_every_interval);
+    SMCobj->set_num_threads(o.m_num_threads);
+    SMCobj->use_foi_difference_arrays(o.m_foi_difference_arrays);
+    SMCobj->set_divergence_exchange(exchange);
 
     if(o.m_print_ESS && !SMCMC){
       SMCobj->store_ESS();
     }
   
-    SMCobj->run_simulation_SMC_PP();
+    string checkpoint_file = worker_file(o.m_checkpoint_file,worker,num_workers);
+    if(resume_generation[worker] >= 0){
+      ifstream checkpoint(checkpoint_generation(checkpoint_file,resume_generation[worker]).c_str(), ios::in | ios::binary);
+      if(!SMCobj->read_checkpoint(checkpoint)){
+	cerr << "checkpoint " << checkpoint_generation(checkpoint_file,resume_generation[worker]) << " could not be restored" << endl;
+	exit(1);
+      }
+    }
+
+    //appended to on resume, the last record of an interval is the one which counts
+    ofstream telemetry;
+    if(!o.m_telemetry_file.empty()){
+      string telemetry_file = worker_file(o.m_telemetry_file,worker,num_workers);
+      telemetry.open(telemetry_file.c_str(), o.m_resume ? ios::out | ios::app : ios::out);
+      if(!telemetry){
+	cerr << "Telemetry file " << telemetry_file << " could not be opened" << endl;
+	exit(1);
+      }
+      SMCobj->set_telemetry(telemetry,first_individual);
+    }
+
+    //the checkpoints are written in the background while the next intervals run
+    Checkpoint_Writer checkpoints(checkpoint_generations);
+    while(SMCobj->advance_interval()){
+      unsigned int completed = SMCobj->get_num_intervals_completed();
+      if(!o.m_checkpoint_file.empty() && completed%o.m_checkpoint_every == 0 && completed < (unsigned int)o.m_num_intervals){
+	SMCobj->write_checkpoint(checkpoints.begin());
+	checkpoints.commit(checkpoint_file);
+      }
+    }
+    checkpoints.wait();
 
     if(!o.m_fixed_sample_size){
       stringstream out_i_sample_sizes;
@@ -139,6 +327,9 @@ int main(int argc, char *argv[])
       if ( num_runs > 1 ) {
 	out_i_sample_sizes << run;
       }
+      if ( exchange ) {
+	out_i_sample_sizes << "worker" << worker;
+      }
       out_i_sample_sizes << ".txt";
       filename=out_i_sample_sizes.str();
       SMCobj->print_variable_sample_sizes(filename.c_str());
@@ -163,8 +354,8 @@ int main(int argc, char *argv[])
     
     if (o.m_calculate_filtering_mean) {
       stringstream out_i;
-      for(unsigned int ds=0; ds<num_of_individuals; ds++){
-	out_i << "intensity_" << ds;
+      for(unsigned int ds=0; ds<num_local; ds++){
+	out_i << "intensity_" << first_individual+ds;
 	if (num_runs > 1) {
 	  out_i << "_run_" << run;
 	}
@@ -176,8 +367,8 @@ int main(int argc, char *argv[])
 
     if (o.m_print_ESS) {
       stringstream out_e;
-      for (unsigned int ds = 0; ds < num_of_individuals; ds++) {
-	out_e << "ess_" << ds ;
+      for (unsigned int ds = 0; ds < num_local; ds++) {
+	out_e << "ess_" << first_individual+ds ;
 	if (num_runs > 1) {
 	  out_e << "_run_" << run;
 	}
@@ -187,30 +378,40 @@ int main(int argc, char *argv[])
       }
     }
 
-    if(calculate_KL){
+    if(calculate_KL || !o.m_histogram_file.empty()){
       unsigned long long int* num_samples =  SMCobj->get_final_sample_size();
       Particle<changepoint> *** samples = SMCobj->get_sample();
       SMCobj->normalise_weights();
       double ** weights = SMCobj->get_sample_weights();
-      for(unsigned long long int i=0; i<num_samples[0]; i++){
-	current_histogram.calculate_bin(samples[0][i],samples[0][i]->get_dim_theta());
-	current_histogram.increment_bin_counts(NULL,weights[0][i]*num_samples[0]);
+      current_shards.bin_particles(samples[0],weights[0],num_samples[0],num_samples[0],o.m_num_threads);
+      current_shards.reduce(&current_histogram);
+      if(!o.m_histogram_file.empty()){
+	stringstream out_h;
+	out_h << o.m_histogram_file;
+	if (num_runs > 1) {
+	  out_h << "." << run;
+	}
+	current_histogram.write_histogram_to_binary_file(worker_file(out_h.str(),worker,num_workers));
+      }
+      if(calculate_KL){
+	sum_entropy+=current_histogram.get_shannon_entropy();
+	combined_histogram.add_histogram(&current_histogram);
+	if(track_KL)
+	  cout << combined_histogram.get_shannon_entropy()-sum_entropy/(double)run << endl;//comment out if tracking of JSD not wanted
       }
-      sum_entropy+=current_histogram.get_shannon_entropy();
-      combined_histogram.add_histogram(&current_histogram);
       current_histogram.reset();
-      if(track_KL)
-	cout << combined_histogram.get_shannon_entropy()-sum_entropy/(double)run << endl;//comment out if tracking of JSD not wanted
     }
   
 
     delete SMCobj;
   }
 
-  for(unsigned int i=0; i<num_of_individuals; i++){
+  for(unsigned int i=0; i<num_local; i++){
     delete ppptr[i];
   }
   delete [] ppptr;
+  if(exchange)
+    delete exchange;
   
   if(!o.m_fixed_sample_size){
     mc_divergence::delete_lookup_arrays(divergence_type);
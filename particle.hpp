@@ -40,6 +40,11 @@ class Particle
   long double get_weight(){ return m_log_weight; }
   unsigned int get_birth_time(){ return m_birth_time; }
   bool does_particle_exist(T *);
+  void retire_components(unsigned int);
+  unsigned int get_num_retired() const {return m_num_retired;}
+  void set_num_retired(unsigned int n) {m_num_retired = n;}
+  /*particles constructed so far, on any thread*/
+  static unsigned long long int get_num_allocated() {return __sync_fetch_and_add(&m_num_allocated,0);}
 
 
  protected:
@@ -50,32 +55,35 @@ class Particle
   double m_log_posterior;
   long double m_log_weight;
   unsigned int m_birth_time;
-  static int particleCount;
+  unsigned int m_num_retired;//components dropped from the front of m_theta by retire_components
+  static unsigned long long int m_num_allocated;
   void sort( T **, unsigned int);
   void swap( T * const, T * const);
 
 };
 
-template<class T> 
-int Particle<T>::particleCount=0;
 
+template <class T>
+unsigned long long int Particle<T>::m_num_allocated = 0;
 
 template <class T>
 Particle<T>::Particle(int k,T ** thetaarray, T* thetaintercept, unsigned int birth_time)
 :m_dim_theta(k)
 {
+  __sync_fetch_and_add(&m_num_allocated,1);
   settheta(thetaarray);
 
   m_intercept = thetaintercept;
   
   m_birth_time=birth_time;
-  ++ particleCount;
+  m_num_retired=0;
 }
 
 
 template <class T>
 Particle<T>::Particle(const Particle *particle1, const Particle *particle2, unsigned int birth_time)
 {
+  __sync_fetch_and_add(&m_num_allocated,1);
 
   if(particle2==NULL){
     m_dim_theta=particle1->m_dim_theta;
@@ -101,11 +109,13 @@ Particle<T>::Particle(const Particle *particle1, const Particle *particle2, unsi
 
     }
     m_log_posterior = particle1->m_log_posterior;
+    m_num_retired = particle1->m_num_retired;
   }else{
     if (particle1->m_intercept!=NULL && particle2->m_intercept !=NULL){
       m_intercept = new T;
             
-      if (*(particle1->m_intercept)< *(particle2->m_intercept)){
+      //a truncated particle1 keeps its own intercept, the segment it starts is continued by particle2
+      if (particle1->m_num_retired || *(particle1->m_intercept)< *(particle2->m_intercept)){
 	*m_intercept = *(particle1->m_intercept);
       }
        
@@ -145,6 +155,7 @@ Particle<T>::Particle(const Particle *particle1, const Particle *particle2, unsi
     }
 
     m_log_posterior = particle1->m_log_posterior + particle2->m_log_posterior;
+    m_num_retired = particle1->m_num_retired + particle2->m_num_retired;
 
   }
   
@@ -153,7 +164,6 @@ Particle<T>::Particle(const Particle *particle1, const Particle *particle2, unsi
   else
     m_birth_time=birth_time;
   
-  ++particleCount;
 }
 
 template <class T>
@@ -170,8 +180,6 @@ Particle<T>::~Particle()
   if(m_intercept){
     delete m_intercept;
   }
-      
-  --particleCount;
 }
 
 
@@ -322,6 +330,35 @@ unsigned int Particle<T>::find_position(T * new_theta, bool bisection,  unsigned
   return m_dim_theta +1;
 }
 
+/*drop the first n components, the last of them becomes the intercept so that the
+  likelihood and mean of the segment it starts are kept*/
+template <class T>
+void Particle<T>::retire_components(unsigned int n)
+{
+  if (n>m_dim_theta)
+    n=m_dim_theta;
+  if (n==0)
+    return;
+
+  if (m_intercept)
+    delete m_intercept;
+  m_intercept = m_theta[n-1];
+  for (unsigned int i=0; i<n-1; i++)
+    delete m_theta[i];
+
+  T ** temp_theta=m_theta;
+  m_dim_theta-=n;
+  if (m_dim_theta==0){
+    m_theta=NULL;
+  }else{
+    m_theta = new T*[m_dim_theta];
+    for (unsigned int i=0; i<m_dim_theta; i++)
+      m_theta[i]=temp_theta[i+n];
+  }
+  delete [] temp_theta;
+  m_num_retired+=n;
+}
+
 template<class T>
 bool Particle<T>::does_particle_exist(T* new_theta) {
   for (unsigned int j = 0; j < m_dim_theta; j++) {
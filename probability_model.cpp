@@ -1,4 +1,12 @@
 #include "probability_model.hpp"
+#include "checkpoint.hpp"
+#include <pthread.h>
+
+//jittered p-values are combined exactly up to this many, by quasi Monte Carlo beyond
+static const unsigned int EXACT_P_VALUE_COMBINATION_LIMIT = 512;
+static const unsigned int QMC_P_VALUE_SHIFTS = 8;
+static const unsigned int QMC_P_VALUE_BLOCK = 256;
+static const double QMC_P_VALUE_RELATIVE_ERROR = 1e-3;
 
 bool probability_model::m_seasonal_analysis = false;
 bool probability_model::m_p_value_alternative_style = false;
@@ -75,6 +83,42 @@ void probability_model::construct(){
   m_pvalue_pair_on_log_scale = false;
 }
 
+void probability_model::log_likelihood_intervals_with_count(unsigned long long int n, const double * t1, const double * t2, const unsigned long long int * r, double * ll){
+  for(unsigned long long int i=0; i<n; i++)
+    ll[i] = log_likelihood_interval_with_count(t1[i],t2[i],r[i]);
+}
+
+void probability_model::write_state(ostream & out) const{
+  bool has_rng = m_rng!=NULL;
+  checkpoint_write(out,has_rng);
+  if(has_rng)
+    checkpoint_write_rng(out,m_rng);
+}
+
+bool probability_model::read_state(istream & in){
+  bool has_rng;
+  if(!checkpoint_read(in,has_rng))
+    return false;
+  if(!has_rng)
+    return true;
+  if(!m_rng)
+    m_rng = gsl_rng_alloc(gsl_rng_taus);
+  return checkpoint_read_rng(in,m_rng);
+}
+
+//called on a member-wise copy: the original keeps ownership of the data and scales
+void probability_model::release_shared_ownership(){
+  m_owner_of_data = m_owner_of_seasonal_scale = m_owner_of_time_scale = false;
+  m_rng = NULL;
+  if(m_data_seasons){
+    unsigned int num_cols = m_data_cont ? m_data_cont->get_cols() : 0;
+    unsigned int* data_seasons = new unsigned int[ num_cols ];
+    for(unsigned int i = 0; i < num_cols; i++)
+      data_seasons[i] = m_data_seasons[i];
+    m_data_seasons = data_seasons;
+  }
+}
+
 void probability_model::construct_time_scale(vector<string>* data_filenames, double season){
   m_time_scale = NULL;
   if(data_filenames && data_filenames->size()>1){
@@ -170,6 +214,237 @@ double probability_model::get_two_sided_discrete_p_value( unsigned int x ){
   return m_log_predictive_df;
 }
 
+/*the terms m[k] = E[U(-log U)^k]/k!, k<n, for U uniform between exp(log_a) and exp(log_b), up to the
+  returned log factor. With L = -log U these are integrals of exp(-2l)l^k/k! over [-log_b,-log_a],
+  which satisfy D_k = (b^2(-log b)^k - a^2(-log a)^k)/(2k!) + D_{k-1}/2; each term is kept relative
+  to the largest, so endpoints far into the tail neither overflow nor underflow.*/
+static double jittered_p_value_moments( double log_a, double log_b, unsigned int n, const vector<double> & log_factorial, vector<double> & m ){
+  double ratio = exp(log_a-log_b);//a/b
+  bool point = 1-ratio <= 1e-6;
+  double beta_b = point ? -(log_b+log((1+ratio)/2)) : -log_b;
+  double beta_a = -log_a;
+  //the largest of the b^2 beta_b^k/k! and a^2 beta_a^k/k! relative to b^2, which the terms are scaled by
+  double log_scale = 0;
+  for(unsigned int k = 1; k < n; k++){
+    if(beta_b > 0 && k*log(beta_b)-log_factorial[k] > log_scale)
+      log_scale = k*log(beta_b)-log_factorial[k];
+    if(!point && ratio > 0 && 2*log(ratio)+k*log(beta_a)-log_factorial[k] > log_scale)
+      log_scale = 2*log(ratio)+k*log(beta_a)-log_factorial[k];
+  }
+  for(unsigned int k = 0; k < n; k++){
+    double tb = k == 0 ? exp(-log_scale) : (beta_b > 0 ? exp(k*log(beta_b)-log_factorial[k]-log_scale) : 0);
+    if(point){
+      m[k] = tb;
+      continue;
+    }
+    double ta = ratio > 0 ? exp(2*log(ratio)+(k == 0 ? 0 : k*log(beta_a)-log_factorial[k])-log_scale) : 0;
+    m[k] = (tb-ta+(k > 0 ? m[k-1] : 0))/2;
+  }
+  //D_k = b^2 exp(log_scale) m[k], divided by b-a
+  if(point)
+    return log_b+log((1+ratio)/2)+log_scale;
+  return log_b-log1p(-ratio)+log_scale;
+}
+
+double probability_model::combine_jittered_p_values_exactly( const vector<double> & log_lower, const vector<double> & log_upper ){
+  /*with each p-value U_i uniform between its endpoints, the chi-squared survivor function of the
+    Fisher statistic is P sum_{k<n} S^k/k!, P the product of the U_i and S = -log P. Its expectation
+    is the sum of the first n coefficients of the product of the series sum_k E[U_i(-log U_i)^k]z^k/k!.*/
+  unsigned int n = log_lower.size();
+  vector<double> log_factorial(n,0), m(n), product(n,0), next(n);
+  for(unsigned int k = 1; k < n; k++)
+    log_factorial[k] = log_factorial[k-1]+log((double)k);
+  product[0] = 1;
+  double log_scale = 0;
+  for(unsigned int i = 0; i < n; i++){
+    log_scale += jittered_p_value_moments(log_lower[i],log_upper[i],n,log_factorial,m);
+    double largest = 0;
+    for(unsigned int k = 0; k < n; k++){
+      double sum = 0;
+      for(unsigned int j = 0; j <= k; j++)
+	sum += product[j]*m[k-j];
+      next[k] = sum;
+      if(sum > largest)
+	largest = sum;
+    }
+    if(!(largest > 0))
+      return -DBL_MAX;
+    for(unsigned int k = 0; k < n; k++)
+      product[k] = next[k]/largest;
+    log_scale += log(largest);
+  }
+  double sum = 0;
+  for(unsigned int k = 0; k < n; k++)
+    sum += product[k];
+  return log(sum)+log_scale;
+}
+
+//log of the chi-squared survivor function with 2n degrees of freedom at 2s, exp(-s) sum_{k<n} s^k/k!
+static double log_fisher_survivor( double s, unsigned int n, const vector<double> & log_factorial ){
+  if(!(s > 0))
+    return 0;
+  double log_s = log(s), largest = -DBL_MAX;
+  for(unsigned int k = 0; k < n; k++)
+    if(k*log_s-log_factorial[k] > largest)
+      largest = k*log_s-log_factorial[k];
+  double sum = 0;
+  for(unsigned int k = 0; k < n; k++)
+    sum += exp(k*log_s-log_factorial[k]-largest);
+  return -s+largest+log(sum);
+}
+
+double probability_model::combine_jittered_p_values_by_qmc( const vector<double> & log_lower, const vector<double> & log_upper, unsigned int max_samples ){
+  /*a Kronecker lattice with the generalised golden ratio of the dimension (Roberts' R_d sequence),
+    under independent random shifts; the spread of the estimates of the shifts gives the standard
+    error, and the sampling stops once that is small or max_samples points have been used. The
+    averages are kept on the log scale, so that combinations far into the tail do not underflow.*/
+  unsigned int n = log_lower.size();
+  if( !m_rng){
+    m_rng = gsl_rng_alloc(gsl_rng_taus);
+    gsl_rng_set (m_rng,0);
+  }
+  double phi = 2;
+  for(unsigned int i = 0; i < 50; i++)
+    phi = pow(1+phi,1.0/(n+1));
+  vector<double> lower(n), width(n), alpha(n), points(QMC_P_VALUE_SHIFTS*n), log_factorial(n,0);
+  for(unsigned int i = 0; i < n; i++){
+    lower[i] = exp(log_lower[i]);
+    width[i] = exp(log_upper[i])-lower[i];
+    alpha[i] = fmod(pow(phi,-(double)(i+1)),1.0);
+    if(i > 0)
+      log_factorial[i] = log_factorial[i-1]+log((double)i);
+  }
+  for(unsigned int i = 0; i < points.size(); i++)
+    points[i] = gsl_rng_uniform(m_rng);
+  vector<double> log_sums(QMC_P_VALUE_SHIFTS,-DBL_MAX);
+  unsigned int count = 0;
+  double log_mean;
+  while(true){
+    for(unsigned int r = 0; r < QMC_P_VALUE_SHIFTS; r++){
+      double * u = &points[r*n];
+      for(unsigned int j = 0; j < QMC_P_VALUE_BLOCK; j++){
+	double sum_log_pvals = 0;
+	for(unsigned int i = 0; i < n; i++){
+	  sum_log_pvals += log(lower[i]+width[i]*u[i]);
+	  u[i] += alpha[i];
+	  if(u[i] >= 1)
+	    u[i] -= 1;
+	}
+	double l = log_fisher_survivor(-sum_log_pvals,n,log_factorial);
+	log_sums[r] = log_sums[r] > l ? log_sums[r]+log1p(exp(l-log_sums[r])) : l+log1p(exp(log_sums[r]-l));
+      }
+    }
+    count += QMC_P_VALUE_BLOCK;
+    //the estimates of the shifts relative to the largest
+    double largest = *max_element(log_sums.begin(),log_sums.end());
+    double mean = 0, variance = 0;
+    for(unsigned int r = 0; r < QMC_P_VALUE_SHIFTS; r++)
+      mean += exp(log_sums[r]-largest);
+    mean /= QMC_P_VALUE_SHIFTS;
+    for(unsigned int r = 0; r < QMC_P_VALUE_SHIFTS; r++)
+      variance += (exp(log_sums[r]-largest)-mean)*(exp(log_sums[r]-largest)-mean);
+    variance /= QMC_P_VALUE_SHIFTS*(QMC_P_VALUE_SHIFTS-1.0);
+    log_mean = largest+log(mean)-log((double)count);
+    if(sqrt(variance) <= QMC_P_VALUE_RELATIVE_ERROR*mean || (unsigned long long int)count*QMC_P_VALUE_SHIFTS >= max_samples)
+      break;
+  }
+  return log_mean;
+}
+
+struct Window_Scoring_Worker{
+  probability_model ** models;
+  unsigned int num_models;
+  double start, end, increment;
+  bool lower_tail, two_sided;
+  vector<double>* dfs;
+  unsigned int * next_model;
+  pthread_mutex_t * lock;
+};
+
+static void * window_scoring_thread(void * arg){
+  Window_Scoring_Worker * worker = (Window_Scoring_Worker*)arg;
+  unsigned int i;
+  while(true){
+    pthread_mutex_lock(worker->lock);
+    i = (*worker->next_model)++;
+    pthread_mutex_unlock(worker->lock);
+    if(i>=worker->num_models)
+      break;
+    worker->models[i]->calculate_window_log_predictive_dfs(worker->start,worker->end,worker->increment,worker->lower_tail,worker->two_sided,&worker->dfs[i]);
+  }
+  return NULL;
+}
+
+void probability_model::calculate_window_log_predictive_dfs_of_models(probability_model ** models, unsigned int num_models, double start, double end, double increment, bool lower_tail, bool two_sided, vector<double>* dfs, unsigned int num_threads ){
+  //waiting time p-values step through the shared current time, so those models take turns
+  if(m_p_value_alternative_style){
+    for(unsigned int i=0; i<num_models; i++)
+      models[i]->calculate_sequential_log_predictive_dfs(start,end,increment,lower_tail,two_sided,0.05,NULL,&dfs[i]);
+    return;
+  }
+  unsigned int next_model = 0;
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock,NULL);
+  Window_Scoring_Worker worker;
+  worker.models = models;
+  worker.num_models = num_models;
+  worker.start = start;
+  worker.end = end;
+  worker.increment = increment;
+  worker.lower_tail = lower_tail;
+  worker.two_sided = two_sided;
+  worker.dfs = dfs;
+  worker.next_model = &next_model;
+  worker.lock = &lock;
+  if(num_threads > num_models)
+    num_threads = num_models;
+  //any models left by a thread which could not be started are picked up by the others
+  pthread_t * threads = new pthread_t[num_threads+1];
+  bool * started = new bool[num_threads+1];
+  for(unsigned int t=1; t<num_threads; t++)
+    started[t] = pthread_create(&threads[t],NULL,window_scoring_thread,(void*)&worker)==0;
+  window_scoring_thread((void*)&worker);
+  for(unsigned int t=1; t<num_threads; t++)
+    if(started[t])
+      pthread_join(threads[t],NULL);
+  pthread_mutex_destroy(&lock);
+  delete [] started;
+  delete [] threads;
+}
+
+bool probability_model::write_p_values(const string & file, double start, double increment, vector<double>* dfs, unsigned int num_models, unsigned int first_model ){
+  ofstream out(file.c_str(), ios::out);
+  if(!out){
+    cerr << "p-value file " << file << " could not be opened" << endl;
+    return false;
+  }
+  out << "time";
+  unsigned int num_windows = 0;
+  for(unsigned int i=0; i<num_models; i++){
+    out << ',' << first_model+i;
+    if(dfs[i].size() > num_windows)
+      num_windows = dfs[i].size();
+  }
+  out << '\n';
+  //the window starts are stepped through as the models stepped through them
+  double t = start;
+  for(unsigned int k=0; k<num_windows; k++, t += increment){
+    out << t;
+    for(unsigned int i=0; i<num_models; i++){
+      out << ',';
+      if(k < dfs[i].size())
+	out << exp(dfs[i][k]);
+    }
+    out << '\n';
+  }
+  out.close();
+  if(out.fail()){
+    cerr << "p-value file " << file << " could not be written" << endl;
+    return false;
+  }
+  return true;
+}
+
 double probability_model::combine_p_values_from_endpoints(){
   return combine_p_values_from_endpoints( m_monte_carlo_p_values, m_p_value_monte_carlo_samples );
 }
@@ -186,41 +461,33 @@ double probability_model::combine_p_values_from_endpoints( bool monte_carlo, uns
     //    double b = log_scale ? exp(iter->second) : iter->second;
     //    return log(a+b) - LOG_TWO;
   }
-  double combined_value = 0;
-  if( monte_carlo && !m_rng){
-    m_rng = gsl_rng_alloc(gsl_rng_taus);
-    gsl_rng_set (m_rng,0);
-  }
-  unsigned int counter = 0;
-  double sum_widths = 0;
-  do{
-    double sum_log_pvals = 0;
+  if(monte_carlo){
+    //the endpoints in increasing order, on the log scale
+    vector<double> log_lower(num_pvals), log_upper(num_pvals);
     for(unsigned int i = 0; i < num_pvals; i++){
-      if(!monte_carlo){
-	if(m_p_value_endpoints_log_scale[i])
-	  sum_log_pvals += m_p_value_endpoints[i].second + log(1+exp(m_p_value_endpoints[i].first-m_p_value_endpoints[i].second)) - LOG_TWO;
-	else
-	  sum_log_pvals += log(m_p_value_endpoints[i].first+m_p_value_endpoints[i].second) - LOG_TWO;
-	//	sum_log_pvals += log(a+b) - LOG_TWO;
-      }else{
-	double a = m_p_value_endpoints_log_scale[i] ? exp(m_p_value_endpoints[i].first) : m_p_value_endpoints[i].first;
-	double b = m_p_value_endpoints_log_scale[i]  ? exp(m_p_value_endpoints[i].second) : m_p_value_endpoints[i].second;
-	sum_log_pvals += log(gsl_ran_flat(m_rng,a,b));
-	if(!counter)
-	  sum_widths += fabs(b-a);
-      }
+      double a = m_p_value_endpoints_log_scale[i] ? m_p_value_endpoints[i].first : log(m_p_value_endpoints[i].first);
+      double b = m_p_value_endpoints_log_scale[i] ? m_p_value_endpoints[i].second : log(m_p_value_endpoints[i].second);
+      log_lower[i] = a < b ? a : b;
+      log_upper[i] = a < b ? b : a;
+      if(!(log_upper[i] > -DBL_MAX))//a p-value of 0
+	return -DBL_MAX;
     }
-    double fisher_score = gsl_cdf_chisq_Q(-2*sum_log_pvals,2*num_pvals);
-    combined_value += fisher_score;
-    //    double stouffer_score = gsl_cdf_ugaussian_Qinv(fisher_score);
-    //    combined_value += stouffer_score;
-    if(monte_carlo && sum_widths<=0)
-      monte_carlo_size = 1;
-  } while(monte_carlo && ++counter < monte_carlo_size );
-  if(monte_carlo)
-    combined_value /= monte_carlo_size;
+    if(num_pvals <= EXACT_P_VALUE_COMBINATION_LIMIT)
+      return combine_jittered_p_values_exactly(log_lower,log_upper);
+    return combine_jittered_p_values_by_qmc(log_lower,log_upper,monte_carlo_size);
+  }
+  double sum_log_pvals = 0;
+  for(unsigned int i = 0; i < num_pvals; i++){
+    if(m_p_value_endpoints_log_scale[i])
+      sum_log_pvals += m_p_value_endpoints[i].second + log(1+exp(m_p_value_endpoints[i].first-m_p_value_endpoints[i].second)) - LOG_TWO;
+    else
+      sum_log_pvals += log(m_p_value_endpoints[i].first+m_p_value_endpoints[i].second) - LOG_TWO;
+    //	sum_log_pvals += log(a+b) - LOG_TWO;
+  }
+  double fisher_score = gsl_cdf_chisq_Q(-2*sum_log_pvals,2*num_pvals);
+  //    double stouffer_score = gsl_cdf_ugaussian_Qinv(fisher_score);
   //  combined_value = gsl_cdf_ugaussian_Q(combined_value);
-  return log(combined_value);
+  return log(fisher_score);
 
   /*  if(!monte_carlo){
     for(vector< pair<double,double> >::iterator iter = m_p_value_endpoints.begin(); iter != m_p_value_endpoints.end(); ++iter){
@@ -19,21 +19,34 @@ class probability_model{
   probability_model(string* data_filename = NULL, string* seasonal_data_filename = NULL, double season = DBL_MAX, bool make_time_scale = true );
   virtual ~probability_model();
   void construct();
+  /*copy sharing the data and scales of this model but with its own scratch state, for use on another thread; NULL if unsupported*/
+  virtual probability_model* clone() const { return NULL; }
   virtual void set_prior_parameters(changepoint *obj1, changepoint* obj2){}
   virtual double log_likelihood_interval(changepoint *, changepoint *, changepoint * = NULL) = 0 ;
   virtual double log_likelihood_interval(double t1, double t2){ return 0;}
   virtual double log_likelihood_interval_with_count(double t1, double t2, unsigned long long int r){return 0;}
+  /*log_likelihood_interval_with_count of the n intervals (t1[i],t2[i]) holding r[i] points, into ll*/
+  virtual void log_likelihood_intervals_with_count(unsigned long long int n, const double * t1, const double * t2, const unsigned long long int * r, double * ll);
   virtual void propose_new_parameters(Particle<changepoint>*, int, unsigned int,changepoint *, changepoint *){};//if third argument 0 birth if 1 death if 2 move changepoint if 3 move parameter
   virtual double calculate_prior_ratio(Particle<changepoint>*,unsigned int){return 0;};//if argument 0 birth if 1 death if 2 move changepoint if 3 move parameter
   virtual double proposal_ratio(Particle<changepoint>*,unsigned int){return 0;};//if 0 birth if 1 death if 2 move changepoint if 3 move parameter
   virtual double calculate_log_predictive_df(double t1, double t2, double t3, bool lower_tail = true ){ return 0; }
   virtual void calculate_sequential_log_predictive_dfs(double start, double end, double increment, bool lower_tail = true, bool two_sided = false, double control_chart_weight = 0.05, string* filename_ptr = NULL, vector<double>* dfs = NULL ){if(dfs) for(unsigned int i=0; i<(end-start)/increment; i++) dfs->push_back(-LOG_TWO);}
   virtual double calculate_log_predictive_df_bounds( double dt, bool lower_tail = true, bool two_sided = false, bool increment_parameters = true ){ m_pvalue_pair = make_pair(-LOG_TWO,-LOG_TWO); return -LOG_TWO; }
+  /*the log p-values of the windows [start,start+increment), ... up to end, appended to dfs, as calculate_sequential_log_predictive_dfs
+    but leaving the shared current time alone so that models can be scored on different threads; returns the time reached*/
+  virtual double calculate_window_log_predictive_dfs(double start, double end, double increment, bool lower_tail, bool two_sided, vector<double>* dfs ){double t = start; for( ; t < end; t += increment ) dfs->push_back(-LOG_TWO); return t;}
+  /*the same for each of num_models models into dfs[i], the models shared out between num_threads threads*/
+  static void calculate_window_log_predictive_dfs_of_models(probability_model ** models, unsigned int num_models, double start, double end, double increment, bool lower_tail, bool two_sided, vector<double>* dfs, unsigned int num_threads = 1 );
+  /*the p-values as CSV, a line for the start of each window followed by the p-value of each model, numbered from first_model in the header*/
+  static bool write_p_values(const string & file, double start, double increment, vector<double>* dfs, unsigned int num_models, unsigned int first_model = 0 );
   virtual void calculate_posterior_mean_parameters(changepoint *, changepoint *){}
   virtual double calculate_mean(changepoint *, changepoint *, changepoint * = NULL) = 0;
   virtual double draw_mean_from_posterior(changepoint *, changepoint *, changepoint * = NULL){ return m_mean;}
   virtual void set_data_index(changepoint *, unsigned int=0,changepoint * = NULL, changepoint * = NULL);
   virtual double get_mean_function( double t ){ return 1; }
+  /*true when get_mean_function is 1 whatever t*/
+  virtual bool constant_mean_function(){ return true; }
   virtual void collapse_to_seasons_implementation(){}
   virtual void set_parameters_to_current_t(){}
   virtual bool been_active(){ return m_current_data_index>0; }
@@ -46,6 +59,9 @@ class probability_model{
   virtual double get_beta(){return 0;}
   virtual void use_random_mean(int){}
   virtual void use_prior_mean(){}
+  /*random number state carried from one SMC interval to the next, for checkpoints*/
+  virtual void write_state(ostream &) const;
+  virtual bool read_state(istream &);
   double get_start() const {return m_start;}
   double get_end() const {return m_end;}
   double get_mean() const {return m_mean;}
@@ -57,7 +73,10 @@ class probability_model{
   void collapse_to_seasons();
   double get_two_sided_discrete_p_value( unsigned int );
   double combine_p_values_from_endpoints();
+  /*with monte_carlo, the expected Fisher combination when each p-value is uniform between its endpoints*/
   double combine_p_values_from_endpoints( bool monte_carlo, unsigned int monte_carlo_size = 1);
+  double combine_jittered_p_values_exactly( const vector<double> & log_lower, const vector<double> & log_upper );
+  double combine_jittered_p_values_by_qmc( const vector<double> & log_lower, const vector<double> & log_upper, unsigned int max_samples );
   void set_parameters_to_current_t( double t ){ m_current_t = t; set_parameters_to_current_t(); }
   pair<double,double> get_p_value_bounds(){ return m_pvalue_pair; }
   bool get_p_value_bounds_on_log_scale(){ return m_pvalue_pair_on_log_scale; }
@@ -105,6 +124,7 @@ class probability_model{
   bool m_owner_of_data;
   bool m_owner_of_seasonal_scale;
   bool m_owner_of_time_scale;
+  void release_shared_ownership();
 };
 
 
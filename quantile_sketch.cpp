@@ -0,0 +1,172 @@
+#include "quantile_sketch.hpp"
+#include "checkpoint.hpp"
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <cstdlib>
+
+Quantile_Sketch::Quantile_Sketch(unsigned int num_cells, const vector<double> & probabilities)
+  :m_num_cells(num_cells),m_probabilities(probabilities)
+{
+  for(unsigned int j=0; j<m_probabilities.size(); j++){
+    if(!(m_probabilities[j] > 0 && m_probabilities[j] < 1) || (j>0 && !(m_probabilities[j] > m_probabilities[j-1]))){
+      cerr << "Error: quantiles must be increasing probabilities between 0 and 1" << endl;
+      exit(1);
+    }
+  }
+  m_marker_probabilities.push_back(0);
+  double last = 0;
+  for(unsigned int j=0; j<m_probabilities.size(); j++){
+    m_marker_probabilities.push_back((last+m_probabilities[j])/2);
+    m_marker_probabilities.push_back(m_probabilities[j]);
+    last = m_probabilities[j];
+  }
+  m_marker_probabilities.push_back((last+1)/2);
+  m_marker_probabilities.push_back(1);
+  m_num_markers = m_marker_probabilities.size();
+
+  m_heights = new double[(unsigned long long int)m_num_cells*m_num_markers];
+  m_positions = new double[(unsigned long long int)m_num_cells*m_num_markers];
+  m_counts = new unsigned long long int[m_num_cells];
+  reset();
+}
+
+Quantile_Sketch::~Quantile_Sketch(){
+  delete [] m_heights;
+  delete [] m_positions;
+  delete [] m_counts;
+}
+
+void Quantile_Sketch::reset(){
+  for(unsigned int c=0; c<m_num_cells; c++)
+    m_counts[c] = 0;
+}
+
+void Quantile_Sketch::start_markers(unsigned int cell){
+  double * n = m_positions + (unsigned long long int)cell*m_num_markers;
+  for(unsigned int i=1; i<m_num_markers; i++)
+    n[i] += n[i-1];
+}
+
+void Quantile_Sketch::add(unsigned int cell, double value, double weight){
+  if(!(weight > 0))
+    return;
+  unsigned int M = m_num_markers;
+  double * q = m_heights + (unsigned long long int)cell*M;
+  double * n = m_positions + (unsigned long long int)cell*M;
+  unsigned long long int & count = m_counts[cell];
+
+  //the first values are kept in order with their weights, and become the markers
+  if(count < M){
+    unsigned int i = count;
+    while(i>0 && q[i-1] > value){
+      q[i] = q[i-1];
+      n[i] = n[i-1];
+      i--;
+    }
+    q[i] = value;
+    n[i] = weight;
+    if(++count == M)
+      start_markers(cell);
+    return;
+  }
+
+  unsigned int k = 0;
+  if(value < q[0])
+    q[0] = value;
+  else if(value >= q[M-1]){
+    q[M-1] = value;
+    k = M-2;
+  }else{
+    while(value >= q[k+1])
+      k++;
+  }
+  for(unsigned int i=k+1; i<M; i++)
+    n[i] += weight;
+  count++;
+
+  double step = n[M-1]/count;
+  for(unsigned int i=1; i<M-1; i++){
+    double desired = n[0] + (n[M-1]-n[0])*m_marker_probabilities[i];
+    while(true){
+      double d = desired-n[i];
+      double s;
+      if(d >= step && n[i+1]-n[i] > step)
+	s = step;
+      else if(d <= -step && n[i-1]-n[i] < -step)
+	s = -step;
+      else
+	break;
+      double parabolic = q[i] + s/(n[i+1]-n[i-1])*((n[i]-n[i-1]+s)*(q[i+1]-q[i])/(n[i+1]-n[i]) + (n[i+1]-n[i]-s)*(q[i]-q[i-1])/(n[i]-n[i-1]));
+      if(q[i-1] < parabolic && parabolic < q[i+1])
+	q[i] = parabolic;
+      else{
+	unsigned int j = s > 0 ? i+1 : i-1;
+	q[i] += s*(q[j]-q[i])/(n[j]-n[i]);
+      }
+      n[i] += s;
+    }
+  }
+}
+
+double Quantile_Sketch::quantile(unsigned int cell, unsigned int j) const{
+  const double * q = m_heights + (unsigned long long int)cell*m_num_markers;
+  const double * n = m_positions + (unsigned long long int)cell*m_num_markers;
+  unsigned long long int count = m_counts[cell];
+  if(count == 0)
+    return numeric_limits<double>::quiet_NaN();
+  if(count >= m_num_markers)
+    return q[2*j+2];
+  double total = 0;
+  for(unsigned int i=0; i<count; i++)
+    total += n[i];
+  double cumulative = 0;
+  for(unsigned int i=0; i<count; i++){
+    cumulative += n[i];
+    if(cumulative >= m_probabilities[j]*total)
+      return q[i];
+  }
+  return q[count-1];
+}
+
+void Quantile_Sketch::write_to_file(const string & file) const{
+  ofstream OutputStream(file.c_str(), ios::out);
+  if(!OutputStream){
+    cerr << file << " could not be opened" << endl;
+    return;
+  }
+  OutputStream << setiosflags(ios::fixed);
+  OutputStream.precision(8);
+  for(unsigned int c=0; c<m_num_cells; c++){
+    for(unsigned int j=0; j<m_probabilities.size(); j++)
+      OutputStream << (j>0 ? "\t" : "") << quantile(c,j);
+    OutputStream << endl;
+  }
+  OutputStream.close();
+}
+
+void Quantile_Sketch::write_state(ostream & out) const{
+  checkpoint_write(out,m_num_cells);
+  checkpoint_write(out,m_num_markers);
+  checkpoint_write(out,m_heights,(unsigned long long int)m_num_cells*m_num_markers);
+  checkpoint_write(out,m_positions,(unsigned long long int)m_num_cells*m_num_markers);
+  checkpoint_write(out,m_counts,m_num_cells);
+}
+
+bool Quantile_Sketch::read_state(istream & in){
+  unsigned int num_cells, num_markers;
+  if(!checkpoint_read(in,num_cells) || !checkpoint_read(in,num_markers) || num_cells!=m_num_cells || num_markers!=m_num_markers)
+    return false;
+  bool ok = checkpoint_read(in,m_heights,(unsigned long long int)m_num_cells*m_num_markers);
+  ok = ok && checkpoint_read(in,m_positions,(unsigned long long int)m_num_cells*m_num_markers);
+  ok = ok && checkpoint_read(in,m_counts,m_num_cells);
+  return ok;
+}
+
+string Quantile_Sketch::bands_file(const string & file){
+  size_t dot = file.find_last_of('.');
+  size_t slash = file.find_last_of('/');
+  if(dot == string::npos || (slash != string::npos && dot < slash))
+    return file + "_bands";
+  return file.substr(0,dot) + "_bands" + file.substr(dot);
+}
@@ -0,0 +1,49 @@
+#ifndef QUANTILE_SKETCH_HPP
+#define QUANTILE_SKETCH_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*Running estimates of a few quantiles of a weighted stream of values in each of a number of
+  cells, eg the grid of a function of interest, without keeping the values. Each cell holds
+  the 2m+3 markers of the P^2 algorithm (Jain and Chlamtac) extended to m quantiles: the least
+  and greatest values, the quantiles and the points half way between them. An added value
+  moves the positions of the markers above it on by its weight, and the markers are then
+  stepped towards their desired positions in cumulative weight by piecewise parabolic
+  interpolation, each step the average weight so far. With equal weights this is the usual
+  P^2 update.*/
+class Quantile_Sketch{
+
+ public:
+  /*probabilities increasing, all in (0,1)*/
+  Quantile_Sketch(unsigned int num_cells, const vector<double> & probabilities);
+  ~Quantile_Sketch();
+  void add(unsigned int cell, double value, double weight = 1);
+  /*the estimate of the j-th quantile in the cell, NaN if nothing has been added to it*/
+  double quantile(unsigned int cell, unsigned int j) const;
+  unsigned int get_num_cells() const { return m_num_cells; }
+  unsigned int get_num_quantiles() const { return m_probabilities.size(); }
+  void reset();
+  /*a line for each cell, its quantiles separated by tabs*/
+  void write_to_file(const string & file) const;
+  void write_state(ostream &) const;
+  bool read_state(istream &);
+  /*the file the bands of file are written to, eg intensity.txt -> intensity_bands.txt*/
+  static string bands_file(const string & file);
+
+ private:
+  unsigned int m_num_cells;
+  unsigned int m_num_markers;
+  vector<double> m_probabilities;
+  vector<double> m_marker_probabilities;
+  double * m_heights;//m_num_markers for each cell
+  double * m_positions;//cumulative weights of the markers, the weights themselves until a cell has m_num_markers values
+  unsigned long long int * m_counts;
+
+  void start_markers(unsigned int cell);
+};
+
+#endif
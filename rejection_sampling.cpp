@@ -3,6 +3,45 @@
 #include "changepoint.hpp"
 #include "histogram_type.hpp"
 #include <vector>
+
+//the least and most blocks proposed between looks at how many more are needed
+#define MIN_BLOCKS_PER_ROUND 8
+#define MAX_BLOCKS_PER_ROUND 64
+//segments the envelope starts with, each over an equal number of data points
+#define INITIAL_ENVELOPE_SEGMENTS 16
+//relative allowance for rounding when the likelihood of a proposal is compared with the bound on its segment
+#define ENVELOPE_SLACK 1e-9
+
+struct rejection_sampling::Proposal_Block{
+  vector<unsigned int> position;//in the block of each accepted proposal
+  vector<double> cp;
+  vector<unsigned long long int> index;
+  vector<double> left;
+  vector<double> right;
+  vector<unsigned int> rejected_position;//of the rejected proposals, kept to refine the envelope
+  vector<double> rejected_cp;
+  unsigned int above_bound;//position of the first proposal with a likelihood above its bound, the block size if none
+};
+
+struct rejection_sampling::Block_Worker{
+  rejection_sampling * rs;
+  probability_model * pm;
+  gsl_rng * r;
+  Proposal_Block * blocks;
+  unsigned long long int first_block;
+  unsigned long long int num_blocks;
+  unsigned long long int * next_block;
+  pthread_mutex_t * lock;
+};
+
+//a stream for each block of proposals, well apart from those of the other blocks and seeds
+static unsigned long int block_seed(int seed, unsigned long long int b){
+  unsigned long long int z = ((unsigned long long int)(unsigned int)seed << 32) + b + 1;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return (unsigned long int)(z ^ (z >> 31));
+}
+
 rejection_sampling::rejection_sampling(double start, double cp_start, double end, long long int sample_size, probability_model *pm, double cp_prior, double space, int seed, bool calculate_mean, bool calculate_sample_histogram, unsigned int grid) {
   m_smcsamplers_prior = 0;
   m_start_time = start;
@@ -25,6 +64,10 @@ rejection_sampling::rejection_sampling(double start, double cp_start, double end
   m_histogram = NULL;
   m_calculate_sample_histogram = calculate_sample_histogram;
   m_num_bins = grid;
+  m_block_size = 0;
+  m_num_threads = 1;
+  m_accepted_samples = 0;
+  m_max_segments = 0;
     
   if (m_calculate_sample_histogram == 1) {
     double bin_width = (m_end_time - m_cp_start) / (double) m_num_bins;
@@ -207,6 +250,17 @@ void rejection_sampling::sample_from_prior(Particle<changepoint> ** previous_sam
 
 }
 
+void
+rejection_sampling::use_batched_proposals(unsigned int block_size, unsigned int num_threads) {
+  m_block_size = block_size;
+  m_num_threads = num_threads > 0 ? num_threads : 1;
+}
+
+void
+rejection_sampling::use_adaptive_envelope(unsigned int max_segments) {
+  m_max_segments = max_segments;
+}
+
 void
 rejection_sampling::run_simulation() {
   if (m_cp_start >= m_end_time) {
@@ -214,88 +268,386 @@ rejection_sampling::run_simulation() {
     exit(1);
   }
   Data<double> *data = m_pm->get_data();
-  unsigned long long int data_index_start = data->find_data_index(m_start_time);
-  unsigned long long int data_index_end = m_end_of_int_changepoint->getdataindex();
+  m_data_index_start = data->find_data_index(m_start_time);
+  m_data_index_end = m_end_of_int_changepoint->getdataindex();
   unsigned long long int data_index_temp = 0;
-  double mle = calculate_mle(data_index_start, data_index_end);
+  m_mle = calculate_mle(m_data_index_start, m_data_index_end);
+  if (m_max_segments > 0) {
+    build_envelope();
+  }
   
-  int accepted_samples = 0;
   double current_cp;
   double likelihood_left = 0, likelihood_right = 0;
-  double log_posterior = 0;
+  double bound;
   double u_rv;
-  changepoint **cpvector = NULL; 
-  changepoint *cpintercept = NULL;
-  int n_cps = 0;
   m_sample =  new Particle<changepoint> *[m_sample_size];
+  m_accepted_samples = 0;
   long long int attempts = 0;
+
+  if (m_block_size > 0) {
+    run_batched_simulation();
+    return;
+  }
   
-  while (accepted_samples < m_sample_size) {
+  while (m_accepted_samples < m_sample_size) {
     attempts++;
-    current_cp = draw_from_prior();
+    current_cp = propose(m_r, bound);
     if (current_cp > m_end_time) {
       likelihood_left = m_zero_cp_likelihood;
     } else {
-      data_index_temp = data->find_data_index(current_cp, 0, data_index_start);
-      likelihood_left = m_pm->log_likelihood_interval_with_count(m_start_time, current_cp, data_index_temp - data_index_start);
-      likelihood_right = m_pm->log_likelihood_interval_with_count(current_cp, m_end_time, data_index_end - data_index_temp);
+      data_index_temp = data->find_data_index(current_cp, 0, m_data_index_start);
+      likelihood_left = m_pm->log_likelihood_interval_with_count(m_start_time, current_cp, data_index_temp - m_data_index_start);
+      likelihood_right = m_pm->log_likelihood_interval_with_count(current_cp, m_end_time, m_data_index_end - data_index_temp);
     }
     u_rv = log( gsl_ran_flat(m_r, 0, 1));
 
-    if (likelihood_left + likelihood_right > mle) {
+    if (likelihood_left + likelihood_right > bound) {
       cerr << "rejection_sampling: likelihood is greater than mle" << endl;
       exit(1);
     }
 
-    if (u_rv < likelihood_left + likelihood_right - mle) {
-      cpintercept = new changepoint(m_start_time, data_index_start, likelihood_left, 0);
+    if (u_rv < likelihood_left + likelihood_right - bound) {
+      accept_sample(current_cp, data_index_temp, likelihood_left, likelihood_right);
+     //cout << "accept" <<endl;
+    } else if (m_max_segments > 0) {
+      refine_envelope(current_cp);
+    }
+    likelihood_left = likelihood_right = 0;
+  }
+  m_acceptance_rate = (double) m_sample_size / attempts;
+}
+
+void
+rejection_sampling::accept_sample(double current_cp, unsigned long long int data_index_temp, double likelihood_left, double likelihood_right) {
+  changepoint **cpvector = NULL; 
+  changepoint *cpintercept = new changepoint(m_start_time, m_data_index_start, likelihood_left, 0);
+  int n_cps = 0;
+  double log_posterior;
      
-      if (current_cp <= m_end_time) {
-	n_cps = 1;
-	cpvector = new changepoint *[1];
-	cpvector[0] = new changepoint(current_cp, data_index_temp, likelihood_right, 0);
-	m_dimension_frequency_count[1]++;
-	if (m_calculate_mean) {
-	  cpintercept->setmeanvalue(m_pm->calculate_mean(cpintercept, cpvector[0]));
-	  cpintercept->setvarvalue(m_pm->get_var());
-	  cpvector[0]->setmeanvalue(m_pm->calculate_mean(cpvector[0], m_end_of_int_changepoint));
-	  cpvector[0]->setvarvalue(m_pm->get_var());
-	}
-      } else {
-	m_dimension_frequency_count[0]++;
-	if (m_calculate_mean) {
-	  cpintercept->setmeanvalue(m_pm->calculate_mean(cpintercept, m_end_of_int_changepoint));
-	  cpintercept->setvarvalue(m_pm->get_var());
-	}
+  if (current_cp <= m_end_time) {
+    n_cps = 1;
+    cpvector = new changepoint *[1];
+    cpvector[0] = new changepoint(current_cp, data_index_temp, likelihood_right, 0);
+    m_dimension_frequency_count[1]++;
+    if (m_calculate_mean) {
+      cpintercept->setmeanvalue(m_pm->calculate_mean(cpintercept, cpvector[0]));
+      cpintercept->setvarvalue(m_pm->get_var());
+      cpvector[0]->setmeanvalue(m_pm->calculate_mean(cpvector[0], m_end_of_int_changepoint));
+      cpvector[0]->setvarvalue(m_pm->get_var());
+    }
+  } else {
+    m_dimension_frequency_count[0]++;
+    if (m_calculate_mean) {
+      cpintercept->setmeanvalue(m_pm->calculate_mean(cpintercept, m_end_of_int_changepoint));
+      cpintercept->setvarvalue(m_pm->get_var());
+    }
+  }
+  m_sample[m_accepted_samples] = new Particle<changepoint>(n_cps, cpvector, cpintercept);
+  log_posterior = likelihood_left + likelihood_right;
+  log_posterior += n_cps * log(m_cp_prior) - m_cp_prior * (m_end_time - m_cp_start);
+  if (n_cps == 1) {
+    log_posterior += m_cp_prior * (m_end_time - current_cp);
+  }
+  m_sample[m_accepted_samples]->set_log_posterior(log_posterior);
+  if (m_calculate_sample_histogram) {
+    m_histogram->calculate_bin(m_sample[m_accepted_samples], n_cps);
+    m_histogram->increment_1d_bin_counts(1);
+  }
+  m_accepted_samples++;
+}
+
+void
+rejection_sampling::propose_block(unsigned long long int b, gsl_rng *r, probability_model *pm, Proposal_Block &block) {
+  Data<double> *data = m_pm->get_data();
+  unsigned int n = m_block_size;
+  vector<double> cp(n), log_u(n), bound(n);
+  vector<pair<double, unsigned int> > sorted;
+  sorted.reserve(n);
+  gsl_rng_set(r, block_seed(m_seed, b));
+  for (unsigned int k = 0; k < n; k++) {
+    cp[k] = propose(r, bound[k]);
+    log_u[k] = log(gsl_ran_flat(r, 0, 1));
+    if (cp[k] <= m_end_time) {
+      sorted.push_back(make_pair(cp[k], k));
+    }
+  }
+
+  //the data indices in one pass through the data in time order, then the likelihoods of
+  //the intervals to the left followed by those to the right in one call to the model
+  sort(sorted.begin(), sorted.end());
+  unsigned long long int m = sorted.size();
+  vector<double> t1(2 * m + 1), t2(2 * m + 1), likelihood(2 * m + 1);
+  vector<unsigned long long int> counts(2 * m + 1), index(n, 0);
+  unsigned long long int data_index = m_data_index_start;
+  for (unsigned long long int j = 0; j < m; j++) {
+    data_index = data->find_data_index(sorted[j].first, 0, data_index);
+    index[sorted[j].second] = data_index;
+    t1[j] = m_start_time;
+    t2[j] = sorted[j].first;
+    counts[j] = data_index - m_data_index_start;
+    t1[m + j] = sorted[j].first;
+    t2[m + j] = m_end_time;
+    counts[m + j] = m_data_index_end - data_index;
+  }
+  pm->log_likelihood_intervals_with_count(2 * m, &t1[0], &t2[0], &counts[0], &likelihood[0]);
+
+  vector<double> left(n, m_zero_cp_likelihood), right(n, 0);
+  for (unsigned long long int j = 0; j < m; j++) {
+    left[sorted[j].second] = likelihood[j];
+    right[sorted[j].second] = likelihood[m + j];
+  }
+
+  block.position.clear();
+  block.cp.clear();
+  block.index.clear();
+  block.left.clear();
+  block.right.clear();
+  block.rejected_position.clear();
+  block.rejected_cp.clear();
+  block.above_bound = n;
+  for (unsigned int k = 0; k < n; k++) {
+    if (left[k] + right[k] > bound[k]) {
+      block.above_bound = k;
+      break;
+    }
+    if (log_u[k] < left[k] + right[k] - bound[k]) {
+      block.position.push_back(k);
+      block.cp.push_back(cp[k]);
+      block.index.push_back(index[k]);
+      block.left.push_back(left[k]);
+      block.right.push_back(right[k]);
+    } else if (m_max_segments > 0) {
+      block.rejected_position.push_back(k);
+      block.rejected_cp.push_back(cp[k]);
+    }
+  }
+}
+
+void *
+rejection_sampling::block_thread(void *arg) {
+  Block_Worker *worker = (Block_Worker *) arg;
+  unsigned long long int b;
+  while (true) {
+    pthread_mutex_lock(worker->lock);
+    b = (*worker->next_block)++;
+    pthread_mutex_unlock(worker->lock);
+    if (b >= worker->num_blocks)
+      break;
+    worker->rs->propose_block(worker->first_block + b, worker->r, worker->pm, worker->blocks[b]);
+  }
+  return NULL;
+}
+
+void
+rejection_sampling::run_batched_simulation() {
+  unsigned int num_threads = m_num_threads;
+
+  //worker 0 runs on this thread with the original model, the others on copies
+  probability_model **pm = new probability_model *[num_threads];
+  pm[0] = m_pm;
+  for (unsigned int t = 1; t < num_threads; t++) {
+    pm[t] = m_pm->clone();
+    if (!pm[t]) {
+      num_threads = t;
+      break;
+    }
+  }
+
+  unsigned long long int next_block = 0;
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock, NULL);
+  Block_Worker *workers = new Block_Worker[num_threads];
+  pthread_t *threads = new pthread_t[num_threads];
+  bool *started = new bool[num_threads];
+  for (unsigned int t = 0; t < num_threads; t++) {
+    workers[t].rs = this;
+    workers[t].pm = pm[t];
+    workers[t].r = gsl_rng_alloc(m_r_type);
+    workers[t].next_block = &next_block;
+    workers[t].lock = &lock;
+  }
+
+  long long int attempts = 0;
+  unsigned long long int first_block = 0;
+  unsigned long long int num_blocks = MIN_BLOCKS_PER_ROUND;
+  vector<Proposal_Block> blocks;
+  vector<double> rejected;
+  while (m_accepted_samples < m_sample_size) {
+    blocks.resize(num_blocks);
+    next_block = 0;
+    for (unsigned int t = 0; t < num_threads; t++) {
+      workers[t].blocks = &blocks[0];
+      workers[t].first_block = first_block;
+      workers[t].num_blocks = num_blocks;
+      started[t] = false;
+    }
+    //any blocks left by a thread which could not be started are picked up by the others
+    for (unsigned int t = 1; t < num_threads; t++)
+      started[t] = pthread_create(&threads[t], NULL, block_thread, (void *) (&workers[t])) == 0;
+    block_thread((void *) (&workers[0]));
+    for (unsigned int t = 1; t < num_threads; t++) {
+      if (started[t])
+	pthread_join(threads[t], NULL);
+    }
+
+    //the blocks are taken in order, so the sample does not depend on how they were shared out
+    rejected.clear();
+    for (unsigned long long int b = 0; b < num_blocks && m_accepted_samples < m_sample_size; b++) {
+      Proposal_Block &block = blocks[b];
+      unsigned int a = 0;
+      while (a < block.position.size() && m_accepted_samples < m_sample_size) {
+	accept_sample(block.cp[a], block.index[a], block.left[a], block.right[a]);
+	a++;
       }
-      m_sample[accepted_samples] = new Particle<changepoint>(n_cps, cpvector, cpintercept);
-      log_posterior = likelihood_left + likelihood_right;
-      log_posterior += n_cps * log(m_cp_prior) - m_cp_prior * (m_end_time - m_cp_start);
-      if (n_cps == 1) {
-	log_posterior += m_cp_prior * (m_end_time - current_cp);
+      unsigned int used;
+      if (m_accepted_samples == m_sample_size) {
+	used = block.position[a - 1] + 1;
+      } else if (block.above_bound < m_block_size) {
+	cerr << "rejection_sampling: likelihood is greater than mle" << endl;
+	exit(1);
+      } else {
+	used = m_block_size;
       }
-      m_sample[accepted_samples]->set_log_posterior(log_posterior);
-      if (m_calculate_sample_histogram) {
-	m_histogram->calculate_bin(m_sample[accepted_samples], n_cps);
-	m_histogram->increment_1d_bin_counts(1);
+      attempts += used;
+      for (unsigned int j = 0; j < block.rejected_position.size() && block.rejected_position[j] < used; j++) {
+	rejected.push_back(block.rejected_cp[j]);
       }
-      
-      accepted_samples++;
-      n_cps = 0;
-      cpvector = NULL;
-      cpintercept = NULL;
+    }
+    first_block += num_blocks;
 
-      
-     //cout << "accept" <<endl;
+    //the envelope stays fixed while the threads propose from it, refine it with this round's rejections in order
+    for (unsigned long long int j = 0; j < rejected.size(); j++) {
+      refine_envelope(rejected[j]);
     }
-    likelihood_left = likelihood_right = 0;
+
+    //enough blocks for the rest of the sample at the acceptance rate so far. The rounds must
+    //not depend on the number of threads as the envelope changes between them
+    if (m_accepted_samples > 0) {
+      double needed = (double) (m_sample_size - m_accepted_samples) * attempts / ((double) m_accepted_samples * m_block_size);
+      num_blocks = needed < MAX_BLOCKS_PER_ROUND ? (unsigned long long int) ceil(needed) : MAX_BLOCKS_PER_ROUND;
+    } else {
+      num_blocks = 2 * num_blocks;
+    }
+    num_blocks = max(num_blocks, (unsigned long long int) MIN_BLOCKS_PER_ROUND);
+    num_blocks = min(num_blocks, (unsigned long long int) MAX_BLOCKS_PER_ROUND);
   }
   m_acceptance_rate = (double) m_sample_size / attempts;
+
+  for (unsigned int t = 0; t < num_threads; t++) {
+    gsl_rng_free(workers[t].r);
+    if (t > 0)
+      delete pm[t];
+  }
+  pthread_mutex_destroy(&lock);
+  delete [] started;
+  delete [] threads;
+  delete [] workers;
+  delete [] pm;
 }
 
 double 
-rejection_sampling::draw_from_prior() {
-  return gsl_ran_exponential (m_r, 1.0/m_cp_prior) + m_cp_start;
+rejection_sampling::draw_from_prior(gsl_rng *r) {
+  return gsl_ran_exponential (r, 1.0/m_cp_prior) + m_cp_start;
+}
+
+/*a changepoint from the prior, or from the envelope when there is one, with the bound on
+  its likelihood to accept it against; beyond m_end_time for no changepoint*/
+double
+rejection_sampling::propose(gsl_rng *r, double &bound) {
+  if (m_max_segments == 0) {
+    bound = m_mle;
+    return draw_from_prior(r);
+  }
+  unsigned int num_segments = m_segment_bound.size();
+  double u = gsl_ran_flat(r, 0, m_cumulative_weight[num_segments]);
+  unsigned int s = upper_bound(m_cumulative_weight.begin(), m_cumulative_weight.end(), u) - m_cumulative_weight.begin();
+  double v = gsl_ran_flat(r, 0, 1);
+  if (s >= num_segments) {
+    bound = m_zero_cp_likelihood;
+    return DBL_MAX;
+  }
+  //the prior truncated to the segment
+  double a = m_segment_ends[s];
+  double b = m_segment_ends[s + 1];
+  double cp = a - log1p(v * expm1(-m_cp_prior * (b - a))) / m_cp_prior;
+  bound = m_segment_bound[s];
+  return cp < b ? cp : b;
+}
+
+double
+rejection_sampling::likelihood_at(double t) {
+  unsigned long long int data_index = m_pm->get_data()->find_data_index(t, 0, m_data_index_start);
+  return m_pm->log_likelihood_interval_with_count(m_start_time, t, data_index - m_data_index_start) 
+    + m_pm->log_likelihood_interval_with_count(t, m_end_time, m_data_index_end - data_index);
+}
+
+/*between data points the likelihood is convex in the changepoint, as calculate_mle relies
+  on, so it is bounded on [a,b] by its values at a and b and either side of the data points inside*/
+double
+rejection_sampling::segment_bound(double a, double b) {
+  Data<double> *data = m_pm->get_data();
+  double bound = max(likelihood_at(a), likelihood_at(b));
+  unsigned long long int i = data->find_data_index(a, 0, m_data_index_start);
+  while (i < m_data_index_end && data->m_X[0][i] <= b) {
+    bound = max(bound, m_point_bounds[i - m_first_point]);
+    i++;
+  }
+  return bound + ENVELOPE_SLACK * (1 + fabs(bound));
+}
+
+/*the weight of a segment is its prior probability times the exponential of its bound, relative to the mle*/
+void
+rejection_sampling::calculate_envelope_weights() {
+  unsigned int num_segments = m_segment_bound.size();
+  m_cumulative_weight.resize(num_segments + 1);
+  double total = 0;
+  for (unsigned int s = 0; s < num_segments; s++) {
+    double a = m_segment_ends[s];
+    double b = m_segment_ends[s + 1];
+    total += exp(m_segment_bound[s] - m_mle - m_cp_prior * (a - m_cp_start)) * -expm1(-m_cp_prior * (b - a));
+    m_cumulative_weight[s] = total;
+  }
+  total += exp(m_zero_cp_likelihood - m_mle - m_cp_prior * (m_end_time - m_cp_start));
+  m_cumulative_weight[num_segments] = total;
+}
+
+void
+rejection_sampling::build_envelope() {
+  Data<double> *data = m_pm->get_data();
+  unsigned long long int num_points = m_point_bounds.size();
+  unsigned int num_segments = m_max_segments < INITIAL_ENVELOPE_SEGMENTS ? m_max_segments : INITIAL_ENVELOPE_SEGMENTS;
+  m_segment_ends.clear();
+  m_segment_bound.clear();
+  m_segment_ends.push_back(m_cp_start);
+  for (unsigned int s = 1; s < num_segments; s++) {
+    unsigned long long int i = m_first_point + s * num_points / num_segments;
+    if (i < m_data_index_end && data->m_X[0][i] > m_segment_ends.back() && data->m_X[0][i] < m_end_time) {
+      m_segment_ends.push_back(data->m_X[0][i]);
+    }
+  }
+  m_segment_ends.push_back(m_end_time);
+  for (unsigned int s = 0; s + 1 < m_segment_ends.size(); s++) {
+    m_segment_bound.push_back(segment_bound(m_segment_ends[s], m_segment_ends[s + 1]));
+  }
+  calculate_envelope_weights();
+}
+
+/*split the segment holding a rejected changepoint there, until there are m_max_segments*/
+void
+rejection_sampling::refine_envelope(double cp) {
+  if (m_segment_bound.size() >= m_max_segments || cp <= m_cp_start || cp >= m_end_time) {
+    return;
+  }
+  unsigned int s = upper_bound(m_segment_ends.begin(), m_segment_ends.end(), cp) - m_segment_ends.begin() - 1;
+  double a = m_segment_ends[s];
+  double b = m_segment_ends[s + 1];
+  if (!(a < cp && cp < b)) {
+    return;
+  }
+  m_segment_ends.insert(m_segment_ends.begin() + s + 1, cp);
+  m_segment_bound[s] = segment_bound(a, cp);
+  m_segment_bound.insert(m_segment_bound.begin() + s + 1, segment_bound(cp, b));
+  calculate_envelope_weights();
 }
 
 double 
@@ -305,6 +657,8 @@ rejection_sampling::calculate_mle(double data_index_start, double data_index_end
   double current_likelihood;
   double current_data_point;
   double mle = 0;
+  m_first_point = data_index_1;
+  m_point_bounds.clear();
   if (m_start_time != m_cp_start) {
     current_likelihood =  m_pm->log_likelihood_interval_with_count(m_start_time, m_cp_start, data_index_1 - data_index_start);
     current_likelihood += m_pm->log_likelihood_interval_with_count(m_cp_start, m_end_time, data_index_end - data_index_1);
@@ -318,6 +672,7 @@ rejection_sampling::calculate_mle(double data_index_start, double data_index_end
     if (current_likelihood > mle || mle == 0) {
       mle = current_likelihood;
     }
+    double point_bound = current_likelihood;
     current_likelihood = m_pm->log_likelihood_interval_with_count(m_start_time, current_data_point + DBL_MIN, 
 								  i + 1 - data_index_start);
     current_likelihood += m_pm->log_likelihood_interval_with_count(current_data_point + DBL_MIN, m_end_time, 
@@ -325,6 +680,9 @@ rejection_sampling::calculate_mle(double data_index_start, double data_index_end
     if (current_likelihood > mle) {
       mle = current_likelihood;
     }
+    if (m_max_segments > 0) {
+      m_point_bounds.push_back(max(point_bound, current_likelihood));
+    }
   }
 
   /* corresponds to no changepoint */
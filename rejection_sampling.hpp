@@ -5,6 +5,7 @@
 #include "changepoint.hpp"
 #include "probability_model.hpp"
 #include "histogram_type.hpp"
+#include <pthread.h>
 
 /*allows for rejection sampling when there is only one changepoint*/
 
@@ -20,6 +21,14 @@ public:
   void write_frequency_counts_to_file(const char*);
   double m_acceptance_rate;
   void use_smcsamplers_prior() {m_smcsamplers_prior = 1;}
+  /*make the proposals of run_simulation in blocks of block_size, each block drawn from its own
+    random number stream and shared out over num_threads threads. The sample depends on the
+    seed and block_size but not on num_threads. A block_size of 0 proposes one at a time*/
+  void use_batched_proposals(unsigned int block_size, unsigned int num_threads = 1);
+  /*propose from a piecewise envelope over the changepoint, the prior scaled on each segment by a
+    bound on the likelihood there, rather than from the prior against the single global bound.
+    Segments are split at rejected proposals, up to max_segments. 0 for the global bound*/
+  void use_adaptive_envelope(unsigned int max_segments);
 
 private:
   
@@ -34,7 +43,8 @@ private:
   gsl_rng *m_r;
   double m_zero_cp_likelihood;
   Particle<changepoint> **m_sample;
-  double draw_from_prior();
+  double draw_from_prior(gsl_rng *);
+  double propose(gsl_rng *, double &);
   double calculate_mle(double, double);
   map<unsigned int,unsigned long long int> m_dimension_frequency_count;
   Histogram_Type<changepoint> *m_histogram;
@@ -47,6 +57,29 @@ private:
   bool m_smcsamplers_prior;
   bool m_spacing_prior;
   double m_space;
+  unsigned int m_block_size;
+  unsigned int m_num_threads;
+  long long int m_accepted_samples;
+  unsigned long long int m_data_index_start;
+  unsigned long long int m_data_index_end;
+  double m_mle;
+  unsigned int m_max_segments;
+  vector<double> m_segment_ends;//the envelope segments run from m_cp_start to m_end_time
+  vector<double> m_segment_bound;
+  vector<double> m_cumulative_weight;//of the segments, then of no changepoint
+  vector<double> m_point_bounds;//the likelihood either side of each data point from m_first_point
+  unsigned long long int m_first_point;
+  struct Proposal_Block;
+  struct Block_Worker;
+  void accept_sample(double, unsigned long long int, double, double);
+  void run_batched_simulation();
+  void propose_block(unsigned long long int, gsl_rng *, probability_model *, Proposal_Block &);
+  static void * block_thread(void *);
+  double likelihood_at(double);
+  double segment_bound(double, double);
+  void calculate_envelope_weights();
+  void build_envelope();
+  void refine_envelope(double);
 };
 
 
@@ -0,0 +1,196 @@
+#include "resampling.hpp"
+
+Resampler::Resampler(Resampling_Type type)
+  :m_resampling_type(type)
+{
+  m_size = 0;
+  m_capacity = 0;
+  m_counts = NULL;
+  m_indices = NULL;
+  m_alias_prob = NULL;
+  m_residuals = NULL;
+  m_alias = NULL;
+  m_small = NULL;
+  m_large = NULL;
+}
+
+Resampler::~Resampler(){
+  if(m_capacity){
+    delete [] m_counts;
+    delete [] m_indices;
+    delete [] m_alias_prob;
+    delete [] m_residuals;
+    delete [] m_alias;
+    delete [] m_small;
+    delete [] m_large;
+  }
+}
+
+Resampling_Type Resampler::resampling_type_from_string(const string & s){
+  if(s == "systematic")
+    return SYSTEMATIC;
+  if(s == "stratified")
+    return STRATIFIED;
+  if(s == "residual")
+    return RESIDUAL;
+  if(s == "multinomial")
+    return MULTINOMIAL;
+  cerr << "resampling.cpp: unknown resampling scheme " << s << ", using systematic" << endl;
+  return SYSTEMATIC;
+}
+
+const char * Resampler::resampling_type_to_string(Resampling_Type type){
+  switch(type){
+  case STRATIFIED:
+    return "stratified";
+  case RESIDUAL:
+    return "residual";
+  case MULTINOMIAL:
+    return "multinomial";
+  default:
+    return "systematic";
+  }
+}
+
+void Resampler::reserve(unsigned long long int n){
+  if(n <= m_capacity)
+    return;
+  if(m_capacity){
+    delete [] m_counts;
+    delete [] m_indices;
+    delete [] m_alias_prob;
+    delete [] m_residuals;
+    delete [] m_alias;
+    delete [] m_small;
+    delete [] m_large;
+  }
+  m_capacity = n;
+  m_counts = new unsigned long long int[m_capacity];
+  m_indices = new unsigned long long int[m_capacity];
+  m_alias_prob = new double[m_capacity];
+  m_residuals = new double[m_capacity];
+  m_alias = new unsigned long long int[m_capacity];
+  m_small = new unsigned long long int[m_capacity];
+  m_large = new unsigned long long int[m_capacity];
+}
+
+void Resampler::resample(const double * weights, double sum_weights, unsigned long long int n, gsl_rng * r){
+  m_size = n;
+  if(!n)
+    return;
+  reserve(n);
+  for(unsigned long long int i=0; i<n; i++)
+    m_counts[i] = 0;
+  switch(m_resampling_type){
+  case STRATIFIED:
+    stratified(weights,sum_weights,n,r);
+    break;
+  case RESIDUAL:
+    residual(weights,sum_weights,n,r);
+    break;
+  case MULTINOMIAL:
+    multinomial(weights,sum_weights,n,n,r);
+    break;
+  default:
+    systematic(weights,sum_weights,n,r);
+  }
+  counts_to_indices(n);
+}
+
+//one uniform shared by all n strata, offspring assigned in a single pass over the cumulative weights
+void Resampler::systematic(const double * weights, double sum_weights, unsigned long long int n, gsl_rng * r){
+  double unif_rand = gsl_ran_flat(r,0,1)*(1.0/((double)n));
+  double cum_weights = 0;
+  unsigned long long int k = 0, last = 0;
+  for(unsigned long long int i=0; i<n && k<n; i++){
+    cum_weights += weights[i];
+    if(weights[i]>0)
+      last = i;
+    while(k<n && (cum_weights/sum_weights - unif_rand) > ((double)k)/((double)n)){
+      m_counts[i]++;
+      k++;
+    }
+  }
+  //rounding in the cumulative sum can leave the last stratum unassigned
+  m_counts[last] += n-k;
+}
+
+//as systematic but with an independent uniform in each stratum
+void Resampler::stratified(const double * weights, double sum_weights, unsigned long long int n, gsl_rng * r){
+  double cum_weights = 0;
+  double point = gsl_ran_flat(r,0,1)/((double)n);
+  unsigned long long int k = 0, last = 0;
+  for(unsigned long long int i=0; i<n && k<n; i++){
+    cum_weights += weights[i];
+    if(weights[i]>0)
+      last = i;
+    while(k<n && cum_weights/sum_weights > point){
+      m_counts[i]++;
+      k++;
+      point = (k+gsl_ran_flat(r,0,1))/((double)n);
+    }
+  }
+  m_counts[last] += n-k;
+}
+
+//floor(n w_i) copies deterministically, the remainder drawn multinomially from the residual weights
+void Resampler::residual(const double * weights, double sum_weights, unsigned long long int n, gsl_rng * r){
+  unsigned long long int assigned = 0;
+  double sum_residuals = 0;
+  for(unsigned long long int i=0; i<n; i++){
+    double expected = n*weights[i]/sum_weights;
+    unsigned long long int copies = (unsigned long long int)floor(expected);
+    m_counts[i] = copies;
+    assigned += copies;
+    m_residuals[i] = expected-copies;
+    sum_residuals += m_residuals[i];
+  }
+  if(assigned < n)
+    multinomial(m_residuals,sum_residuals,n,n-assigned,r);
+}
+
+void Resampler::multinomial(const double * weights, double sum_weights, unsigned long long int n, unsigned long long int draws, gsl_rng * r){
+  build_alias_table(weights,sum_weights,n);
+  for(unsigned long long int d=0; d<draws; d++){
+    unsigned long long int i = gsl_rng_uniform_int(r,n);
+    if(gsl_rng_uniform(r) < m_alias_prob[i])
+      m_counts[i]++;
+    else
+      m_counts[m_alias[i]]++;
+  }
+}
+
+//Vose's alias method: O(n) construction, O(1) per draw
+void Resampler::build_alias_table(const double * weights, double sum_weights, unsigned long long int n){
+  unsigned long long int num_small = 0, num_large = 0;
+  for(unsigned long long int i=0; i<n; i++){
+    m_alias_prob[i] = n*weights[i]/sum_weights;
+    m_alias[i] = i;
+    if(m_alias_prob[i] < 1)
+      m_small[num_small++] = i;
+    else
+      m_large[num_large++] = i;
+  }
+  while(num_small && num_large){
+    unsigned long long int s = m_small[--num_small];
+    unsigned long long int l = m_large[num_large-1];
+    m_alias[s] = l;
+    m_alias_prob[l] -= 1-m_alias_prob[s];
+    if(m_alias_prob[l] < 1){
+      num_large--;
+      m_small[num_small++] = l;
+    }
+  }
+  while(num_large)
+    m_alias_prob[m_large[--num_large]] = 1;
+  while(num_small)
+    m_alias_prob[m_small[--num_small]] = 1;
+}
+
+void Resampler::counts_to_indices(unsigned long long int n){
+  unsigned long long int j = 0;
+  for(unsigned long long int i=0; i<n && j<n; i++){
+    for(unsigned long long int c=0; c<m_counts[i] && j<n; c++)
+      m_indices[j++] = i;
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef RESAMPLING_HPP
+#define RESAMPLING_HPP
+
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <iostream>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+
+using namespace std;
+
+enum Resampling_Type { SYSTEMATIC, STRATIFIED, RESIDUAL, MULTINOMIAL };
+
+/*O(N) resampling of a weighted sample. The offspring counts and the sorted
+  ancestor indices are held in buffers which are only reallocated when the
+  sample grows, so repeated calls do not allocate.*/
+class Resampler{
+
+ public:
+  Resampler(Resampling_Type=SYSTEMATIC);
+  ~Resampler();
+  void set_resampling_type(Resampling_Type type){ m_resampling_type = type; }
+  Resampling_Type get_resampling_type() const{ return m_resampling_type; }
+  static Resampling_Type resampling_type_from_string(const string &);
+  static const char * resampling_type_to_string(Resampling_Type);
+  /*weights are unnormalised (eg exponentiated log weights), sum_weights is their total*/
+  void resample(const double * weights, double sum_weights, unsigned long long int n, gsl_rng * r);
+  unsigned long long int * get_counts(){ return m_counts; }
+  unsigned long long int * get_indices(){ return m_indices; }
+  unsigned long long int get_size() const{ return m_size; }
+  /*reorder sample in place so that position j holds sample[m_indices[j]]; duplicates end up adjacent*/
+  template<class P> void permute_in_place(P * sample) const;
+
+ private:
+  Resampling_Type m_resampling_type;
+  unsigned long long int m_size;
+  unsigned long long int m_capacity;
+  unsigned long long int * m_counts;
+  unsigned long long int * m_indices;
+  double * m_alias_prob;
+  double * m_residuals;
+  unsigned long long int * m_alias;
+  unsigned long long int * m_small;
+  unsigned long long int * m_large;
+
+  void reserve(unsigned long long int);
+  void systematic(const double *, double, unsigned long long int, gsl_rng *);
+  void stratified(const double *, double, unsigned long long int, gsl_rng *);
+  void residual(const double *, double, unsigned long long int, gsl_rng *);
+  void multinomial(const double *, double, unsigned long long int, unsigned long long int, gsl_rng *);
+  void build_alias_table(const double *, double, unsigned long long int);
+  void counts_to_indices(unsigned long long int);
+};
+
+/*m_indices is non-decreasing, so entries with m_indices[j]>=j can be filled
+  in ascending order and the rest in descending order without a second buffer.*/
+template<class P>
+void Resampler::permute_in_place(P * sample) const{
+  unsigned long long int j;
+  for(j=0; j<m_size; j++){
+    if(m_indices[j]>=j)
+      sample[j] = sample[m_indices[j]];
+  }
+  for(j=m_size; j>0; j--){
+    if(m_indices[j-1]<j-1)
+      sample[j-1] = sample[m_indices[j-1]];
+  }
+}
+
+#endif
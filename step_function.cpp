@@ -2,6 +2,7 @@
 
 Step_Function::Step_Function(double* knots, double* heights, unsigned int num_knots, double end, bool do_cumulative)
 {
+  m_bucket_first = NULL;
   m_num_knots = num_knots;
   m_end = end;
   m_knots = new double[ m_num_knots ];
@@ -14,15 +15,18 @@ Step_Function::Step_Function(double* knots, double* heights, unsigned int num_kn
   m_cumulative = NULL;
   if(do_cumulative)
     calculate_cumulative_function();
+  build_index();
 }
 
 Step_Function::Step_Function(vector<double>* knots, vector<double>* heights, double end, bool do_cumulative)
 {
+   m_bucket_first = NULL;
    construct_step_function(knots,heights,end,do_cumulative);
 }
 
 Step_Function::Step_Function(const string input_filename, double end, bool do_cumulative)
 {
+  m_bucket_first = NULL;
   m_num_knots = 0;
   ifstream InputStream(input_filename.c_str(), ios::out);
   if(!InputStream.is_open())
@@ -48,6 +52,7 @@ Step_Function::Step_Function(const string input_filename, double end, bool do_cu
 
 Step_Function::Step_Function( const Step_Function* f )
 {
+  m_bucket_first = NULL;
   m_num_knots = f->m_num_knots;
   if(m_num_knots){
     m_knots = new double[ m_num_knots ];
@@ -62,6 +67,7 @@ Step_Function::Step_Function( const Step_Function* f )
     calculate_cumulative_function();
   else
     m_end_cumulative = 1;
+  build_index();
 }
 
 void Step_Function::construct_step_function(vector<double>* knots, vector<double>* heights, double end, bool do_cumulative){
@@ -80,6 +86,7 @@ void Step_Function::construct_step_function(vector<double>* knots, vector<double
     calculate_cumulative_function();
   else
     m_end_cumulative = 1; 
+  build_index();
 }
 
 Step_Function::~Step_Function(){
@@ -89,6 +96,44 @@ Step_Function::~Step_Function(){
     if(m_cumulative)
       delete [] m_cumulative;
   }
+  if(m_bucket_first)
+    delete [] m_bucket_first;
+}
+
+void Step_Function::build_index(){
+  if(m_bucket_first)
+    delete [] m_bucket_first;
+  m_bucket_first = NULL;
+  m_num_buckets = 0;
+  if(m_num_knots < 2 || !(m_knots[m_num_knots-1] > m_knots[0]))
+    return;
+  m_num_buckets = m_num_knots;
+  m_bucket_scale = m_num_buckets/(m_knots[m_num_knots-1]-m_knots[0]);
+  m_bucket_first = new unsigned int[ m_num_buckets ];
+  unsigned int j = 0;
+  for(unsigned int b = 0; b < m_num_buckets; b++ ){
+    double left = m_knots[0] + b/m_bucket_scale;
+    while( j < m_num_knots && !(left < m_knots[j]) )
+      j++;
+    m_bucket_first[b] = j;
+  }
+}
+
+//the first knot after t, as the linear scan from the first knot finds it
+unsigned int Step_Function::indexed_position( double t ) const{
+  if(m_num_knots==0||t<m_knots[0])
+    return 0;
+  unsigned int j = 0;
+  if(m_bucket_first){
+    double x = (t-m_knots[0])*m_bucket_scale;
+    j = m_bucket_first[ x < m_num_buckets ? (unsigned int)x : m_num_buckets-1 ];
+    //the bucket may be one out by rounding
+    while( j > 0 && t < m_knots[j-1] )
+      j--;
+  }
+  while( j < m_num_knots && !(t < m_knots[j]) )
+    j++;
+  return j;
 }
 
 void Step_Function::calculate_cumulative_function(){
@@ -102,6 +147,8 @@ void Step_Function::calculate_cumulative_function(){
 }
 
 unsigned int Step_Function::find_position_in_knots( double t, bool bisection, unsigned int l, unsigned int h ){
+  if( !bisection && l == 0 && h == 0 )
+    return indexed_position(t);
   if( l == m_num_knots )
     return m_num_knots;
   if(m_num_knots==0||t<m_knots[l])
@@ -143,7 +190,34 @@ double Step_Function::cumulative_function( double t ){
   return num_repeats * m_end_cumulative + m_cumulative[t_pos-1] + (t-m_knots[t_pos-1])*m_heights[t_pos-1];
 }
 
+unsigned int Step_Function::find_position_from_cursor( double t, unsigned int & cursor ){
+  if(m_num_knots==0||t<m_knots[0])
+    return cursor = 0;
+  unsigned int j = cursor < m_num_knots ? cursor : m_num_knots;
+  if( j > 0 && t < m_knots[j-1] ){
+    if( j > 1 && t < m_knots[j-2] )
+      j = indexed_position(t);
+    else
+      j--;
+  }else{
+    //a few steps forward, further than that is left to the index
+    for( unsigned int steps = 0; j < m_num_knots && !(t < m_knots[j]); steps++ ){
+      if( steps == 4 ){
+	j = indexed_position(t);
+	break;
+      }
+      j++;
+    }
+  }
+  return cursor = j;
+}
+
 double Step_Function::cumulative_function( double s, double t ){
+  unsigned int cursor = 0;
+  return cumulative_function( s, t, cursor );
+}
+
+double Step_Function::cumulative_function( double s, double t, unsigned int & cursor ){
   unsigned int num_repeats_s = 0, num_repeats_t = 0;
   if(s>m_end){
     num_repeats_s = (unsigned int)(s/m_end);
@@ -154,13 +228,20 @@ double Step_Function::cumulative_function( double s, double t ){
      t -= num_repeats_t * m_end;
   }
   double cum = (num_repeats_t - num_repeats_s) * m_end_cumulative;
-  unsigned int s_pos = find_position_in_knots(s);
-  unsigned int t_pos = find_position_in_knots(t);//,true,s_pos);//assumes t>s
+  unsigned int s_pos = find_position_from_cursor(s,cursor);
+  unsigned int t_pos = find_position_from_cursor(t,cursor);
   if(s_pos==t_pos)
     return cum+(t-s)*m_heights[t_pos-1];
   return cum+m_cumulative[t_pos-1] + (t-m_knots[t_pos-1])*m_heights[t_pos-1] - m_cumulative[s_pos-1] - (s-m_knots[s_pos-1])*m_heights[s_pos-1];
 }
 
+//consecutive pairs share the cursor, so sweeps through the knots cost little more than the pairs
+void Step_Function::cumulative_function_batch( const double* s, const double* t, unsigned int n, double* out ){
+  unsigned int cursor = 0;
+  for(unsigned int i = 0; i < n; i++ )
+    out[i] = cumulative_function( s[i], t[i], cursor );
+}
+
 Step_Function* Step_Function::combine_with_step_function( Step_Function* f, bool multiply ){
   if(!f->m_num_knots)
     return new Step_Function(this);
@@ -26,10 +26,16 @@ public:
   ~Step_Function();
   void construct_step_function(vector<double>* knots, vector<double>* heights, double end, bool do_cumulative);
   void calculate_cumulative_function();
+  /*the number of knots at or before t; over all the knots (no l or h) this uses the knot index*/
   unsigned int find_position_in_knots( double t, bool bisection = false, unsigned int l = 0, unsigned int h = 0 );
+  /*the same, starting from cursor, a position found before, which is moved to the result:
+    a few comparisons when the times sweep forwards*/
+  unsigned int find_position_from_cursor( double t, unsigned int & cursor );
   virtual double function( double t );
   virtual double cumulative_function( double t );
   virtual double cumulative_function( double s, double t );
+  double cumulative_function( double s, double t, unsigned int & cursor );
+  virtual void cumulative_function_batch( const double* s, const double* t, unsigned int n, double* out );
   double get_end_cumulative(){ return m_end_cumulative; }
   double* get_changepoints(){ return m_knots; }
   double* get_heights(){ return m_heights; }
@@ -51,6 +57,13 @@ protected:
   double m_end_cumulative;//the integral of the step function up to m_end
   double* m_cumulative;//the integral of the step function up to each knot point
   unsigned int m_num_knots;
+  /*knot index: the knots are split into m_num_buckets equal buckets between the first and
+    last knot, m_bucket_first[b] the position of the left end of bucket b*/
+  unsigned int* m_bucket_first;
+  unsigned int m_num_buckets;
+  double m_bucket_scale;
+  void build_index();
+  unsigned int indexed_position( double t ) const;
 };
 
 
@@ -0,0 +1,90 @@
+#include "telemetry.hpp"
+
+Telemetry::Telemetry(ostream & out, int first_process)
+  :m_out(out),m_process_offset(first_process)
+{
+  begin_interval();
+}
+
+double Telemetry::elapsed_ms(const struct timespec & t0, const struct timespec & t1){
+  return (t1.tv_sec-t0.tv_sec)*1000.0 + (t1.tv_nsec-t0.tv_nsec)/1000000.0;
+}
+
+const char * Telemetry::stage_name(Telemetry_Stage stage){
+  switch(stage){
+  case SAMPLE_STAGE: return "sample";
+  case JOIN_STAGE: return "join";
+  case ESS_STAGE: return "ess";
+  case RESAMPLE_STAGE: return "resample";
+  case REJUVENATE_STAGE: return "rejuvenate";
+  case FOI_STAGE: return "foi";
+  case RETIRE_STAGE: return "retire";
+  default: return "unknown";
+  }
+}
+
+void Telemetry::begin_interval(){
+  for(int s=0; s<NUM_TELEMETRY_STAGES; s++){
+    m_wall_ms[s] = 0;
+    m_cpu_ms[s] = 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC,&m_interval_wall);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&m_interval_cpu);
+}
+
+void Telemetry::begin_stage(Telemetry_Stage){
+  clock_gettime(CLOCK_MONOTONIC,&m_stage_wall);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&m_stage_cpu);
+}
+
+//a stage may run several times in an interval, eg once per process, the times add up
+void Telemetry::end_stage(Telemetry_Stage stage){
+  struct timespec wall, cpu;
+  clock_gettime(CLOCK_MONOTONIC,&wall);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&cpu);
+  m_wall_ms[stage] += elapsed_ms(m_stage_wall,wall);
+  m_cpu_ms[stage] += elapsed_ms(m_stage_cpu,cpu);
+}
+
+void Telemetry::begin_record(unsigned int interval, double end, unsigned long long int particles_allocated){
+  struct timespec wall, cpu;
+  clock_gettime(CLOCK_MONOTONIC,&wall);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&cpu);
+  m_out << "{\"interval\":" << interval << ",\"end\":" << end;
+  m_out << ",\"wall_ms\":{\"total\":" << elapsed_ms(m_interval_wall,wall);
+  for(int s=0; s<NUM_TELEMETRY_STAGES; s++)
+    m_out << ",\"" << stage_name((Telemetry_Stage)s) << "\":" << m_wall_ms[s];
+  m_out << "},\"cpu_ms\":{\"total\":" << elapsed_ms(m_interval_cpu,cpu);
+  for(int s=0; s<NUM_TELEMETRY_STAGES; s++)
+    m_out << ",\"" << stage_name((Telemetry_Stage)s) << "\":" << m_cpu_ms[s];
+  m_out << "},\"particles_allocated\":" << particles_allocated << ",\"processes\":[";
+  m_first_process = true;
+}
+
+void Telemetry::begin_process(int ds){
+  if(!m_first_process)
+    m_out << ',';
+  m_first_process = false;
+  m_out << "{\"ds\":" << ds+m_process_offset;
+}
+
+//JSON has no infinities or NaNs
+void Telemetry::field(const char * name, double value){
+  m_out << ",\"" << name << "\":";
+  if(value == value && value-value == 0)
+    m_out << value;
+  else
+    m_out << "null";
+}
+
+void Telemetry::field(const char * name, unsigned long long int value){
+  m_out << ",\"" << name << "\":" << value;
+}
+
+void Telemetry::end_process(){
+  m_out << '}';
+}
+
+void Telemetry::end_record(){
+  m_out << "]}" << endl;
+}
@@ -0,0 +1,45 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+#include <iostream>
+#include <time.h>
+
+using namespace std;
+
+enum Telemetry_Stage { SAMPLE_STAGE, JOIN_STAGE, ESS_STAGE, RESAMPLE_STAGE, REJUVENATE_STAGE, FOI_STAGE, RETIRE_STAGE, NUM_TELEMETRY_STAGES };
+
+/*Per interval timings of the stages of an SMC update, streamed as one JSON object per
+  line and flushed so that a run can be followed as it goes. Wall and CPU (all threads of
+  the process) times are in milliseconds. A record is written as
+
+  begin_record(...), then for each process begin_process(ds), field(...)..., end_process(),
+  then end_record()*/
+class Telemetry{
+
+ public:
+  /*first_process is added to the process indices written, eg when the processes are split over workers*/
+  Telemetry(ostream & out, int first_process = 0);
+  void begin_interval();
+  void begin_stage(Telemetry_Stage);
+  void end_stage(Telemetry_Stage);
+  void begin_record(unsigned int interval, double end, unsigned long long int particles_allocated);
+  void begin_process(int ds);
+  void field(const char * name, double value);
+  void field(const char * name, unsigned long long int value);
+  void end_process();
+  void end_record();
+  static const char * stage_name(Telemetry_Stage);
+
+ private:
+  ostream & m_out;
+  int m_process_offset;
+  struct timespec m_interval_wall, m_interval_cpu;
+  struct timespec m_stage_wall, m_stage_cpu;
+  double m_wall_ms[NUM_TELEMETRY_STAGES];
+  double m_cpu_ms[NUM_TELEMETRY_STAGES];
+  bool m_first_process;
+
+  static double elapsed_ms(const struct timespec &, const struct timespec &);
+};
+
+#endif
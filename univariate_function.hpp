@@ -7,6 +7,11 @@ class Univariate_Function
   virtual double function( double t ) = 0;
   virtual double cumulative_function( double t ) = 0;
   virtual double cumulative_function( double s, double t ) = 0;
+  /*out[i] = cumulative_function(s[i],t[i]) for i<n*/
+  virtual void cumulative_function_batch( const double* s, const double* t, unsigned int n, double* out ){
+    for(unsigned int i = 0; i < n; i++)
+      out[i] = cumulative_function( s[i], t[i] );
+  }
   virtual ~Univariate_Function(){;}
 
 };